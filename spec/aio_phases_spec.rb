@@ -0,0 +1,68 @@
+RSpec.describe "pg_smgrstat async read phases" do
+  def cold_scan_phases(table)
+    conn.exec("CREATE TABLE #{table} (id int, data text)")
+    conn.exec("INSERT INTO #{table} SELECT g, repeat('x', 200) FROM generate_series(1, 50000) g")
+    conn.exec("CHECKPOINT")
+    pg.evict_buffers(dbname: TEST_DATABASE)
+    conn.exec("SELECT count(*) FROM #{table}")
+
+    relfilenode = lookup_relfilenode(conn, table)
+    stats_conn.exec(<<~SQL)[0]
+      SELECT read_count, read_total_us, aio_stage_hist, aio_stage_count, aio_stage_total_us,
+             aio_device_count, aio_device_total_us, aio_completion_count, aio_completion_total_us
+      FROM smgr_stats.current() WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+  end
+
+  def expect_consistent_phases(row)
+    count = row["aio_stage_count"].to_i
+    expect(count).to be > 0
+    expect(count).to be <= row["read_count"].to_i
+    expect(row["aio_device_count"].to_i).to eq(count)
+    expect(row["aio_completion_count"].to_i).to eq(count)
+
+    bins = row["aio_stage_hist"].gsub(/[{}]/, '').split(',').map(&:to_i)
+    expect(bins.sum).to eq(count)
+
+    # The phases split the reads they were stamped for, so they can't exceed the total
+    phases = %w[aio_stage_total_us aio_device_total_us aio_completion_total_us].sum { |c| row[c].to_i }
+    expect(phases).to be <= row["read_total_us"].to_i
+  end
+
+  describe "with I/O workers" do
+    include_context "pg instance"
+
+    it "splits async reads into stage, device and completion phases" do
+      expect_consistent_phases(cold_scan_phases("test_aio_phases_worker"))
+    end
+
+    it "reports the io_method" do
+      expect(status_value("io_method")).to eq("worker")
+    end
+  end
+
+  describe "with synchronous AIO", extra_config: {"io_method" => "sync"} do
+    include_context "pg instance"
+
+    it "splits async reads completed by the issuer" do
+      expect_consistent_phases(cold_scan_phases("test_aio_phases_sync"))
+    end
+  end
+
+  describe "collected", extra_config: {"smgr_stats.collection_interval" => "2"} do
+    include_context "pg instance"
+
+    it "tags history rows with the io_method" do
+      cold_scan_phases("test_aio_phases_history")
+      relfilenode = lookup_relfilenode(conn, "test_aio_phases_history")
+      sleep 3
+
+      result = stats_conn.exec(<<~SQL)
+        SELECT sum(aio_device_count) AS n, min(io_method) AS io_method
+        FROM smgr_stats.history WHERE relnumber = #{relfilenode} AND forknum = 0
+      SQL
+      expect(result[0]["n"].to_i).to be > 0
+      expect(result[0]["io_method"]).to eq("worker")
+    end
+  end
+end
@@ -0,0 +1,45 @@
+RSpec.describe "pg_smgrstat backend buffering",
+               extra_config: {"smgr_stats.backend_buffering" => "on"} do
+  include_context "pg instance"
+
+  it "is enabled by configuration" do
+    result = conn.exec("SHOW smgr_stats.backend_buffering")
+    expect(result[0]["smgr_stats.backend_buffering"]).to eq("on")
+  end
+
+  it "flushes buffered reads at statement end" do
+    conn.exec("CREATE TABLE test_buffered (id int, data text)")
+    conn.exec("INSERT INTO test_buffered SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+    conn.exec("CHECKPOINT")
+    pg.evict_buffers(dbname: TEST_DATABASE)
+    conn.exec("SELECT count(*) FROM test_buffered")
+
+    relfilenode = lookup_relfilenode(conn, "test_buffered")
+    result = stats_conn.exec(<<~SQL)
+      SELECT reads, read_blocks, read_count, sequential_reads
+      FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+    expect(result.ntuples).to eq(1)
+    expect(result[0]["reads"].to_i).to be > 0
+    expect(result[0]["read_blocks"].to_i).to be > 0
+    expect(result[0]["read_count"].to_i).to eq(result[0]["reads"].to_i)
+    expect(result[0]["sequential_reads"].to_i).to be > 0
+  end
+
+  it "resolves metadata for entries created by a flush" do
+    conn.exec("CREATE TABLE test_buffered_meta (id int)")
+    conn.exec("INSERT INTO test_buffered_meta SELECT g FROM generate_series(1, 1000) g")
+    conn.exec("CHECKPOINT")
+    pg.evict_buffers(dbname: TEST_DATABASE)
+    conn.exec("SELECT count(*) FROM test_buffered_meta")
+
+    relfilenode = lookup_relfilenode(conn, "test_buffered_meta")
+    result = stats_conn.exec(<<~SQL)
+      SELECT relname FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+    expect(result.ntuples).to eq(1)
+    expect(result[0]["relname"]).to eq("test_buffered_meta")
+  end
+end
@@ -0,0 +1,47 @@
+RSpec.describe "pg_smgrstat backend type attribution" do
+  def rows_by_type(relfilenode)
+    stats_conn.exec(<<~SQL).to_a.to_h { |r| [r["backend_type"], r] }
+      SELECT backend_type, writes, extends, relname FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+  end
+
+  describe "enabled", extra_config: {"smgr_stats.track_backend_type" => "on"} do
+    include_context "pg instance"
+
+    it "splits a relation's I/O by the process type that did it" do
+      conn.exec("CREATE TABLE test_backend_type (id int, data text)")
+      conn.exec("INSERT INTO test_backend_type SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+      conn.exec("CHECKPOINT")
+
+      rows = rows_by_type(lookup_relfilenode(conn, "test_backend_type"))
+      expect(rows.keys).to include("client backend", "checkpointer")
+      expect(rows["client backend"]["extends"].to_i).to be > 0
+      expect(rows["checkpointer"]["writes"].to_i).to be > 0
+      expect(rows["checkpointer"]["extends"].to_i).to eq(0)
+    end
+
+    it "gives the checkpointer's rows the relation's metadata" do
+      conn.exec("CREATE TABLE test_backend_type_meta (id int, data text)")
+      conn.exec("INSERT INTO test_backend_type_meta SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+      conn.exec("CHECKPOINT")
+
+      rows = rows_by_type(lookup_relfilenode(conn, "test_backend_type_meta"))
+      expect(rows["checkpointer"]["relname"]).to eq("test_backend_type_meta")
+      expect(rows["client backend"]["relname"]).to eq("test_backend_type_meta")
+    end
+  end
+
+  describe "disabled" do
+    include_context "pg instance"
+
+    it "keeps one row per fork with no backend type" do
+      conn.exec("CREATE TABLE test_backend_type_off (id int, data text)")
+      conn.exec("INSERT INTO test_backend_type_off SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+      conn.exec("CHECKPOINT")
+
+      rows = rows_by_type(lookup_relfilenode(conn, "test_backend_type_off"))
+      expect(rows.keys).to eq([nil])
+    end
+  end
+end
@@ -0,0 +1,44 @@
+RSpec.describe "pg_smgrstat cold page cache release",
+               extra_config: {"smgr_stats.cold_release_buckets" => "1", "smgr_stats.collection_interval" => "2"} do
+  include_context "pg instance"
+
+  def release_log(relfilenode)
+    stats_conn.exec("SELECT * FROM smgr_stats.cache_release_log WHERE relnumber = #{relfilenode}")
+  end
+
+  it "releases relations that went idle and logs it once" do
+    conn.exec("CREATE TABLE test_cold (id int, data text)")
+    conn.exec("INSERT INTO test_cold SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+    conn.exec("CHECKPOINT")
+    relfilenode = lookup_relfilenode(conn, "test_cold")
+
+    # One bucket with I/O, then idle buckets
+    sleep 8
+
+    result = release_log(relfilenode)
+    expect(result.ntuples).to eq(1)
+    row = result[0]
+    expect(row["relname"]).to eq("test_cold")
+    expect(row["segments"].to_i).to be >= 1
+    expect(row["bytes"].to_i).to be > 0
+    expect(row["last_bucket_id"].to_i).to be < row["bucket_id"].to_i
+
+    # The table still reads fine
+    expect(conn.exec("SELECT count(*) AS n FROM test_cold")[0]["n"].to_i).to eq(5000)
+  end
+
+  it "leaves busy relations alone" do
+    conn.exec("CREATE TABLE test_warm (id int, data text)")
+    conn.exec("INSERT INTO test_warm SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+    relfilenode = lookup_relfilenode(conn, "test_warm")
+
+    # Read well within every bucket
+    12.times do
+      pg.evict_buffers(dbname: TEST_DATABASE)
+      conn.exec("SELECT count(*) FROM test_warm")
+      sleep 0.5
+    end
+
+    expect(release_log(relfilenode).ntuples).to eq(0)
+  end
+end
@@ -0,0 +1,32 @@
+RSpec.describe "pg_smgrstat collector I/O", extra_config: {"smgr_stats.collection_interval" => "2"} do
+  include_context "pg instance"
+
+  def history_relnumber
+    stats_conn.exec("SELECT pg_relation_filenode('smgr_stats.history') AS n")[0]["n"].to_i
+  end
+
+  it "records the collector's own I/O under a synthetic entry" do
+    conn.exec("CREATE TABLE test_collector_io (id int, data text)")
+    conn.exec("INSERT INTO test_collector_io SELECT g, repeat('x', 100) FROM generate_series(1, 20000) g")
+    sleep 5
+
+    result = stats_conn.exec(<<~SQL)
+      SELECT relname, sum(reads + extends + writes) AS ops FROM smgr_stats.history
+      WHERE spcoid = 0 AND dboid = 0 AND relnumber = 0 AND relkind = 'C'
+      GROUP BY relname
+    SQL
+    expect(result.ntuples).to eq(1)
+    expect(result[0]["relname"]).to eq("<pg_smgrstat collector>")
+    expect(result[0]["ops"].to_i).to be > 0
+  end
+
+  it "keeps the collector's inserts out of the history table's own entry" do
+    sleep 5
+
+    result = stats_conn.exec(<<~SQL)
+      SELECT coalesce(sum(extends), 0) AS extends FROM smgr_stats.history
+      WHERE relnumber = #{history_relnumber}
+    SQL
+    expect(result[0]["extends"].to_i).to eq(0)
+  end
+end
@@ -0,0 +1,86 @@
+RSpec.describe "pg_smgrstat tracking filters" do
+  describe "smgr_stats.enabled" do
+    include_context "pg instance"
+
+    it "stops tracking I/O while disabled" do
+      conn.exec("SET smgr_stats.enabled = off")
+      conn.exec("CREATE TABLE test_disabled (id int, data text)")
+      conn.exec("INSERT INTO test_disabled SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+      pg.evict_buffers(dbname: TEST_DATABASE)
+      conn.exec("SELECT count(*) FROM test_disabled")
+
+      relfilenode = lookup_relfilenode(conn, "test_disabled")
+      # Writes by the checkpointer/bgwriter still count, reads by this backend don't
+      result = stats_conn.exec("SELECT coalesce(sum(reads), 0) AS reads FROM smgr_stats.current() " \
+                               "WHERE relnumber = #{relfilenode}")
+      expect(result[0]["reads"].to_i).to eq(0)
+    end
+  end
+
+  describe "fork filters", extra_config: {"smgr_stats.exclude_forks" => "fsm,vm"} do
+    include_context "pg instance"
+
+    it "does not track excluded forks" do
+      conn.exec("CREATE TABLE test_forks (id int, data text)")
+      conn.exec("INSERT INTO test_forks SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+      conn.exec("VACUUM test_forks")
+      conn.exec("CHECKPOINT")
+
+      relfilenode = lookup_relfilenode(conn, "test_forks")
+      result = stats_conn.exec("SELECT forknum FROM smgr_stats.current() WHERE relnumber = #{relfilenode}")
+      expect(result.map { |r| r["forknum"].to_i }.uniq).to eq([0])
+    end
+
+    it "rejects unknown fork names" do
+      expect {
+        conn.exec("ALTER SYSTEM SET smgr_stats.exclude_forks = 'bogus'")
+      }.to raise_error(PG::InvalidParameterValue)
+    end
+  end
+
+  describe "database filters" do
+    include_context "pg instance"
+
+    it "does not track excluded databases" do
+      db_oid = test_db_oid(conn)
+      stats_conn.exec("ALTER SYSTEM SET smgr_stats.exclude_databases = '#{db_oid}'")
+      stats_conn.exec("SELECT pg_reload_conf()")
+      sleep 1
+
+      conn.exec("CREATE TABLE test_excluded_db (id int, data text)")
+      conn.exec("INSERT INTO test_excluded_db SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+      conn.exec("CHECKPOINT")
+
+      relfilenode = lookup_relfilenode(conn, "test_excluded_db")
+      result = stats_conn.exec("SELECT count(*) AS n FROM smgr_stats.current() " \
+                               "WHERE dboid = #{db_oid} AND relnumber = #{relfilenode}")
+      expect(result[0]["n"].to_i).to eq(0)
+    ensure
+      stats_conn.exec("ALTER SYSTEM RESET smgr_stats.exclude_databases")
+      stats_conn.exec("SELECT pg_reload_conf()")
+    end
+
+    it "rejects values that are not OIDs" do
+      expect {
+        stats_conn.exec("ALTER SYSTEM SET smgr_stats.include_databases = 'postgres'")
+      }.to raise_error(PG::InvalidParameterValue)
+    end
+  end
+
+  describe "relkind filters", extra_config: {"smgr_stats.exclude_relkinds" => "i"} do
+    include_context "pg instance"
+
+    it "drops excluded relation kinds once their metadata is known" do
+      conn.exec("CREATE TABLE test_relkind (id int PRIMARY KEY, data text)")
+      conn.exec("INSERT INTO test_relkind SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+      conn.exec("CHECKPOINT")
+
+      table = lookup_relfilenode(conn, "test_relkind")
+      index = lookup_relfilenode(conn, "test_relkind_pkey")
+      expect(stats_conn.exec("SELECT count(*) AS n FROM smgr_stats.current() WHERE relnumber = #{table}")[0]["n"].to_i)
+        .to be > 0
+      expect(stats_conn.exec("SELECT count(*) AS n FROM smgr_stats.current() WHERE relnumber = #{index}")[0]["n"].to_i)
+        .to eq(0)
+    end
+  end
+end
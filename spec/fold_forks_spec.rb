@@ -0,0 +1,48 @@
+RSpec.describe "pg_smgrstat fork folding", extra_config: {"smgr_stats.fold_forks" => "on"} do
+  include_context "pg instance"
+
+  it "records all forks in the main-fork entry with per-fork counters" do
+    conn.exec("CREATE TABLE test_fold (id int, data text)")
+    conn.exec("INSERT INTO test_fold SELECT g, repeat('x', 100) FROM generate_series(1, 20000) g")
+    conn.exec("VACUUM test_fold")
+    conn.exec("CHECKPOINT")
+
+    relfilenode = lookup_relfilenode(conn, "test_fold")
+    result = stats_conn.exec(<<~SQL)
+      SELECT forknum, writes, extends, fork_writes, fork_extends
+      FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode}
+    SQL
+    expect(result.ntuples).to eq(1)
+    row = result[0]
+    expect(row["forknum"].to_i).to eq(0)
+
+    fork_writes = row["fork_writes"].gsub(/[{}]/, '').split(',').map(&:to_i)
+    fork_extends = row["fork_extends"].gsub(/[{}]/, '').split(',').map(&:to_i)
+    expect(fork_writes.size).to eq(4)
+    expect(fork_writes.sum).to eq(row["writes"].to_i)
+    expect(fork_extends.sum).to eq(row["extends"].to_i)
+    # VACUUM created and wrote the FSM and VM forks
+    expect(fork_writes[1] + fork_writes[2] + fork_extends[1] + fork_extends[2]).to be > 0
+  end
+
+  it "leaves the per-fork arrays NULL when folding is off" do
+    stats_conn.exec("ALTER SYSTEM SET smgr_stats.fold_forks = off")
+    stats_conn.exec("SELECT pg_reload_conf()")
+    sleep 1
+
+    conn.exec("CREATE TABLE test_unfolded (id int)")
+    conn.exec("INSERT INTO test_unfolded SELECT g FROM generate_series(1, 1000) g")
+    conn.exec("CHECKPOINT")
+
+    relfilenode = lookup_relfilenode(conn, "test_unfolded")
+    result = stats_conn.exec(<<~SQL)
+      SELECT fork_writes IS NULL AS unfolded FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+    expect(result[0]["unfolded"]).to eq("t")
+  ensure
+    stats_conn.exec("ALTER SYSTEM RESET smgr_stats.fold_forks")
+    stats_conn.exec("SELECT pg_reload_conf()")
+  end
+end
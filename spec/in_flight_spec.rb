@@ -0,0 +1,50 @@
+RSpec.describe "pg_smgrstat in-flight I/O" do
+  include_context "pg instance"
+
+  before(:all) do
+    @pg.connect(dbname: TEST_DATABASE) { |c| c.exec("CREATE EXTENSION IF NOT EXISTS pg_smgrstat_debug") }
+  end
+
+  after do
+    conn.exec("SELECT smgr_stats_debug.clear_write_delay()")
+  end
+
+  it "lists only running processes" do
+    result = stats_conn.exec(<<~SQL)
+      SELECT f.pid, a.pid AS live_pid FROM smgr_stats.in_flight() f
+      LEFT JOIN pg_stat_activity a USING (pid)
+    SQL
+    result.each { |row| expect(row["live_pid"]).not_to be_nil }
+  end
+
+  it "shows a write while the device holds it" do
+    conn.exec("CREATE TABLE test_in_flight (id int)")
+    conn.exec("INSERT INTO test_in_flight SELECT generate_series(1, 100)")
+    relfilenode = lookup_relfilenode(conn, "test_in_flight")
+    conn.exec("SELECT smgr_stats_debug.set_write_delay(500000)")
+
+    instance = pg
+    checkpoint = Thread.new { instance.connect(dbname: TEST_DATABASE) { |c| c.exec("CHECKPOINT") } }
+    row = nil
+    deadline = Time.now + 30
+    while row.nil? && Time.now < deadline
+      result = stats_conn.exec(<<~SQL)
+        SELECT * FROM smgr_stats.in_flight() WHERE relnumber = #{relfilenode} AND op = 'write'
+      SQL
+      row = result[0] if result.ntuples > 0
+      sleep 0.05
+    end
+    conn.exec("SELECT smgr_stats_debug.clear_write_delay()")
+    checkpoint.join
+
+    expect(row).not_to be_nil
+    expect(row["forknum"].to_i).to eq(0)
+    expect(row["blocknum"]).not_to be_nil
+    expect(row["nblocks"].to_i).to be >= 1
+    expect(row["aio_id"]).to be_nil
+    expect(row["age_us"].to_i).to be >= 0
+
+    idle = stats_conn.exec("SELECT count(*) FROM smgr_stats.in_flight() WHERE relnumber = #{relfilenode}")
+    expect(idle[0]["count"].to_i).to eq(0)
+  end
+end
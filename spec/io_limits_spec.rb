@@ -0,0 +1,84 @@
+RSpec.describe "pg_smgrstat I/O rate limits" do
+  include_context "pg instance"
+
+  def throttle_count(relfilenode)
+    result = stats_conn.exec(<<~SQL)
+      SELECT coalesce(throttle_count, 0) AS n FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+    result.ntuples == 1 ? result[0]["n"].to_i : 0
+  end
+
+  before do
+    conn.exec("CREATE TABLE IF NOT EXISTS test_limited (id int, data text)")
+    conn.exec("TRUNCATE test_limited")
+    conn.exec("INSERT INTO test_limited SELECT g, repeat('x', 200) FROM generate_series(1, 50000) g")
+    conn.exec("CHECKPOINT")
+  end
+
+  after do
+    stats_conn.exec("DELETE FROM smgr_stats.io_limits")
+    stats_conn.exec("SELECT smgr_stats.reload_io_limits()")
+  end
+
+  it "does not throttle without limits" do
+    before = status_value("throttled_ops").to_i
+    scan_cold("test_limited")
+    expect(throttle_count(lookup_relfilenode(conn, "test_limited"))).to eq(0)
+    expect(status_value("throttled_ops").to_i).to eq(before)
+  end
+
+  it "throttles reads of a limited database and records the delay" do
+    stats_conn.exec("INSERT INTO smgr_stats.io_limits (dboid, iops) VALUES (#{test_db_oid(conn)}, 20)")
+    expect(stats_conn.exec("SELECT smgr_stats.reload_io_limits() AS n")[0]["n"].to_i).to eq(1)
+
+    before = status_value("throttled_ops").to_i
+    started = Time.now
+    scan_cold("test_limited")
+    elapsed = Time.now - started
+
+    expect(throttle_count(lookup_relfilenode(conn, "test_limited"))).to be > 0
+    expect(status_value("throttled_ops").to_i).to be > before
+    expect(elapsed).to be > 0.5
+    expect(conn.exec("SELECT count(*) AS n FROM test_limited")[0]["n"].to_i).to eq(50000)
+  end
+
+  it "lets a throttled read be cancelled" do
+    stats_conn.exec("INSERT INTO smgr_stats.io_limits (dboid, iops) VALUES (#{test_db_oid(conn)}, 2)")
+    stats_conn.exec("SELECT smgr_stats.reload_io_limits()")
+
+    conn.exec("SET statement_timeout = '200ms'")
+    started = Time.now
+    expect { scan_cold("test_limited") }.to raise_error(PG::QueryCanceled)
+    expect(Time.now - started).to be < 1.0
+  ensure
+    conn.exec("RESET statement_timeout")
+  end
+
+  it "does not delay writes flushed under a buffer content lock" do
+    conn.exec("UPDATE test_limited SET data = repeat('y', 200)")
+    stats_conn.exec("INSERT INTO smgr_stats.io_limits (dboid, iops) VALUES (#{test_db_oid(conn)}, 1)")
+    stats_conn.exec("SELECT smgr_stats.reload_io_limits()")
+
+    # Eviction writes each dirty page out while holding its content lock; at one op per second
+    # waiting would take many minutes
+    started = Time.now
+    pg.evict_buffers(dbname: TEST_DATABASE)
+    expect(Time.now - started).to be < 10
+  end
+
+  it "leaves relations outside a relation limit alone" do
+    conn.exec("CREATE TABLE IF NOT EXISTS test_other (id int)")
+    other = lookup_table_oid(conn, "test_other")
+    stats_conn.exec("INSERT INTO smgr_stats.io_limits (dboid, reloid, iops) VALUES (#{test_db_oid(conn)}, #{other}, 1)")
+    stats_conn.exec("SELECT smgr_stats.reload_io_limits()")
+
+    scan_cold("test_limited")
+    expect(throttle_count(lookup_relfilenode(conn, "test_limited"))).to eq(0)
+  end
+
+  it "rejects limits without a rate" do
+    expect { stats_conn.exec("INSERT INTO smgr_stats.io_limits (dboid) VALUES (1)") }
+      .to raise_error(PG::CheckViolation)
+  end
+end
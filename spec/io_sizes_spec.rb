@@ -0,0 +1,47 @@
+RSpec.describe "pg_smgrstat request size histograms" do
+  def bins(array)
+    array.nil? ? [] : array.gsub(/[{}]/, '').split(',').map(&:to_i)
+  end
+
+  def cold_scan_sizes(table)
+    conn.exec("CREATE TABLE #{table} (id int, data text)")
+    conn.exec("INSERT INTO #{table} SELECT g, repeat('x', 200) FROM generate_series(1, 50000) g")
+    conn.exec("CHECKPOINT")
+    pg.evict_buffers(dbname: TEST_DATABASE)
+    conn.exec("SELECT count(*) FROM #{table}")
+
+    relfilenode = lookup_relfilenode(conn, table)
+    stats_conn.exec(<<~SQL)[0]
+      SELECT reads, writes, extends, read_size_hist, write_size_hist, zeroextend_size_hist
+      FROM smgr_stats.current() WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+  end
+
+  describe "with combined reads" do
+    include_context "pg instance"
+
+    it "counts every request in one size bin" do
+      row = cold_scan_sizes("test_io_sizes")
+      read_bins = bins(row["read_size_hist"])
+      expect(read_bins.length).to eq(8)
+      expect(read_bins.sum).to eq(row["reads"].to_i)
+      expect(bins(row["write_size_hist"]).sum).to eq(row["writes"].to_i)
+      expect(bins(row["zeroextend_size_hist"]).sum).to be <= row["extends"].to_i
+    end
+
+    it "shows multi-block reads of a sequential scan" do
+      read_bins = bins(cold_scan_sizes("test_io_sizes_combined")["read_size_hist"])
+      expect(read_bins[1..].sum).to be > 0
+    end
+  end
+
+  describe "with io_combine_limit = 1", extra_config: {"io_combine_limit" => "1"} do
+    include_context "pg instance"
+
+    it "puts every read in the single-block bin" do
+      read_bins = bins(cold_scan_sizes("test_io_sizes_single")["read_size_hist"])
+      expect(read_bins[0]).to be > 0
+      expect(read_bins[1..].sum).to eq(0)
+    end
+  end
+end
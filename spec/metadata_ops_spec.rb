@@ -0,0 +1,50 @@
+RSpec.describe "pg_smgrstat metadata operations" do
+  include_context "pg instance"
+
+  def meta_ops(relfilenode)
+    stats_conn.exec(<<~SQL)[0]
+      SELECT coalesce(sum(nblocks_calls), 0) AS nblocks_calls, coalesce(sum(nblocks_time_us), 0) AS nblocks_time_us,
+             coalesce(sum(exists_calls), 0) AS exists_calls
+      FROM smgr_stats.current() WHERE relnumber = #{relfilenode}
+    SQL
+  end
+
+  before do
+    conn.exec("CREATE TABLE IF NOT EXISTS test_meta_ops (id int, data text)")
+    conn.exec("TRUNCATE test_meta_ops")
+    conn.exec("INSERT INTO test_meta_ops SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+  end
+
+  it "counts the size lookups of planning" do
+    relfilenode = lookup_relfilenode(conn, "test_meta_ops")
+    before = meta_ops(relfilenode)["nblocks_calls"].to_i
+
+    10.times { conn.exec("EXPLAIN SELECT * FROM test_meta_ops WHERE id = 1") }
+
+    after = meta_ops(relfilenode)
+    expect(after["nblocks_calls"].to_i).to be >= before + 10
+  end
+
+  it "counts fork existence checks" do
+    conn.exec("VACUUM test_meta_ops")
+    expect(meta_ops(lookup_relfilenode(conn, "test_meta_ops"))["exists_calls"].to_i).to be > 0
+  end
+end
+
+RSpec.describe "pg_smgrstat metadata operations export",
+               extra_config: {"smgr_stats.collection_interval" => "2"} do
+  include_context "pg instance"
+
+  it "exports metadata ops to the history table" do
+    conn.exec("CREATE TABLE test_meta_ops_history (id int)")
+    conn.exec("INSERT INTO test_meta_ops_history SELECT generate_series(1, 1000)")
+    relfilenode = lookup_relfilenode(conn, "test_meta_ops_history")
+    5.times { conn.exec("EXPLAIN SELECT * FROM test_meta_ops_history") }
+    sleep 3
+
+    result = stats_conn.exec(<<~SQL)
+      SELECT sum(nblocks_calls) AS n FROM smgr_stats.history WHERE relnumber = #{relfilenode}
+    SQL
+    expect(result[0]["n"].to_i).to be > 0
+  end
+end
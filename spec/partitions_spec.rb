@@ -0,0 +1,77 @@
+RSpec.describe "pg_smgrstat partition aggregation" do
+  def create_partitioned(conn, name, leaves: 4)
+    conn.exec("CREATE TABLE #{name} (id int, data text) PARTITION BY RANGE (id)")
+    leaves.times do |i|
+      conn.exec("CREATE TABLE #{name}_#{i} PARTITION OF #{name} FOR VALUES FROM (#{i * 10000}) TO (#{(i + 1) * 10000})")
+    end
+    # The first transaction on each leaf records it individually and maps it to the root
+    conn.exec("INSERT INTO #{name} SELECT g, repeat('x', 100) FROM generate_series(0, #{leaves * 10000 - 1}) g")
+    conn.exec("CHECKPOINT")
+  end
+
+  def root_oid(conn, name)
+    conn.exec("SELECT '#{name}'::regclass::oid AS oid")[0]["oid"].to_i
+  end
+
+  describe "aggregate mode",
+           extra_config: {"smgr_stats.track_partitions" => "aggregate", "smgr_stats.collection_interval" => "2"} do
+    include_context "pg instance"
+
+    it "records leaf I/O under the partitioned root" do
+      create_partitioned(conn, "test_parted")
+      sleep 3
+
+      pg.evict_buffers(dbname: TEST_DATABASE)
+      conn.exec("SELECT count(*) FROM test_parted")
+
+      result = stats_conn.exec(<<~SQL)
+        SELECT spcoid, relname, relkind, reads
+        FROM smgr_stats.current()
+        WHERE relnumber = #{root_oid(conn, "test_parted")} AND forknum = 0
+      SQL
+      expect(result.ntuples).to eq(1)
+      row = result[0]
+      expect(row["spcoid"].to_i).to eq(0)
+      expect(row["relname"]).to eq("test_parted")
+      expect(row["relkind"]).to eq("p")
+      expect(row["reads"].to_i).to be > 0
+
+      leaf = lookup_relfilenode(conn, "test_parted_0")
+      expect(stats_conn.exec("SELECT count(*) AS n FROM smgr_stats.current() WHERE relnumber = #{leaf}")[0]["n"].to_i)
+        .to eq(0)
+      expect(status_value("partition_leaves").to_i).to be >= 4
+    end
+  end
+
+  describe "hot leaves",
+           extra_config: {"smgr_stats.track_partitions" => "aggregate", "smgr_stats.partition_hot_leaves" => "1",
+                          "smgr_stats.collection_interval" => "2"} do
+    include_context "pg instance"
+
+    it "keeps the busiest leaf tracked individually" do
+      create_partitioned(conn, "test_hot", leaves: 2)
+      sleep 3
+
+      # Leaf 0 is the only busy one during this interval (activity is sampled every 64 ops),
+      # so the next collection makes it hot
+      6.times do
+        pg.evict_buffers(dbname: TEST_DATABASE)
+        conn.exec("SELECT count(*) FROM test_hot_0")
+      end
+      sleep 3
+
+      pg.evict_buffers(dbname: TEST_DATABASE)
+      conn.exec("SELECT count(*) FROM test_hot")
+
+      hot = lookup_relfilenode(conn, "test_hot_0")
+      cold = lookup_relfilenode(conn, "test_hot_1")
+      count_rows = ->(relnumber) {
+        stats_conn.exec("SELECT count(*) AS n FROM smgr_stats.current() " \
+                        "WHERE relnumber = #{relnumber} AND reads > 0")[0]["n"].to_i
+      }
+      expect(count_rows.call(hot)).to eq(1)
+      expect(count_rows.call(cold)).to eq(0)
+      expect(count_rows.call(root_oid(conn, "test_hot"))).to eq(1)
+    end
+  end
+end
@@ -0,0 +1,40 @@
+RSpec.describe "pg_smgrstat adaptive read-ahead" do
+  include_context "pg instance"
+
+  def prefetched_blocks
+    status_value("prefetched_blocks").to_i
+  end
+
+  before do
+    conn.exec("CREATE TABLE test_prefetch (id int, data text)")
+    conn.exec("INSERT INTO test_prefetch SELECT g, repeat('x', 100) FROM generate_series(1, 50000) g")
+    conn.exec("CHECKPOINT")
+  end
+
+  it "does not prefetch unless enabled" do
+    before = prefetched_blocks
+    scan_cold("test_prefetch")
+    expect(prefetched_blocks).to eq(before)
+  end
+
+  it "prefetches ahead of sequential scans" do
+    conn.exec("SET smgr_stats.adaptive_prefetch = on")
+    before = prefetched_blocks
+    scan_cold("test_prefetch")
+    expect(prefetched_blocks).to be > before
+
+    # Results are unaffected
+    expect(conn.exec("SELECT count(*) AS n FROM test_prefetch")[0]["n"].to_i).to eq(50000)
+  end
+
+  it "reads ahead most of a long scan once the table has run history" do
+    conn.exec("SET smgr_stats.adaptive_prefetch = on")
+    pages = conn.exec("SELECT pg_relation_size('test_prefetch') / 8192 AS n")[0]["n"].to_i
+    scan_cold("test_prefetch")
+
+    # The second scan's first read completes the first one's run, which sets the expected length
+    before = prefetched_blocks
+    scan_cold("test_prefetch")
+    expect(prefetched_blocks - before).to be > [1, pages / 2].max
+  end
+end
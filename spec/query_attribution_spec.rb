@@ -0,0 +1,61 @@
+RSpec.describe "pg_smgrstat per-query attribution" do
+  def setup_table(table)
+    conn.exec("CREATE TABLE #{table} (id int, data text)")
+    conn.exec("INSERT INTO #{table} SELECT g, repeat('x', 200) FROM generate_series(1, 20000) g")
+    conn.exec("CHECKPOINT")
+  end
+
+  describe "enabled", extra_config: {"smgr_stats.query_top_n" => "100", "compute_query_id" => "on"} do
+    include_context "pg instance"
+
+    it "attributes a statement's reads and extends to its queryid" do
+      setup_table("test_query_attr")
+      scan_cold("test_query_attr")
+      relfilenode = lookup_relfilenode(conn, "test_query_attr")
+
+      rows = stats_conn.exec(<<~SQL).to_a
+        SELECT queryid, sum(read_blocks) AS read_blocks, sum(extend_blocks) AS extend_blocks
+        FROM smgr_stats.current_by_query()
+        WHERE relnumber = #{relfilenode} AND forknum = 0
+        GROUP BY queryid
+      SQL
+      expect(rows).not_to be_empty
+      expect(rows.map { |r| r["queryid"].to_i }).not_to include(0)
+      expect(rows.sum { |r| r["read_blocks"].to_i }).to be > 0
+      expect(rows.sum { |r| r["extend_blocks"].to_i }).to be > 0
+      # The scan and the insert are different statements
+      expect(rows.count { |r| r["read_blocks"].to_i > 0 && r["extend_blocks"].to_i == 0 }).to be >= 1
+    end
+  end
+
+  describe "collected",
+           extra_config: {"smgr_stats.query_top_n" => "100", "compute_query_id" => "on",
+                          "smgr_stats.collection_interval" => "2"} do
+    include_context "pg instance"
+
+    it "persists each bucket into query_history" do
+      setup_table("test_query_hist")
+      scan_cold("test_query_hist")
+      relfilenode = lookup_relfilenode(conn, "test_query_hist")
+      sleep 5
+
+      result = stats_conn.exec(<<~SQL)
+        SELECT count(*) AS n, sum(read_blocks) AS read_blocks, min(bucket_id) AS bucket_id
+        FROM smgr_stats.query_history WHERE relnumber = #{relfilenode}
+      SQL
+      expect(result[0]["n"].to_i).to be > 0
+      expect(result[0]["read_blocks"].to_i).to be > 0
+      expect(result[0]["bucket_id"]).not_to be_nil
+    end
+  end
+
+  describe "disabled" do
+    include_context "pg instance"
+
+    it "attributes nothing" do
+      setup_table("test_query_off")
+      scan_cold("test_query_off")
+      expect(stats_conn.exec("SELECT count(*) AS n FROM smgr_stats.current_by_query()")[0]["n"].to_i).to eq(0)
+    end
+  end
+end
@@ -0,0 +1,39 @@
+RSpec.describe "pg_smgrstat sampled timing",
+               extra_config: {"smgr_stats.timing_sample_rate" => "4", "smgr_stats.collection_interval" => "2"} do
+  include_context "pg instance"
+
+  it "counts every write but times only a sample, scaled by the rate" do
+    conn.exec("CREATE TABLE test_sampled (id int, data text)")
+    conn.exec("INSERT INTO test_sampled SELECT g, repeat('x', 100) FROM generate_series(1, 20000) g")
+    conn.exec("CHECKPOINT")
+
+    relfilenode = lookup_relfilenode(conn, "test_sampled")
+    result = stats_conn.exec(<<~SQL)
+      SELECT writes, write_hist, write_count, timing_sample_rate
+      FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+    expect(result.ntuples).to eq(1)
+    row = result[0]
+    expect(row["writes"].to_i).to be > 0
+    expect(row["timing_sample_rate"].to_i).to eq(4)
+
+    # Each timed write stands for 4 writes
+    write_count = row["write_count"].to_i
+    expect(write_count % 4).to eq(0)
+    expect(write_count).to be <= row["writes"].to_i + 4
+    bins = row["write_hist"].gsub(/[{}]/, '').split(',').map(&:to_i)
+    expect(bins.sum).to eq(write_count)
+  end
+
+  it "records the rate in history" do
+    conn.exec("CREATE TABLE test_sampled_hist (id int, data text)")
+    conn.exec("INSERT INTO test_sampled_hist SELECT g, repeat('x', 100) FROM generate_series(1, 20000) g")
+    conn.exec("CHECKPOINT")
+
+    sleep 3
+
+    result = stats_conn.exec("SELECT count(*) AS n FROM smgr_stats.history WHERE timing_sample_rate = 4")
+    expect(result[0]["n"].to_i).to be > 0
+  end
+end
@@ -0,0 +1,81 @@
+RSpec.describe "pg_smgrstat slow I/O capture" do
+  SLOW_IO_WRITE_DELAY_US = 200_000
+
+  def delayed_checkpoint(table)
+    conn.exec("CREATE TABLE #{table} (id int)")
+    conn.exec("INSERT INTO #{table} SELECT generate_series(1, 100)")
+    conn.exec("SELECT smgr_stats_debug.set_write_delay(#{SLOW_IO_WRITE_DELAY_US})")
+    conn.exec("CHECKPOINT")
+    conn.exec("SELECT smgr_stats_debug.clear_write_delay()")
+    lookup_relfilenode(conn, table)
+  end
+
+  describe "current bucket", extra_config: {"smgr_stats.slow_io_threshold" => "100ms"} do
+    include_context "pg instance"
+
+    before(:all) do
+      @pg.connect(dbname: TEST_DATABASE) { |c| c.exec("CREATE EXTENSION IF NOT EXISTS pg_smgrstat_debug") }
+    end
+
+    after do
+      conn.exec("SELECT smgr_stats_debug.clear_write_delay()")
+    end
+
+    it "records writes above the threshold with their block and backend" do
+      relfilenode = delayed_checkpoint("test_slow_io")
+
+      result = stats_conn.exec(<<~SQL)
+        SELECT * FROM smgr_stats.current_slow_io() WHERE relnumber = #{relfilenode} AND op = 'write'
+      SQL
+      expect(result.ntuples).to be >= 1
+      row = result[0]
+      expect(row["elapsed_us"].to_i).to be >= SLOW_IO_WRITE_DELAY_US
+      expect(row["backend_type"]).to eq("checkpointer")
+      expect(row["forknum"].to_i).to eq(0)
+      expect(row["blocknum"]).not_to be_nil
+      expect(row["nblocks"].to_i).to be >= 1
+    end
+
+    it "skips I/Os below the threshold" do
+      conn.exec("CREATE TABLE test_fast_io (id int)")
+      conn.exec("INSERT INTO test_fast_io SELECT generate_series(1, 100)")
+      conn.exec("CHECKPOINT")
+      relfilenode = lookup_relfilenode(conn, "test_fast_io")
+
+      result = stats_conn.exec("SELECT count(*) FROM smgr_stats.current_slow_io() WHERE relnumber = #{relfilenode}")
+      expect(result[0]["count"].to_i).to eq(0)
+    end
+
+    it "reports dropped records in status()" do
+      expect(status_value("slow_io_dropped")).not_to be_nil
+    end
+  end
+
+  describe "collected", extra_config: {"smgr_stats.slow_io_threshold" => "100ms",
+                                       "smgr_stats.collection_interval" => "2"} do
+    include_context "pg instance"
+
+    before(:all) do
+      @pg.connect(dbname: TEST_DATABASE) { |c| c.exec("CREATE EXTENSION IF NOT EXISTS pg_smgrstat_debug") }
+    end
+
+    after do
+      conn.exec("SELECT smgr_stats_debug.clear_write_delay()")
+    end
+
+    it "persists the records into smgr_stats.slow_io" do
+      relfilenode = delayed_checkpoint("test_slow_io_history")
+      sleep 5
+
+      result = stats_conn.exec(<<~SQL)
+        SELECT count(*) AS n, min(elapsed_us) AS elapsed_us FROM smgr_stats.slow_io
+        WHERE relnumber = #{relfilenode} AND op = 'write'
+      SQL
+      expect(result[0]["n"].to_i).to be >= 1
+      expect(result[0]["elapsed_us"].to_i).to be >= SLOW_IO_WRITE_DELAY_US
+
+      live = stats_conn.exec("SELECT count(*) FROM smgr_stats.current_slow_io() WHERE relnumber = #{relfilenode}")
+      expect(live[0]["count"].to_i).to eq(0)
+    end
+  end
+end
@@ -80,6 +80,18 @@ RSpec.shared_context "pg instance" do
   # Opens a fresh connection to postgres database for each test (for stats queries)
   let(:stats_conn) { @stats_conn = pg.connect(dbname: "postgres") }
 
+  # Value of a smgr_stats.status() row as text, nil if there is no such row
+  def status_value(name)
+    result = stats_conn.exec_params("SELECT value FROM smgr_stats.status() WHERE name = $1", [name])
+    result.ntuples == 1 ? result[0]["value"] : nil
+  end
+
+  # Sequential scan of a table in the test database with nothing of it in shared buffers
+  def scan_cold(table)
+    pg.evict_buffers(dbname: TEST_DATABASE)
+    conn.exec("SELECT count(*) FROM #{table}")
+  end
+
   after do
     @conn&.close
     @stats_conn&.close
@@ -0,0 +1,74 @@
+RSpec.describe "pg_smgrstat status()" do
+  include_context "pg instance"
+
+  it "reports the active clock source" do
+    expect(%w[system tsc]).to include(status_value("clock_source"))
+  end
+
+  it "reports the number of shared entries" do
+    conn.exec("CREATE TABLE test_status_entries (id int)")
+    conn.exec("INSERT INTO test_status_entries SELECT g FROM generate_series(1, 1000) g")
+    conn.exec("CHECKPOINT")
+
+    expect(status_value("entries").to_i).to be > 0
+  end
+
+  it "reports clock re-anchors after I/O" do
+    conn.exec("CREATE TABLE test_status_clock (id int, data text)")
+    conn.exec("INSERT INTO test_status_clock SELECT g, repeat('x', 100) FROM generate_series(1, 1000) g")
+    conn.exec("CHECKPOINT")
+
+    expect(status_value("clock_reanchors").to_i).to be > 0
+  end
+
+  it "derives plausible wall-clock timestamps from the monotonic clock" do
+    conn.exec("CREATE TABLE test_status_wall (id int)")
+    conn.exec("INSERT INTO test_status_wall SELECT g FROM generate_series(1, 1000) g")
+    conn.exec("CHECKPOINT")
+
+    relfilenode = lookup_relfilenode(conn, "test_status_wall")
+    result = stats_conn.exec(<<~SQL)
+      SELECT abs(extract(epoch FROM now() - last_access)) < 60 AS recent
+      FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+    expect(result.ntuples).to eq(1)
+    expect(result[0]["recent"]).to eq("t")
+  end
+
+  it "tracks every async read of a large scan exactly" do
+    conn.exec("CREATE TABLE test_status_aio (id int, data text)")
+    conn.exec("INSERT INTO test_status_aio SELECT g, repeat('x', 200) FROM generate_series(1, 50000) g")
+    conn.exec("CHECKPOINT")
+    pg.evict_buffers(dbname: TEST_DATABASE)
+    conn.exec("SELECT count(*) FROM test_status_aio")
+
+    expect(status_value("aio_collisions").to_i).to eq(0)
+    expect(status_value("aio_misses").to_i).to eq(0)
+    relfilenode = lookup_relfilenode(conn, "test_status_aio")
+    result = stats_conn.exec("SELECT reads FROM smgr_stats.current() WHERE relnumber = #{relfilenode} AND forknum = 0")
+    expect(result[0]["reads"].to_i).to be > 0
+  end
+end
+
+RSpec.describe "pg_smgrstat with the system clock",
+               extra_config: {"smgr_stats.clock_source" => "system"} do
+  include_context "pg instance"
+
+  it "reports the system clock source" do
+    expect(status_value("clock_source")).to eq("system")
+  end
+
+  it "still records write timing" do
+    conn.exec("CREATE TABLE test_system_clock (id int, data text)")
+    conn.exec("INSERT INTO test_system_clock SELECT g, repeat('x', 100) FROM generate_series(1, 1000) g")
+    conn.exec("CHECKPOINT")
+
+    relfilenode = lookup_relfilenode(conn, "test_system_clock")
+    result = stats_conn.exec(<<~SQL)
+      SELECT write_count FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+    expect(result[0]["write_count"].to_i).to be > 0
+  end
+end
@@ -0,0 +1,57 @@
+RSpec.describe "pg_smgrstat striped entries",
+               extra_config: {"smgr_stats.stripes" => "4", "smgr_stats.stripe_threshold" => "0",
+                              "smgr_stats.collection_interval" => "2"} do
+  include_context "pg instance"
+
+  def read_from_several_backends(table, backends: 4)
+    pg.evict_buffers(dbname: TEST_DATABASE)
+    backends.times do
+      pg.connect(dbname: TEST_DATABASE) { |c| c.exec("SELECT count(*) FROM #{table}") }
+    end
+  end
+
+  it "stripes active keys and reports one row per key" do
+    conn.exec("CREATE TABLE test_striped (id int, data text)")
+    conn.exec("INSERT INTO test_striped SELECT g, repeat('x', 100) FROM generate_series(1, 20000) g")
+    conn.exec("CHECKPOINT")
+
+    # The next collection stripes every active key (threshold 0)
+    sleep 3
+    expect(status_value("striped_keys").to_i).to be > 0
+
+    read_from_several_backends("test_striped")
+
+    relfilenode = lookup_relfilenode(conn, "test_striped")
+    result = stats_conn.exec(<<~SQL)
+      SELECT reads, read_blocks, read_count, relname
+      FROM smgr_stats.current()
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+    SQL
+    expect(result.ntuples).to eq(1)
+    row = result[0]
+    expect(row["reads"].to_i).to be > 0
+    expect(row["read_count"].to_i).to be > 0
+    expect(row["relname"]).to eq("test_striped")
+  end
+
+  it "writes merged stripes to history" do
+    conn.exec("CREATE TABLE test_striped_hist (id int, data text)")
+    conn.exec("INSERT INTO test_striped_hist SELECT g, repeat('x', 100) FROM generate_series(1, 20000) g")
+    conn.exec("CHECKPOINT")
+    sleep 3
+
+    read_from_several_backends("test_striped_hist")
+    sleep 3
+
+    relfilenode = lookup_relfilenode(conn, "test_striped_hist")
+    result = stats_conn.exec(<<~SQL)
+      SELECT bucket_id, count(*) AS n, sum(reads) AS reads
+      FROM smgr_stats.history
+      WHERE relnumber = #{relfilenode} AND forknum = 0
+      GROUP BY bucket_id
+    SQL
+    expect(result.ntuples).to be > 0
+    expect(result.map { |r| r["n"].to_i }.uniq).to eq([1])
+    expect(result.sum { |r| r["reads"].to_i }).to be > 0
+  end
+end
@@ -0,0 +1,49 @@
+RSpec.describe "pg_smgrstat tablespace queue depth" do
+  def tablespace_row(spcname)
+    stats_conn.exec(<<~SQL)[0]
+      SELECT c.* FROM smgr_stats.current_by_tablespace() c
+      JOIN pg_tablespace t ON t.oid = c.spcoid WHERE t.spcname = '#{spcname}'
+    SQL
+  end
+
+  describe "current bucket" do
+    include_context "pg instance"
+
+    it "reports depth, busy time and utilization of the default tablespace" do
+      conn.exec("CREATE TABLE test_tablespace_depth (id int, data text)")
+      conn.exec("INSERT INTO test_tablespace_depth SELECT g, repeat('x', 200) FROM generate_series(1, 50000) g")
+      conn.exec("CHECKPOINT")
+      pg.evict_buffers(dbname: TEST_DATABASE)
+      conn.exec("SELECT count(*) FROM test_tablespace_depth")
+
+      row = tablespace_row("pg_default")
+      expect(row).not_to be_nil
+      expect(row["ios"].to_i).to be > 0
+      expect(row["max_queue_depth"].to_i).to be >= 1
+      expect(row["busy_us"].to_i).to be <= row["interval_us"].to_i
+      expect(row["utilization"].to_f).to be_between(0.0, 1.0)
+      expect(row["avg_queue_depth"].to_f).to be >= 0.0
+    end
+  end
+
+  describe "collected", extra_config: {"smgr_stats.collection_interval" => "2"} do
+    include_context "pg instance"
+
+    it "persists each bucket into tablespace_history" do
+      conn.exec("CREATE TABLE test_tablespace_history (id int)")
+      conn.exec("INSERT INTO test_tablespace_history SELECT generate_series(1, 10000)")
+      conn.exec("CHECKPOINT")
+      sleep 5
+
+      result = stats_conn.exec(<<~SQL)
+        SELECT count(*) AS n, sum(ios) AS ios, max(utilization) AS utilization, min(interval_us) AS interval_us
+        FROM smgr_stats.tablespace_history h JOIN pg_tablespace t ON t.oid = h.spcoid
+        WHERE t.spcname = 'pg_default'
+      SQL
+      expect(result[0]["n"].to_i).to be > 0
+      expect(result[0]["ios"].to_i).to be > 0
+      expect(result[0]["utilization"].to_f).to be <= 1.0
+      expect(result[0]["interval_us"].to_i).to be > 0
+    end
+  end
+end
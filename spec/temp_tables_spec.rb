@@ -206,6 +206,26 @@ RSpec.describe "pg_smgrstat temporary table tracking" do
       off_result = stats_conn.exec("SELECT count(*) AS n FROM smgr_stats.current() WHERE relnumber = #{relfilenode3}")
       expect(off_result[0]["n"].to_i).to eq(0)
     end
+
+    it "re-resolves an already open temp table after switching modes" do
+      conn.exec("SET smgr_stats.track_temp_tables = 'aggregate'")
+      conn.exec("CREATE TEMP TABLE temp_switch_open (id int, data text)")
+      conn.exec("INSERT INTO temp_switch_open SELECT g, repeat('x', 1000) FROM generate_series(1, 100) g")
+      conn.exec("SELECT smgr_stats_debug.flush_local_buffers()")
+
+      relfilenode = conn.exec("SELECT relfilenode FROM pg_class WHERE relname = 'temp_switch_open'")[0]["relfilenode"].to_i
+      result = stats_conn.exec("SELECT count(*) AS n FROM smgr_stats.current() WHERE relnumber = #{relfilenode}")
+      expect(result[0]["n"].to_i).to eq(0)
+
+      # Same relation (and cached handle), new mode
+      conn.exec("SET smgr_stats.track_temp_tables = 'individual'")
+      conn.exec("INSERT INTO temp_switch_open SELECT g, repeat('x', 1000) FROM generate_series(1, 100) g")
+      conn.exec("SELECT smgr_stats_debug.flush_local_buffers()")
+
+      result = stats_conn.exec("SELECT write_blocks FROM smgr_stats.current() WHERE relnumber = #{relfilenode} AND forknum = 0")
+      expect(result.ntuples).to eq(1)
+      expect(result[0]["write_blocks"].to_i).to be > 0
+    end
   end
 end
 
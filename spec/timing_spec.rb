@@ -93,6 +93,47 @@ RSpec.describe "pg_smgrstat timing histograms" do
     end
   end
 
+  context "extend, truncate and sync timing" do
+    def timing_row(relfilenode, forknum = 0)
+      stats_conn.exec(<<~SQL)[0]
+        SELECT * FROM smgr_stats.current() WHERE relnumber = #{relfilenode} AND forknum = #{forknum}
+      SQL
+    end
+
+    it "times extends" do
+      conn.exec("CREATE TABLE test_extend_timing (id int, data text)")
+      conn.exec("INSERT INTO test_extend_timing SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+
+      row = timing_row(lookup_relfilenode(conn, "test_extend_timing"))
+      expect(row["extends"].to_i).to be > 0
+      expect(row["extend_count"].to_i + row["zeroextend_count"].to_i).to be > 0
+      expect(row["extend_min_us"].to_i).to be <= row["extend_max_us"].to_i
+    end
+
+    it "times truncates and counts the blocks removed" do
+      conn.exec("CREATE TABLE test_truncate_timing (id int, data text)")
+      conn.exec("INSERT INTO test_truncate_timing SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g")
+      conn.exec("DELETE FROM test_truncate_timing")
+      conn.exec("VACUUM test_truncate_timing")
+
+      row = timing_row(lookup_relfilenode(conn, "test_truncate_timing"))
+      expect(row["truncates"].to_i).to be > 0
+      expect(row["truncated_blocks"].to_i).to be > 0
+      expect(row["truncate_count"].to_i).to eq(row["truncates"].to_i)
+      expect(row["truncate_hist"]).not_to be_nil
+    end
+
+    it "times immediate syncs" do
+      # The init fork of an unlogged table is synced right away
+      conn.exec("CREATE UNLOGGED TABLE test_sync_timing (id int)")
+
+      row = timing_row(lookup_relfilenode(conn, "test_sync_timing"), 3)
+      expect(row["fsyncs"].to_i).to be > 0
+      expect(row["fsync_count"].to_i).to eq(row["fsyncs"].to_i)
+      expect(row["fsync_max_us"].to_i).to be >= row["fsync_min_us"].to_i
+    end
+  end
+
   context "hist_percentile function" do
     it "returns NULL for empty histogram" do
       result = stats_conn.exec("SELECT smgr_stats.hist_percentile(ARRAY[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]::bigint[], 0.5)")
@@ -44,7 +44,69 @@ CREATE TABLE smgr_stats.history (
     write_run_count bigint NOT NULL DEFAULT 0,
     active_seconds integer NOT NULL DEFAULT 0,
     first_access timestamptz,
-    last_access timestamptz
+    last_access timestamptz,
+    timing_sample_rate integer,  -- 1 in N reads/writes were timed (hist and IAT are scaled estimates if > 1)
+    fork_reads bigint[],         -- With fold_forks: per-fork counts, indexed by forknum + 1 (main, fsm, vm, init)
+    fork_writes bigint[],
+    fork_extends bigint[],
+    throttle_hist bigint[],      -- Delays imposed by smgr_stats.io_limits (throttled reads/writes only)
+    throttle_count bigint,
+    throttle_total_us bigint,
+    throttle_min_us bigint,
+    throttle_max_us bigint,
+    backend_type text,           -- With track_backend_type: process type that did the I/O (NULL = all)
+    truncated_blocks int8 NOT NULL DEFAULT 0,
+    extend_hist bigint[],        -- Timed like reads/writes (subject to timing_sample_rate)
+    extend_count bigint,
+    extend_total_us bigint,
+    extend_min_us bigint,
+    extend_max_us bigint,
+    zeroextend_hist bigint[],
+    zeroextend_count bigint,
+    zeroextend_total_us bigint,
+    zeroextend_min_us bigint,
+    zeroextend_max_us bigint,
+    truncate_hist bigint[],      -- Every truncate and immedsync is timed
+    truncate_count bigint,
+    truncate_total_us bigint,
+    truncate_min_us bigint,
+    truncate_max_us bigint,
+    fsync_hist bigint[],
+    fsync_count bigint,
+    fsync_total_us bigint,
+    fsync_min_us bigint,
+    fsync_max_us bigint,
+    nblocks_calls int8 NOT NULL DEFAULT 0,  -- Metadata ops; times are scaled up under timing_sample_rate
+    nblocks_time_us int8 NOT NULL DEFAULT 0,
+    exists_calls int8 NOT NULL DEFAULT 0,
+    exists_time_us int8 NOT NULL DEFAULT 0,
+    prefetches int8 NOT NULL DEFAULT 0,
+    prefetch_blocks int8 NOT NULL DEFAULT 0,
+    prefetch_time_us int8 NOT NULL DEFAULT 0,
+    writebacks int8 NOT NULL DEFAULT 0,
+    writeback_blocks int8 NOT NULL DEFAULT 0,
+    writeback_time_us int8 NOT NULL DEFAULT 0,
+    closes int8 NOT NULL DEFAULT 0,
+    close_time_us int8 NOT NULL DEFAULT 0,
+    aio_stage_hist bigint[],     -- Timed async reads: smgrstartreadv until staged
+    aio_stage_count bigint,
+    aio_stage_total_us bigint,
+    aio_stage_min_us bigint,
+    aio_stage_max_us bigint,
+    aio_device_hist bigint[],    -- Staged until complete_shared (submission + device)
+    aio_device_count bigint,
+    aio_device_total_us bigint,
+    aio_device_min_us bigint,
+    aio_device_max_us bigint,
+    aio_completion_hist bigint[], -- Until the issuing backend processed the completion
+    aio_completion_count bigint,
+    aio_completion_total_us bigint,
+    aio_completion_min_us bigint,
+    aio_completion_max_us bigint,
+    read_size_hist bigint[],     -- Requests by size: bin i counts [2^i, 2^(i+1)) blocks, the last bin 128 and up
+    write_size_hist bigint[],
+    zeroextend_size_hist bigint[],
+    io_method text               -- io_method setting in effect when the row was collected
 );
 
 CREATE INDEX ON smgr_stats.history USING BRIN (bucket_id);
@@ -75,6 +137,107 @@ CREATE INDEX ON smgr_stats.relfile_history USING BRIN (created_at);
 
 SELECT pg_catalog.pg_extension_config_dump('smgr_stats.relfile_history', '');
 
+-- Page cache released for cold relations (smgr_stats.cold_release_buckets)
+CREATE TABLE smgr_stats.cache_release_log (
+    released_at timestamptz NOT NULL DEFAULT now(),
+    bucket_id bigint NOT NULL,
+    spcoid oid NOT NULL,
+    dboid oid NOT NULL,
+    relnumber oid NOT NULL,
+    relname name,
+    last_bucket_id bigint NOT NULL,
+    active_seconds int8 NOT NULL,
+    segments int4 NOT NULL,
+    bytes int8 NOT NULL
+);
+
+CREATE INDEX ON smgr_stats.cache_release_log (dboid, relnumber);
+CREATE INDEX ON smgr_stats.cache_release_log USING BRIN (released_at);
+
+SELECT pg_catalog.pg_extension_config_dump('smgr_stats.cache_release_log', '');
+
+-- Token-bucket I/O rate limits. NULL scope columns match anything; loaded by the
+-- collector once per smgr_stats.collection_interval, or at once by smgr_stats.reload_io_limits()
+CREATE TABLE smgr_stats.io_limits (
+    spcoid oid,
+    dboid oid,
+    reloid oid,              -- pg_class OID; a partitioned root covers its aggregated leaves
+    iops int4 CHECK (iops > 0),
+    blocks_per_sec int4 CHECK (blocks_per_sec > 0),
+    comment text,
+    CHECK (iops IS NOT NULL OR blocks_per_sec IS NOT NULL),
+    CHECK (reloid IS NULL OR dboid IS NOT NULL)
+);
+
+SELECT pg_catalog.pg_extension_config_dump('smgr_stats.io_limits', '');
+
+-- Per-query I/O attribution (smgr_stats.query_top_n): the heaviest (queryid, file) pairs of each bucket
+CREATE TABLE smgr_stats.query_history (
+    bucket_id bigint NOT NULL,
+    collected_at timestamptz NOT NULL DEFAULT now(),
+    queryid bigint NOT NULL,      -- pg_stat_statements.queryid of the statement (the leader's for parallel workers)
+    spcoid oid NOT NULL,
+    dboid oid NOT NULL,
+    relnumber oid NOT NULL,
+    forknum int2 NOT NULL,
+    reads bigint NOT NULL,
+    read_blocks bigint NOT NULL,
+    read_time_us bigint NOT NULL,
+    writes bigint NOT NULL,
+    write_blocks bigint NOT NULL,
+    write_time_us bigint NOT NULL,
+    extends bigint NOT NULL,
+    extend_blocks bigint NOT NULL,
+    error bigint NOT NULL         -- Blocks possibly counted for pairs this one replaced (0 = exact)
+);
+
+CREATE INDEX ON smgr_stats.query_history USING BRIN (bucket_id);
+CREATE INDEX ON smgr_stats.query_history USING BRIN (collected_at);
+CREATE INDEX ON smgr_stats.query_history (queryid);
+
+SELECT pg_catalog.pg_extension_config_dump('smgr_stats.query_history', '');
+
+-- Per-tablespace queue depth and utilization of each bucket (tracked reads and writes)
+CREATE TABLE smgr_stats.tablespace_history (
+    bucket_id bigint NOT NULL,
+    collected_at timestamptz NOT NULL DEFAULT now(),
+    spcoid oid NOT NULL,
+    ios bigint NOT NULL,
+    io_time_us bigint NOT NULL,        -- Sum of the I/O durations
+    busy_us bigint NOT NULL,           -- Time with at least one I/O in flight
+    interval_us bigint NOT NULL,       -- Length of the bucket
+    avg_queue_depth double precision,  -- io_time_us / interval_us (Little's law)
+    max_queue_depth int4 NOT NULL,
+    utilization double precision       -- busy_us / interval_us, like iostat's %util
+);
+
+CREATE INDEX ON smgr_stats.tablespace_history USING BRIN (bucket_id);
+CREATE INDEX ON smgr_stats.tablespace_history USING BRIN (collected_at);
+
+SELECT pg_catalog.pg_extension_config_dump('smgr_stats.tablespace_history', '');
+
+-- I/Os that took at least smgr_stats.slow_io_threshold, persisted per bucket
+CREATE TABLE smgr_stats.slow_io (
+    bucket_id bigint NOT NULL,
+    collected_at timestamptz NOT NULL DEFAULT now(),
+    completed_at timestamptz NOT NULL,
+    pid int4 NOT NULL,
+    backend_type text NOT NULL,
+    op text NOT NULL,                  -- read, write, extend, zeroextend, truncate, fsync
+    spcoid oid NOT NULL,
+    dboid oid NOT NULL,
+    relnumber oid NOT NULL,
+    forknum int2 NOT NULL,
+    blocknum bigint,                   -- First block; for a truncate the new size; NULL for fsync
+    nblocks int4 NOT NULL,
+    elapsed_us bigint NOT NULL
+);
+
+CREATE INDEX ON smgr_stats.slow_io USING BRIN (bucket_id);
+CREATE INDEX ON smgr_stats.slow_io USING BRIN (collected_at);
+
+SELECT pg_catalog.pg_extension_config_dump('smgr_stats.slow_io', '');
+
 CREATE FUNCTION smgr_stats.current(
     OUT bucket_id bigint,
     OUT collected_at timestamptz,
@@ -121,10 +284,148 @@ CREATE FUNCTION smgr_stats.current(
     OUT write_run_count bigint,
     OUT active_seconds integer,
     OUT first_access timestamptz,
-    OUT last_access timestamptz
+    OUT last_access timestamptz,
+    OUT timing_sample_rate integer,
+    OUT fork_reads bigint[],
+    OUT fork_writes bigint[],
+    OUT fork_extends bigint[],
+    OUT throttle_hist bigint[],
+    OUT throttle_count bigint,
+    OUT throttle_total_us bigint,
+    OUT throttle_min_us bigint,
+    OUT throttle_max_us bigint,
+    OUT backend_type text,
+    OUT truncated_blocks int8,
+    OUT extend_hist bigint[],
+    OUT extend_count bigint,
+    OUT extend_total_us bigint,
+    OUT extend_min_us bigint,
+    OUT extend_max_us bigint,
+    OUT zeroextend_hist bigint[],
+    OUT zeroextend_count bigint,
+    OUT zeroextend_total_us bigint,
+    OUT zeroextend_min_us bigint,
+    OUT zeroextend_max_us bigint,
+    OUT truncate_hist bigint[],
+    OUT truncate_count bigint,
+    OUT truncate_total_us bigint,
+    OUT truncate_min_us bigint,
+    OUT truncate_max_us bigint,
+    OUT fsync_hist bigint[],
+    OUT fsync_count bigint,
+    OUT fsync_total_us bigint,
+    OUT fsync_min_us bigint,
+    OUT fsync_max_us bigint,
+    OUT nblocks_calls int8,
+    OUT nblocks_time_us int8,
+    OUT exists_calls int8,
+    OUT exists_time_us int8,
+    OUT prefetches int8,
+    OUT prefetch_blocks int8,
+    OUT prefetch_time_us int8,
+    OUT writebacks int8,
+    OUT writeback_blocks int8,
+    OUT writeback_time_us int8,
+    OUT closes int8,
+    OUT close_time_us int8,
+    OUT aio_stage_hist bigint[],
+    OUT aio_stage_count bigint,
+    OUT aio_stage_total_us bigint,
+    OUT aio_stage_min_us bigint,
+    OUT aio_stage_max_us bigint,
+    OUT aio_device_hist bigint[],
+    OUT aio_device_count bigint,
+    OUT aio_device_total_us bigint,
+    OUT aio_device_min_us bigint,
+    OUT aio_device_max_us bigint,
+    OUT aio_completion_hist bigint[],
+    OUT aio_completion_count bigint,
+    OUT aio_completion_total_us bigint,
+    OUT aio_completion_min_us bigint,
+    OUT aio_completion_max_us bigint,
+    OUT read_size_hist bigint[],
+    OUT write_size_hist bigint[],
+    OUT zeroextend_size_hist bigint[]
 ) RETURNS SETOF record
 LANGUAGE c AS 'MODULE_PATHNAME', 'smgr_stats_current';
 
+-- Instance-wide collector status and event counters
+CREATE FUNCTION smgr_stats.status(
+    OUT name text,
+    OUT value text
+) RETURNS SETOF record
+LANGUAGE c AS 'MODULE_PATHNAME', 'smgr_stats_status';
+
+-- Apply smgr_stats.io_limits now instead of at the next collection; returns the number of limits in effect
+CREATE FUNCTION smgr_stats.reload_io_limits()
+RETURNS integer
+LANGUAGE c AS 'MODULE_PATHNAME', 'smgr_stats_reload_io_limits';
+
+-- Per-query I/O attribution of the current bucket (empty unless smgr_stats.query_top_n > 0)
+CREATE FUNCTION smgr_stats.current_by_query(
+    OUT queryid bigint,
+    OUT spcoid oid,
+    OUT dboid oid,
+    OUT relnumber oid,
+    OUT forknum int2,
+    OUT reads bigint,
+    OUT read_blocks bigint,
+    OUT read_time_us bigint,
+    OUT writes bigint,
+    OUT write_blocks bigint,
+    OUT write_time_us bigint,
+    OUT extends bigint,
+    OUT extend_blocks bigint,
+    OUT error bigint
+) RETURNS SETOF record
+LANGUAGE c AS 'MODULE_PATHNAME', 'smgr_stats_current_by_query';
+
+-- Queue depth and utilization of each tablespace in the current bucket
+CREATE FUNCTION smgr_stats.current_by_tablespace(
+    OUT spcoid oid,
+    OUT ios bigint,
+    OUT io_time_us bigint,
+    OUT busy_us bigint,
+    OUT interval_us bigint,
+    OUT avg_queue_depth double precision,
+    OUT max_queue_depth int4,
+    OUT in_flight int4,
+    OUT utilization double precision
+) RETURNS SETOF record
+LANGUAGE c AS 'MODULE_PATHNAME', 'smgr_stats_current_by_tablespace';
+
+-- I/Os in flight right now, one row per backend call or async read
+CREATE FUNCTION smgr_stats.in_flight(
+    OUT pid int4,
+    OUT op text,
+    OUT spcoid oid,
+    OUT dboid oid,
+    OUT relnumber oid,
+    OUT forknum int2,
+    OUT blocknum bigint,
+    OUT nblocks int4,
+    OUT aio_id int4,
+    OUT started_at timestamptz,
+    OUT age_us bigint
+) RETURNS SETOF record
+LANGUAGE c AS 'MODULE_PATHNAME', 'smgr_stats_in_flight';
+
+-- Slow I/Os recorded since the last collection, oldest first
+CREATE FUNCTION smgr_stats.current_slow_io(
+    OUT completed_at timestamptz,
+    OUT pid int4,
+    OUT backend_type text,
+    OUT op text,
+    OUT spcoid oid,
+    OUT dboid oid,
+    OUT relnumber oid,
+    OUT forknum int2,
+    OUT blocknum bigint,
+    OUT nblocks int4,
+    OUT elapsed_us bigint
+) RETURNS SETOF record
+LANGUAGE c AS 'MODULE_PATHNAME', 'smgr_stats_current_slow_io';
+
 CREATE FUNCTION smgr_stats.hist_percentile(hist bigint[], pct double precision)
 RETURNS double precision
 LANGUAGE c IMMUTABLE STRICT
@@ -146,6 +447,7 @@ SELECT
         WHEN 3 THEN 'init'
         ELSE 'unknown'
     END AS fork_name,
+    h.backend_type,
     h.reloid,
     h.main_reloid,
     h.relname,
@@ -168,6 +470,7 @@ SELECT
     h.extends,
     h.extend_blocks,
     h.truncates,
+    h.truncated_blocks,
     h.fsyncs,
     h.read_count,
     h.read_total_us,
@@ -195,7 +498,74 @@ SELECT
     h.write_run_count,
     h.active_seconds,
     h.first_access,
-    h.last_access
+    h.last_access,
+    h.timing_sample_rate,
+    h.fork_reads,
+    h.fork_writes,
+    h.fork_extends,
+    h.throttle_count,
+    h.throttle_total_us,
+    h.throttle_min_us,
+    h.throttle_max_us,
+    CASE WHEN h.throttle_count > 0 THEN h.throttle_total_us::double precision / h.throttle_count ELSE NULL END
+        AS throttle_avg_us,
+    h.extend_count,
+    h.extend_total_us,
+    h.extend_min_us,
+    h.extend_max_us,
+    CASE WHEN h.extend_count > 0 THEN h.extend_total_us::double precision / h.extend_count ELSE NULL END
+        AS extend_avg_us,
+    h.zeroextend_count,
+    h.zeroextend_total_us,
+    h.zeroextend_min_us,
+    h.zeroextend_max_us,
+    CASE WHEN h.zeroextend_count > 0 THEN h.zeroextend_total_us::double precision / h.zeroextend_count ELSE NULL END
+        AS zeroextend_avg_us,
+    h.truncate_count,
+    h.truncate_total_us,
+    h.truncate_min_us,
+    h.truncate_max_us,
+    CASE WHEN h.truncate_count > 0 THEN h.truncate_total_us::double precision / h.truncate_count ELSE NULL END
+        AS truncate_avg_us,
+    h.fsync_count,
+    h.fsync_total_us,
+    h.fsync_min_us,
+    h.fsync_max_us,
+    CASE WHEN h.fsync_count > 0 THEN h.fsync_total_us::double precision / h.fsync_count ELSE NULL END AS fsync_avg_us,
+    h.nblocks_calls,
+    h.nblocks_time_us,
+    h.exists_calls,
+    h.exists_time_us,
+    h.prefetches,
+    h.prefetch_blocks,
+    h.prefetch_time_us,
+    h.writebacks,
+    h.writeback_blocks,
+    h.writeback_time_us,
+    h.closes,
+    h.close_time_us,
+    h.aio_stage_count,
+    h.aio_stage_total_us,
+    h.aio_stage_min_us,
+    h.aio_stage_max_us,
+    CASE WHEN h.aio_stage_count > 0 THEN h.aio_stage_total_us::double precision / h.aio_stage_count ELSE NULL END
+        AS aio_stage_avg_us,
+    h.aio_device_count,
+    h.aio_device_total_us,
+    h.aio_device_min_us,
+    h.aio_device_max_us,
+    CASE WHEN h.aio_device_count > 0 THEN h.aio_device_total_us::double precision / h.aio_device_count ELSE NULL END
+        AS aio_device_avg_us,
+    h.aio_completion_count,
+    h.aio_completion_total_us,
+    h.aio_completion_min_us,
+    h.aio_completion_max_us,
+    CASE WHEN h.aio_completion_count > 0 THEN h.aio_completion_total_us::double precision / h.aio_completion_count ELSE NULL END
+        AS aio_completion_avg_us,
+    h.read_size_hist,
+    h.write_size_hist,
+    h.zeroextend_size_hist,
+    h.io_method
 FROM smgr_stats.history h;
 
 CREATE FUNCTION smgr_stats.get_table_history(db_oid oid, rel_oid oid)
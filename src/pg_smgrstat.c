@@ -3,6 +3,8 @@
 #include "fmgr.h"
 #include "miscadmin.h"
 
+#include "smgr_stats_aio.h"
+#include "smgr_stats_clock.h"
 #include "smgr_stats_guc.h"
 #include "smgr_stats_link.h"
 #include "smgr_stats_metadata.h"
@@ -16,7 +18,9 @@ void _PG_init(void) {
   }
 
   smgr_stats_register_gucs();
+  smgr_stats_clock_init();
   smgr_stats_register_link();
+  smgr_stats_aio_register();
   smgr_stats_register_metadata_hooks();
   smgr_stats_register_worker();
 
@@ -0,0 +1,97 @@
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+
+#include "smgr_stats_aio.h"
+
+typedef struct SmgrStatsAioStamp {
+  pg_atomic_uint32 seq; /* Sequence number of the read that completed last, 0 if none */
+  SmgrStatsInstant completed_at;
+} SmgrStatsAioStamp;
+
+typedef struct SmgrStatsAioStamps {
+  uint32 capacity; /* Handles with a higher id are not stamped */
+  SmgrStatsAioStamp stamps[FLEXIBLE_ARRAY_MEMBER];
+} SmgrStatsAioStamps;
+
+static SmgrStatsAioStamps* aio_stamps = NULL;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/*
+ * One stamp per AIO handle: io_max_concurrency handles for each backend and
+ * auxiliary process. Requested before io_max_concurrency is auto-tuned, which
+ * never picks more than 64, so reserve for that many.
+ */
+static uint32 aio_stamp_slots(void) {
+  return (uint32)(MaxBackends + NUM_AUXILIARY_PROCS) * (uint32)Max(io_max_concurrency, 64);
+}
+
+static Size aio_stamps_size(void) {
+  return add_size(offsetof(SmgrStatsAioStamps, stamps), mul_size(aio_stamp_slots(), sizeof(SmgrStatsAioStamp)));
+}
+
+static void aio_shmem_request(void) {
+  if (prev_shmem_request_hook) {
+    prev_shmem_request_hook();
+  }
+  RequestAddinShmemSpace(aio_stamps_size());
+}
+
+static void aio_shmem_startup(void) {
+  if (prev_shmem_startup_hook) {
+    prev_shmem_startup_hook();
+  }
+
+  bool found;
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  aio_stamps = ShmemInitStruct("pg_smgrstat_aio_stamps", aio_stamps_size(), &found);
+  if (!found) {
+    aio_stamps->capacity = aio_stamp_slots();
+    for (uint32 i = 0; i < aio_stamps->capacity; i++) {
+      pg_atomic_init_u32(&aio_stamps->stamps[i].seq, 0);
+      aio_stamps->stamps[i].completed_at = 0;
+    }
+  }
+  LWLockRelease(AddinShmemInitLock);
+}
+
+void smgr_stats_aio_register(void) {
+  prev_shmem_request_hook = shmem_request_hook;
+  shmem_request_hook = aio_shmem_request;
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = aio_shmem_startup;
+}
+
+void smgr_stats_aio_stamp_completion(int io_id, uint8 seq, SmgrStatsInstant at) {
+  if (!aio_stamps || (uint32)io_id >= aio_stamps->capacity) {
+    return;
+  }
+  SmgrStatsAioStamp* stamp = &aio_stamps->stamps[io_id];
+  stamp->completed_at = at;
+  pg_write_barrier();
+  pg_atomic_write_u32(&stamp->seq, seq);
+}
+
+/* The handle is only reused after its owner ran complete_local, so the stamp can't change under the reader */
+bool smgr_stats_aio_completion(int io_id, uint8 seq, SmgrStatsInstant* at) {
+  if (!aio_stamps || (uint32)io_id >= aio_stamps->capacity) {
+    return false;
+  }
+  SmgrStatsAioStamp* stamp = &aio_stamps->stamps[io_id];
+  if (pg_atomic_read_u32(&stamp->seq) != seq) {
+    return false;
+  }
+  pg_read_barrier();
+  *at = stamp->completed_at;
+  return true;
+}
+
+const char* smgr_stats_io_method_name(void) { return GetConfigOption("io_method", false, false); }
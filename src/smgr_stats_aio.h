@@ -0,0 +1,32 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "storage/aio.h"
+
+#include "smgr_stats_clock.h"
+
+/*
+ * Completion stamps of async reads, for the AIO phase breakdown.
+ *
+ * The complete_shared callback runs in whichever process completes the I/O:
+ * an I/O worker, the backend that reaped an io_uring completion, or the issuer
+ * itself. It runs in a critical section, so it can neither attach a DSM
+ * segment nor touch the issuer's backend-local slots. It writes the instant of
+ * completion into a table in the main shared memory segment instead, which
+ * every process inherits from the postmaster, indexed by AIO handle id and
+ * tagged with the read's sequence number (see smgr_stats_link.c). The issuer
+ * picks the stamp up in complete_local.
+ */
+
+/* Request the stamp table's shared memory. Called once from _PG_init. */
+extern void smgr_stats_aio_register(void);
+
+/* Record that read seq on handle io_id completed at `at`. Safe in critical sections. */
+extern void smgr_stats_aio_stamp_completion(int io_id, uint8 seq, SmgrStatsInstant at);
+
+/* Completion instant of read seq on handle io_id. False if it wasn't stamped. */
+extern bool smgr_stats_aio_completion(int io_id, uint8 seq, SmgrStatsInstant* at);
+
+/* The active io_method setting ("sync", "worker" or "io_uring") */
+extern const char* smgr_stats_io_method_name(void);
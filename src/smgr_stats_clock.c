@@ -0,0 +1,111 @@
+#include "postgres.h"
+
+#include "smgr_stats_clock.h"
+
+/* After smgr_stats_clock.h, which defines SMGR_STATS_HAVE_TSC */
+#ifdef SMGR_STATS_HAVE_TSC
+#include <cpuid.h>
+#endif
+
+#include "smgr_stats_guc.h"
+#include "smgr_stats_store.h"
+
+bool smgr_stats_clock_use_tsc = false;
+uint64 smgr_stats_tsc_mult = 0;
+
+/* Raw clock units per second, for the re-anchor interval */
+static uint64 ticks_per_sec = NS_PER_S;
+
+static bool anchored = false;
+static SmgrStatsInstant anchor_instant;
+static TimestampTz anchor_wall;
+
+#ifdef SMGR_STATS_HAVE_TSC
+
+/* CPUID 0x80000007 EDX bit 8: the TSC runs at a constant rate in all P/C-states */
+static bool tsc_is_invariant(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0x80000000, NULL) < 0x80000007) {
+    return false;
+  }
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx & (1 << 8)) != 0;
+}
+
+/* The kernel switches away from the TSC when it detects it as unstable (e.g. unsynchronized across sockets) */
+static bool kernel_trusts_tsc(void) {
+  char buf[32] = {0};
+  FILE* f = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+  if (!f) {
+    return false;
+  }
+  bool ok = fgets(buf, sizeof(buf), f) != NULL && strncmp(buf, "tsc", 3) == 0;
+  fclose(f);
+  return ok;
+}
+
+/* Measure the TSC frequency against the system clock over a short busy wait. */
+static bool calibrate_tsc(void) {
+  instr_time start;
+  instr_time now;
+  INSTR_TIME_SET_CURRENT(start);
+  uint64 c0 = __rdtsc();
+  do {
+    INSTR_TIME_SET_CURRENT(now);
+  } while (INSTR_TIME_GET_NANOSEC(now) - INSTR_TIME_GET_NANOSEC(start) < 20 * NS_PER_MS);
+  uint64 c1 = __rdtsc();
+
+  uint64 elapsed_ns = INSTR_TIME_GET_NANOSEC(now) - INSTR_TIME_GET_NANOSEC(start);
+  double cycles_per_us = (double)(c1 - c0) * NS_PER_US / (double)elapsed_ns;
+  if (cycles_per_us < 100.0 || cycles_per_us > 20000.0) {
+    return false;
+  }
+  smgr_stats_tsc_mult = (uint64)((double)((uint64)1 << SMGR_STATS_TSC_SHIFT) / cycles_per_us);
+  ticks_per_sec = (uint64)(cycles_per_us * USECS_PER_SEC);
+  return true;
+}
+
+#endif
+
+void smgr_stats_clock_init(void) {
+  SmgrStatsClockSource source = (SmgrStatsClockSource)smgr_stats_clock_source;
+  if (source == SMGR_STATS_CLOCK_SYSTEM) {
+    return;
+  }
+
+#ifdef SMGR_STATS_HAVE_TSC
+  bool usable = tsc_is_invariant() && (source == SMGR_STATS_CLOCK_TSC || kernel_trusts_tsc());
+  if (usable && calibrate_tsc()) {
+    smgr_stats_clock_use_tsc = true;
+    elog(LOG, "pg_smgrstat: using TSC clock (%.1f cycles/us)",
+         (double)((uint64)1 << SMGR_STATS_TSC_SHIFT) / (double)smgr_stats_tsc_mult);
+    return;
+  }
+#endif
+
+  if (source == SMGR_STATS_CLOCK_TSC) {
+    ereport(WARNING, (errmsg("pg_smgrstat: no invariant TSC available, falling back to the system clock")));
+  }
+}
+
+const char* smgr_stats_clock_source_name(void) { return smgr_stats_clock_use_tsc ? "tsc" : "system"; }
+
+static void reanchor(SmgrStatsInstant now) {
+  anchor_wall = GetCurrentTimestamp();
+  anchor_instant = now;
+  anchored = true;
+  smgr_stats_counter_add(SMGR_STATS_COUNTER_CLOCK_REANCHORS, 1);
+}
+
+TimestampTz smgr_stats_clock_wall(SmgrStatsInstant now) {
+  int64 since_anchor = (int64)(now - anchor_instant);
+  /* Coarse readings may lag the anchor slightly; that's fine */
+  if (unlikely(!anchored || since_anchor >= (int64)ticks_per_sec || since_anchor <= -(int64)ticks_per_sec)) {
+    reanchor(now);
+    since_anchor = 0;
+  }
+  if (since_anchor >= 0) {
+    return anchor_wall + (TimestampTz)smgr_stats_clock_to_us((uint64)since_anchor);
+  }
+  return anchor_wall - (TimestampTz)smgr_stats_clock_to_us((uint64)-since_anchor);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "portability/instr_time.h"
+#include "utils/timestamp.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && defined(HAVE_INT128)
+#define SMGR_STATS_HAVE_TSC 1
+#include <x86intrin.h>
+#endif
+
+/*
+ * Clock for the I/O hooks. Each hook reads the clock when the operation ends,
+ * and derives the microsecond wall-clock time needed for activity and
+ * inter-arrival tracking from that same instant: a per-backend anchor pairing
+ * an instant with GetCurrentTimestamp() is refreshed at most once per second.
+ * Re-anchors are counted in smgr_stats.status() (clock_reanchors).
+ *
+ * The clock source (smgr_stats.clock_source) is chosen once at startup: the
+ * system monotonic clock (instr_time), or on x86-64 the TSC read with rdtsc,
+ * calibrated against the system clock. Cycles are converted to microseconds
+ * with a multiply-shift when an operation is recorded.
+ *
+ * Operations that are not timed (see smgr_stats.timing_sample_rate) only need
+ * a timestamp for activity tracking and read the cheapest available clock.
+ */
+
+#define SMGR_STATS_CLOCK_REANCHOR_US USECS_PER_SEC
+#define SMGR_STATS_TSC_SHIFT 32
+
+typedef enum SmgrStatsClockSource {
+  SMGR_STATS_CLOCK_AUTO = 0,
+  SMGR_STATS_CLOCK_SYSTEM = 1,
+  SMGR_STATS_CLOCK_TSC = 2
+} SmgrStatsClockSource;
+
+/* A raw reading of the active clock: nanoseconds (system) or cycles (TSC). */
+typedef uint64 SmgrStatsInstant;
+
+/* Decided by smgr_stats_clock_init() in the postmaster, inherited by all processes. */
+extern bool smgr_stats_clock_use_tsc;
+extern uint64 smgr_stats_tsc_mult; /* Microseconds per cycle, scaled by 2^SMGR_STATS_TSC_SHIFT */
+
+static inline SmgrStatsInstant smgr_stats_clock_read(void) {
+#ifdef SMGR_STATS_HAVE_TSC
+  if (smgr_stats_clock_use_tsc) {
+    return __rdtsc();
+  }
+#endif
+  instr_time t;
+  INSTR_TIME_SET_CURRENT(t);
+  return INSTR_TIME_GET_NANOSEC(t);
+}
+
+/* Instant with tick (a few ms) resolution, when the TSC isn't in use. */
+static inline SmgrStatsInstant smgr_stats_clock_read_coarse(void) {
+#ifdef SMGR_STATS_HAVE_TSC
+  if (smgr_stats_clock_use_tsc) {
+    return __rdtsc();
+  }
+#endif
+#if defined(CLOCK_MONOTONIC_COARSE) && PG_INSTR_CLOCK == CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (uint64)ts.tv_sec * NS_PER_S + ts.tv_nsec;
+#else
+  return smgr_stats_clock_read();
+#endif
+}
+
+/* Convert a difference between two instants to microseconds. */
+static inline uint64 smgr_stats_clock_to_us(uint64 delta) {
+#ifdef SMGR_STATS_HAVE_TSC
+  if (smgr_stats_clock_use_tsc) {
+    return (uint64)(((uint128)delta * smgr_stats_tsc_mult) >> SMGR_STATS_TSC_SHIFT);
+  }
+#endif
+  return delta / NS_PER_US;
+}
+
+/* Microseconds from start to end. */
+static inline uint64 smgr_stats_clock_elapsed_us(SmgrStatsInstant start, SmgrStatsInstant end) {
+  return end > start ? smgr_stats_clock_to_us(end - start) : 0;
+}
+
+/* Choose the clock source and calibrate the TSC. Called once from _PG_init. */
+extern void smgr_stats_clock_init(void);
+
+/* Name of the active clock source ("system" or "tsc"). */
+extern const char* smgr_stats_clock_source_name(void);
+
+/* Wall-clock time of an instant taken just before the call. */
+extern TimestampTz smgr_stats_clock_wall(SmgrStatsInstant now);
+
+/* Wall-clock time now, for operations that are not timed. */
+static inline TimestampTz smgr_stats_clock_now(void) { return smgr_stats_clock_wall(smgr_stats_clock_read_coarse()); }
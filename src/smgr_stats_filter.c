@@ -0,0 +1,219 @@
+#include "postgres.h"
+
+#include <errno.h>
+
+#include "nodes/pg_list.h"
+#include "utils/varlena.h"
+
+#include "smgr_stats_filter.h"
+#include "smgr_stats_handle.h"
+
+SmgrStatsFilter smgr_stats_filter = {
+    .forks = SMGR_STATS_ALL_FORKS,
+    .include_forks = SMGR_STATS_ALL_FORKS,
+};
+
+/* Split a GUC list value; the items point into *raw_out. Sets the GUC error detail if malformed. */
+static bool split_list(const char* value, char** raw_out, List** elems_out) {
+  *raw_out = pstrdup(value);
+  *elems_out = NIL;
+  if (!SplitGUCList(*raw_out, ',', elems_out)) {
+    GUC_check_errdetail("List syntax is invalid.");
+    pfree(*raw_out);
+    list_free(*elems_out);
+    return false;
+  }
+  return true;
+}
+
+bool smgr_stats_check_oid_list(char** newval, void** extra, GucSource source) {
+  (void)source;
+  char* raw;
+  List* elems;
+  if (!split_list(*newval, &raw, &elems)) {
+    return false;
+  }
+
+  SmgrStatsOidFilter* filter = guc_malloc(LOG, sizeof(SmgrStatsOidFilter));
+  if (!filter) {
+    return false;
+  }
+  filter->n = 0;
+
+  bool ok = true;
+  ListCell* lc;
+  foreach (lc, elems) {
+    const char* item = lfirst(lc);
+    char* end;
+    errno = 0;
+    unsigned long oid = strtoul(item, &end, 10);
+    if (errno != 0 || end == item || *end != '\0' || oid > PG_UINT32_MAX) {
+      GUC_check_errdetail("\"%s\" is not an OID.", item);
+      ok = false;
+      break;
+    }
+    if (filter->n >= SMGR_STATS_FILTER_MAX_OIDS) {
+      GUC_check_errdetail("At most %d OIDs can be listed.", SMGR_STATS_FILTER_MAX_OIDS);
+      ok = false;
+      break;
+    }
+    filter->oids[filter->n++] = (Oid)oid;
+  }
+
+  pfree(raw);
+  list_free(elems);
+  if (!ok) {
+    guc_free(filter);
+    return false;
+  }
+  *extra = filter;
+  return true;
+}
+
+bool smgr_stats_check_fork_list(char** newval, void** extra, GucSource source) {
+  (void)source;
+  char* raw;
+  List* elems;
+  if (!split_list(*newval, &raw, &elems)) {
+    return false;
+  }
+
+  uint8 mask = 0;
+  bool ok = true;
+  ListCell* lc;
+  foreach (lc, elems) {
+    const char* item = lfirst(lc);
+    ForkNumber forknum = InvalidForkNumber;
+    for (ForkNumber f = 0; f <= MAX_FORKNUM; f++) {
+      if (strcmp(item, forkNames[f]) == 0) {
+        forknum = f;
+      }
+    }
+    if (forknum == InvalidForkNumber) {
+      GUC_check_errdetail("Unknown fork \"%s\" (expected main, fsm, vm or init).", item);
+      ok = false;
+      break;
+    }
+    mask |= (uint8)(1 << forknum);
+  }
+
+  pfree(raw);
+  list_free(elems);
+  if (!ok) {
+    return false;
+  }
+  uint8* result = guc_malloc(LOG, sizeof(uint8));
+  if (!result) {
+    return false;
+  }
+  *result = mask;
+  *extra = result;
+  return true;
+}
+
+bool smgr_stats_check_relkind_list(char** newval, void** extra, GucSource source) {
+  (void)source;
+  char* raw;
+  List* elems;
+  if (!split_list(*newval, &raw, &elems)) {
+    return false;
+  }
+
+  SmgrStatsRelkindFilter* filter = guc_malloc(LOG, sizeof(SmgrStatsRelkindFilter));
+  if (!filter) {
+    return false;
+  }
+  memset(filter, 0, sizeof(SmgrStatsRelkindFilter));
+
+  bool ok = true;
+  ListCell* lc;
+  foreach (lc, elems) {
+    const char* item = lfirst(lc);
+    if (strlen(item) != 1) {
+      GUC_check_errdetail("\"%s\" is not a relkind (a single character such as r, i or t).", item);
+      ok = false;
+      break;
+    }
+    uint8 c = (uint8)item[0];
+    filter->bits[c >> 6] |= (uint64)1 << (c & 63);
+    filter->any = true;
+  }
+
+  pfree(raw);
+  list_free(elems);
+  if (!ok) {
+    guc_free(filter);
+    return false;
+  }
+  *extra = filter;
+  return true;
+}
+
+static void update_active(void) {
+  SmgrStatsFilter* f = &smgr_stats_filter;
+  f->forks = f->include_forks & (uint8)~f->exclude_forks;
+  f->active = f->forks != SMGR_STATS_ALL_FORKS || f->include_databases.n > 0 || f->exclude_databases.n > 0 ||
+              f->include_tablespaces.n > 0 || f->exclude_tablespaces.n > 0;
+  f->relkinds_active = f->include_relkinds.any || f->exclude_relkinds.any;
+}
+
+static void assign_oid_filter(SmgrStatsOidFilter* dst, void* extra) {
+  dst->n = 0;
+  if (extra) {
+    *dst = *(SmgrStatsOidFilter*)extra;
+  }
+  update_active();
+}
+
+void smgr_stats_assign_include_databases(const char* newval, void* extra) {
+  (void)newval;
+  assign_oid_filter(&smgr_stats_filter.include_databases, extra);
+}
+
+void smgr_stats_assign_exclude_databases(const char* newval, void* extra) {
+  (void)newval;
+  assign_oid_filter(&smgr_stats_filter.exclude_databases, extra);
+}
+
+void smgr_stats_assign_include_tablespaces(const char* newval, void* extra) {
+  (void)newval;
+  assign_oid_filter(&smgr_stats_filter.include_tablespaces, extra);
+}
+
+void smgr_stats_assign_exclude_tablespaces(const char* newval, void* extra) {
+  (void)newval;
+  assign_oid_filter(&smgr_stats_filter.exclude_tablespaces, extra);
+}
+
+void smgr_stats_assign_include_forks(const char* newval, void* extra) {
+  /* An empty include list means all forks */
+  uint8 mask = extra ? *(uint8*)extra : 0;
+  smgr_stats_filter.include_forks = (newval[0] == '\0' || mask == 0) ? SMGR_STATS_ALL_FORKS : mask;
+  update_active();
+}
+
+void smgr_stats_assign_exclude_forks(const char* newval, void* extra) {
+  (void)newval;
+  smgr_stats_filter.exclude_forks = extra ? *(uint8*)extra : 0;
+  update_active();
+}
+
+/* Handles cache the relkind decision, so changing a relkind filter re-resolves them */
+static void assign_relkind_filter(SmgrStatsRelkindFilter* dst, void* extra) {
+  memset(dst, 0, sizeof(SmgrStatsRelkindFilter));
+  if (extra) {
+    *dst = *(SmgrStatsRelkindFilter*)extra;
+  }
+  update_active();
+  smgr_stats_handles_invalidate();
+}
+
+void smgr_stats_assign_include_relkinds(const char* newval, void* extra) {
+  (void)newval;
+  assign_relkind_filter(&smgr_stats_filter.include_relkinds, extra);
+}
+
+void smgr_stats_assign_exclude_relkinds(const char* newval, void* extra) {
+  (void)newval;
+  assign_relkind_filter(&smgr_stats_filter.exclude_relkinds, extra);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "common/relpath.h"
+#include "storage/relfilelocator.h"
+#include "utils/guc.h"
+
+/*
+ * Tracking filters (smgr_stats.include_* / exclude_*), compiled by the GUC
+ * check hooks into flat arrays and bitmaps so that the I/O hooks can reject
+ * an operation after a few compares. Database, tablespace and fork filters
+ * are applied to every I/O; relkind filters need metadata, so handles apply
+ * them once a relation's metadata is known and snapshots drop the rest.
+ */
+
+/* Maximum number of OIDs in one include/exclude list */
+#define SMGR_STATS_FILTER_MAX_OIDS 64
+
+#define SMGR_STATS_ALL_FORKS ((uint8)((1 << (MAX_FORKNUM + 1)) - 1))
+
+typedef struct SmgrStatsOidFilter {
+  int n;
+  Oid oids[SMGR_STATS_FILTER_MAX_OIDS];
+} SmgrStatsOidFilter;
+
+typedef struct SmgrStatsRelkindFilter {
+  bool any;
+  uint64 bits[4]; /* Bitmap over all (unsigned) relkind characters */
+} SmgrStatsRelkindFilter;
+
+typedef struct SmgrStatsFilter {
+  bool active;          /* Any database, tablespace or fork filter set */
+  bool relkinds_active; /* Any relkind filter set */
+  uint8 forks;          /* Tracked forks: include_forks (or all) minus exclude_forks */
+  uint8 include_forks;
+  uint8 exclude_forks;
+  SmgrStatsOidFilter include_databases;
+  SmgrStatsOidFilter exclude_databases;
+  SmgrStatsOidFilter include_tablespaces;
+  SmgrStatsOidFilter exclude_tablespaces;
+  SmgrStatsRelkindFilter include_relkinds;
+  SmgrStatsRelkindFilter exclude_relkinds;
+} SmgrStatsFilter;
+
+extern SmgrStatsFilter smgr_stats_filter;
+
+static inline bool smgr_stats_oid_filter_contains(const SmgrStatsOidFilter* f, Oid oid) {
+  for (int i = 0; i < f->n; i++) {
+    if (f->oids[i] == oid) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline bool smgr_stats_relkind_filter_contains(const SmgrStatsRelkindFilter* f, char relkind) {
+  uint8 c = (uint8)relkind;
+  return (f->bits[c >> 6] & ((uint64)1 << (c & 63))) != 0;
+}
+
+/* Should I/O on this file be tracked? Cheap when no filter is set. */
+static inline bool smgr_stats_filter_file(const RelFileLocator* locator, ForkNumber forknum) {
+  const SmgrStatsFilter* f = &smgr_stats_filter;
+  if (likely(!f->active)) {
+    return true;
+  }
+  if ((f->forks & (1 << forknum)) == 0) {
+    return false;
+  }
+  if (f->include_databases.n > 0 && !smgr_stats_oid_filter_contains(&f->include_databases, locator->dbOid)) {
+    return false;
+  }
+  if (smgr_stats_oid_filter_contains(&f->exclude_databases, locator->dbOid)) {
+    return false;
+  }
+  if (f->include_tablespaces.n > 0 && !smgr_stats_oid_filter_contains(&f->include_tablespaces, locator->spcOid)) {
+    return false;
+  }
+  return !smgr_stats_oid_filter_contains(&f->exclude_tablespaces, locator->spcOid);
+}
+
+/* Should a relation of this kind be tracked? */
+static inline bool smgr_stats_filter_relkind(char relkind) {
+  const SmgrStatsFilter* f = &smgr_stats_filter;
+  if (likely(!f->relkinds_active)) {
+    return true;
+  }
+  if (f->include_relkinds.any && !smgr_stats_relkind_filter_contains(&f->include_relkinds, relkind)) {
+    return false;
+  }
+  return !smgr_stats_relkind_filter_contains(&f->exclude_relkinds, relkind);
+}
+
+/* GUC hooks, see smgr_stats_register_gucs() */
+extern bool smgr_stats_check_oid_list(char** newval, void** extra, GucSource source);
+extern bool smgr_stats_check_fork_list(char** newval, void** extra, GucSource source);
+extern bool smgr_stats_check_relkind_list(char** newval, void** extra, GucSource source);
+extern void smgr_stats_assign_include_databases(const char* newval, void* extra);
+extern void smgr_stats_assign_exclude_databases(const char* newval, void* extra);
+extern void smgr_stats_assign_include_tablespaces(const char* newval, void* extra);
+extern void smgr_stats_assign_exclude_tablespaces(const char* newval, void* extra);
+extern void smgr_stats_assign_include_forks(const char* newval, void* extra);
+extern void smgr_stats_assign_exclude_forks(const char* newval, void* extra);
+extern void smgr_stats_assign_include_relkinds(const char* newval, void* extra);
+extern void smgr_stats_assign_exclude_relkinds(const char* newval, void* extra);
@@ -1,13 +1,28 @@
 #include "postgres.h"
 
 #include "access/htup_details.h"
+#include "executor/spi.h"
 #include "funcapi.h"
 #include "miscadmin.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
 #include "utils/timestamp.h"
 
+#include "smgr_stats_aio.h"
+#include "smgr_stats_clock.h"
+#include "smgr_stats_guc.h"
+#include "smgr_stats_inflight.h"
+#include "smgr_stats_limit.h"
+#include "smgr_stats_query.h"
+#include "smgr_stats_slow_io.h"
 #include "smgr_stats_store.h"
+#include "smgr_stats_tablespace.h"
 
-#define CURRENT_NUM_COLUMNS 46
+#define CURRENT_NUM_COLUMNS 107
+#define QUERY_NUM_COLUMNS 14
+#define TABLESPACE_NUM_COLUMNS 9
+#define INFLIGHT_NUM_COLUMNS 11
+#define SLOW_IO_NUM_COLUMNS 11
 
 typedef struct SmgrStatsCurrentCtx {
   SmgrStatsEntry* entries;
@@ -49,6 +64,34 @@ static inline void set_char_or_null(char c, Datum* values, bool* nulls, int idx)
   }
 }
 
+/* Per-fork counter array indexed by forknum + 1, NULL unless forks were folded into the entry */
+static inline void fork_counts_to_datum(const uint64* counts, bool folded, Datum* values, bool* nulls, int idx) {
+  if (!folded) {
+    nulls[idx] = true;
+    return;
+  }
+  Datum elems[MAX_FORKNUM + 1];
+  for (int f = 0; f <= MAX_FORKNUM; f++) {
+    elems[f] = Int64GetDatum((int64)counts[f]);
+  }
+  values[idx] = PointerGetDatum(construct_array_builtin(elems, MAX_FORKNUM + 1, INT8OID));
+}
+
+/* Request size histogram, NULL if there were no requests of that kind */
+static inline void size_counts_to_datum(const uint64* bins, Datum* values, bool* nulls, int idx) {
+  Datum elems[SMGR_STATS_SIZE_BINS];
+  uint64 total = 0;
+  for (int b = 0; b < SMGR_STATS_SIZE_BINS; b++) {
+    elems[b] = Int64GetDatum((int64)bins[b]);
+    total += bins[b];
+  }
+  if (total == 0) {
+    nulls[idx] = true;
+    return;
+  }
+  values[idx] = PointerGetDatum(construct_array_builtin(elems, SMGR_STATS_SIZE_BINS, INT8OID));
+}
+
 static inline void timing_to_datum(const SmgrStatsTimingHist* h, Datum* values, bool* nulls, int idx) {
   if (h->count > 0) {
     values[idx] = smgr_stats_hist_to_array_datum(h);
@@ -66,14 +109,14 @@ static inline void timing_to_datum(const SmgrStatsTimingHist* h, Datum* values,
 }
 
 /*
- * Resolve metadata for temp aggregate entries in the snapshot.
+ * Resolve metadata for temp aggregate and collector entries in the snapshot.
  * Regular entries have their metadata resolved by hooks (ExecutorEnd, ProcessUtility, shmem_exit).
- * Temp aggregates are skipped by hooks since they use synthetic metadata that doesn't require syscache.
+ * Synthetic entries are skipped by hooks since their metadata doesn't require syscache.
  */
-static void resolve_temp_aggregate_metadata(SmgrStatsEntry* entries, int count) {
+static void resolve_synthetic_metadata(SmgrStatsEntry* entries, int count) {
   for (int i = 0; i < count; i++) {
     SmgrStatsEntry* e = &entries[i];
-    if (!e->meta.metadata_valid && smgr_stats_is_temp_aggregate_key(&e->key)) {
+    if (!e->meta.metadata_valid && smgr_stats_has_synthetic_metadata(&e->key)) {
       smgr_stats_lookup_metadata(&e->key, &e->meta);
     }
   }
@@ -93,7 +136,7 @@ Datum smgr_stats_current(PG_FUNCTION_ARGS) {
     int count;
     ctx->entries = smgr_stats_snapshot(&count, &ctx->bucket_id);
     ctx->collected_at = GetCurrentTimestamp();
-    resolve_temp_aggregate_metadata(ctx->entries, count);
+    resolve_synthetic_metadata(ctx->entries, count);
 
     funcctx->user_fctx = ctx;
     funcctx->max_calls = count;
@@ -147,6 +190,67 @@ Datum smgr_stats_current(PG_FUNCTION_ARGS) {
     TupleDescInitEntry(tupdesc, 44, "active_seconds", INT4OID, -1, 0);
     TupleDescInitEntry(tupdesc, 45, "first_access", TIMESTAMPTZOID, -1, 0);
     TupleDescInitEntry(tupdesc, 46, "last_access", TIMESTAMPTZOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 47, "timing_sample_rate", INT4OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 48, "fork_reads", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 49, "fork_writes", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 50, "fork_extends", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 51, "throttle_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 52, "throttle_count", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 53, "throttle_total_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 54, "throttle_min_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 55, "throttle_max_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 56, "backend_type", TEXTOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 57, "truncated_blocks", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 58, "extend_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 59, "extend_count", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 60, "extend_total_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 61, "extend_min_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 62, "extend_max_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 63, "zeroextend_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 64, "zeroextend_count", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 65, "zeroextend_total_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 66, "zeroextend_min_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 67, "zeroextend_max_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 68, "truncate_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 69, "truncate_count", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 70, "truncate_total_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 71, "truncate_min_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 72, "truncate_max_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 73, "fsync_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 74, "fsync_count", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 75, "fsync_total_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 76, "fsync_min_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 77, "fsync_max_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 78, "nblocks_calls", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 79, "nblocks_time_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 80, "exists_calls", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 81, "exists_time_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 82, "prefetches", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 83, "prefetch_blocks", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 84, "prefetch_time_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 85, "writebacks", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 86, "writeback_blocks", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 87, "writeback_time_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 88, "closes", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 89, "close_time_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 90, "aio_stage_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 91, "aio_stage_count", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 92, "aio_stage_total_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 93, "aio_stage_min_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 94, "aio_stage_max_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 95, "aio_device_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 96, "aio_device_count", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 97, "aio_device_total_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 98, "aio_device_min_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 99, "aio_device_max_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 100, "aio_completion_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 101, "aio_completion_count", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 102, "aio_completion_total_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 103, "aio_completion_min_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 104, "aio_completion_max_us", INT8OID, -1, 0);
+    TupleDescInitEntry(tupdesc, 105, "read_size_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 106, "write_size_hist", INT8ARRAYOID, -1, 0);
+    TupleDescInitEntry(tupdesc, 107, "zeroextend_size_hist", INT8ARRAYOID, -1, 0);
     funcctx->tuple_desc = BlessTupleDesc(tupdesc);
 
     MemoryContextSwitchTo(oldctx);
@@ -203,6 +307,50 @@ Datum smgr_stats_current(PG_FUNCTION_ARGS) {
     values[43] = Int32GetDatum((int32)e->active_seconds);
     values[44] = TimestampTzGetDatum(e->first_access);
     values[45] = TimestampTzGetDatum(e->last_access);
+    if (e->timing_sample_rate > 0) {
+      values[46] = Int32GetDatum((int32)e->timing_sample_rate);
+    } else {
+      nulls[46] = true;
+    }
+
+    bool folded = smgr_stats_entry_has_folded_forks(e);
+    fork_counts_to_datum(e->forks.reads, folded, values, nulls, 47);
+    fork_counts_to_datum(e->forks.writes, folded, values, nulls, 48);
+    fork_counts_to_datum(e->forks.extends, folded, values, nulls, 49);
+
+    timing_to_datum(&e->throttle_timing, values, nulls, 50);
+
+    if (e->key.backend_type != B_INVALID) {
+      values[55] = CStringGetTextDatum(GetBackendTypeDesc((BackendType)e->key.backend_type));
+    } else {
+      nulls[55] = true;
+    }
+
+    values[56] = UInt64GetDatum(e->truncated_blocks);
+    timing_to_datum(&e->extend_timing, values, nulls, 57);
+    timing_to_datum(&e->zeroextend_timing, values, nulls, 62);
+    timing_to_datum(&e->truncate_timing, values, nulls, 67);
+    timing_to_datum(&e->fsync_timing, values, nulls, 72);
+
+    /* Metadata ops */
+    values[77] = UInt64GetDatum(e->meta_ops.calls[SMGR_STATS_META_NBLOCKS]);
+    values[78] = UInt64GetDatum(e->meta_ops.time_us[SMGR_STATS_META_NBLOCKS]);
+    values[79] = UInt64GetDatum(e->meta_ops.calls[SMGR_STATS_META_EXISTS]);
+    values[80] = UInt64GetDatum(e->meta_ops.time_us[SMGR_STATS_META_EXISTS]);
+    values[81] = UInt64GetDatum(e->meta_ops.calls[SMGR_STATS_META_PREFETCH]);
+    values[82] = UInt64GetDatum(e->meta_ops.blocks[SMGR_STATS_META_PREFETCH]);
+    values[83] = UInt64GetDatum(e->meta_ops.time_us[SMGR_STATS_META_PREFETCH]);
+    values[84] = UInt64GetDatum(e->meta_ops.calls[SMGR_STATS_META_WRITEBACK]);
+    values[85] = UInt64GetDatum(e->meta_ops.blocks[SMGR_STATS_META_WRITEBACK]);
+    values[86] = UInt64GetDatum(e->meta_ops.time_us[SMGR_STATS_META_WRITEBACK]);
+    values[87] = UInt64GetDatum(e->meta_ops.calls[SMGR_STATS_META_CLOSE]);
+    values[88] = UInt64GetDatum(e->meta_ops.time_us[SMGR_STATS_META_CLOSE]);
+    for (int p = 0; p < SMGR_STATS_NUM_AIO_PHASES; p++) {
+      timing_to_datum(&e->aio_phase_timing[p], values, nulls, 89 + 5 * p);
+    }
+    size_counts_to_datum(e->sizes.reads, values, nulls, 104);
+    size_counts_to_datum(e->sizes.writes, values, nulls, 105);
+    size_counts_to_datum(e->sizes.zeroextends, values, nulls, 106);
 
     HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
     SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
@@ -210,3 +358,192 @@ Datum smgr_stats_current(PG_FUNCTION_ARGS) {
 
   SRF_RETURN_DONE(funcctx);
 }
+
+/* Append one (name, value) row to a materialized smgr_stats.status() result. */
+static void status_row(ReturnSetInfo* rsinfo, const char* name, const char* value) {
+  Datum values[2] = {CStringGetTextDatum(name), CStringGetTextDatum(value)};
+  bool nulls[2] = {false, false};
+  tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+}
+
+PG_FUNCTION_INFO_V1(smgr_stats_status);
+
+Datum smgr_stats_status(PG_FUNCTION_ARGS) {
+  ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+  InitMaterializedSRF(fcinfo, 0);
+
+  status_row(rsinfo, "clock_source", smgr_stats_clock_source_name());
+  status_row(rsinfo, "io_method", smgr_stats_io_method_name());
+
+  char entries[32];
+  snprintf(entries, sizeof(entries), INT64_FORMAT, smgr_stats_entry_count());
+  status_row(rsinfo, "entries", entries);
+
+  for (int i = 0; i < SMGR_STATS_NUM_COUNTERS; i++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), UINT64_FORMAT, smgr_stats_counter_read((SmgrStatsCounterId)i));
+    status_row(rsinfo, smgr_stats_counter_names[i], buf);
+  }
+
+  return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(smgr_stats_reload_io_limits);
+
+Datum smgr_stats_reload_io_limits(PG_FUNCTION_ARGS) {
+  (void)fcinfo;
+  SPI_connect();
+  int count = smgr_stats_load_io_limits();
+  SPI_finish();
+  PG_RETURN_INT32(count);
+}
+
+PG_FUNCTION_INFO_V1(smgr_stats_current_by_query);
+
+Datum smgr_stats_current_by_query(PG_FUNCTION_ARGS) {
+  ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+  InitMaterializedSRF(fcinfo, 0);
+  if (smgr_stats_query_top_n == 0) {
+    return (Datum)0;
+  }
+
+  int count;
+  SmgrStatsQueryEntry* entries = smgr_stats_query_snapshot(&count, false);
+  for (int i = 0; i < count; i++) {
+    SmgrStatsQueryEntry* e = &entries[i];
+    Datum values[QUERY_NUM_COLUMNS];
+    bool nulls[QUERY_NUM_COLUMNS] = {0};
+
+    values[0] = Int64GetDatum(e->key.queryid);
+    values[1] = ObjectIdGetDatum(e->key.locator.spcOid);
+    values[2] = ObjectIdGetDatum(e->key.locator.dbOid);
+    values[3] = ObjectIdGetDatum(e->key.locator.relNumber);
+    values[4] = Int16GetDatum(e->key.forknum);
+    values[5] = Int64GetDatum((int64)e->counters.reads);
+    values[6] = Int64GetDatum((int64)e->counters.read_blocks);
+    values[7] = Int64GetDatum((int64)e->counters.read_us);
+    values[8] = Int64GetDatum((int64)e->counters.writes);
+    values[9] = Int64GetDatum((int64)e->counters.write_blocks);
+    values[10] = Int64GetDatum((int64)e->counters.write_us);
+    values[11] = Int64GetDatum((int64)e->counters.extends);
+    values[12] = Int64GetDatum((int64)e->counters.extend_blocks);
+    values[13] = Int64GetDatum((int64)e->error);
+
+    tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+  }
+  pfree(entries);
+
+  return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(smgr_stats_current_by_tablespace);
+
+Datum smgr_stats_current_by_tablespace(PG_FUNCTION_ARGS) {
+  ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+  InitMaterializedSRF(fcinfo, 0);
+
+  int count;
+  SmgrStatsTablespaceStats* stats = smgr_stats_tablespace_snapshot(&count, false);
+  for (int i = 0; i < count; i++) {
+    SmgrStatsTablespaceStats* s = &stats[i];
+    Datum values[TABLESPACE_NUM_COLUMNS];
+    bool nulls[TABLESPACE_NUM_COLUMNS] = {0};
+
+    values[0] = ObjectIdGetDatum(s->spcoid);
+    values[1] = Int64GetDatum((int64)s->ios);
+    values[2] = Int64GetDatum((int64)s->io_time_us);
+    values[3] = Int64GetDatum((int64)s->busy_us);
+    values[4] = Int64GetDatum((int64)s->interval_us);
+    if (s->interval_us > 0) {
+      values[5] = Float8GetDatum((double)s->io_time_us / (double)s->interval_us);
+      values[8] = Float8GetDatum(Min((double)s->busy_us / (double)s->interval_us, 1.0));
+    } else {
+      nulls[5] = true;
+      nulls[8] = true;
+    }
+    values[6] = Int32GetDatum((int32)s->max_depth);
+    values[7] = Int32GetDatum((int32)s->depth);
+
+    tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+  }
+  pfree(stats);
+
+  return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(smgr_stats_in_flight);
+
+Datum smgr_stats_in_flight(PG_FUNCTION_ARGS) {
+  ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+  InitMaterializedSRF(fcinfo, 0);
+
+  int count;
+  SmgrStatsInflightIO* ios = smgr_stats_inflight_snapshot(&count);
+  TimestampTz now = GetCurrentTimestamp();
+  for (int i = 0; i < count; i++) {
+    SmgrStatsInflightIO* io = &ios[i];
+    Datum values[INFLIGHT_NUM_COLUMNS];
+    bool nulls[INFLIGHT_NUM_COLUMNS] = {0};
+
+    values[0] = Int32GetDatum(io->pid);
+    values[1] = CStringGetTextDatum(smgr_stats_inflight_op_name(io->op));
+    values[2] = ObjectIdGetDatum(io->locator.spcOid);
+    values[3] = ObjectIdGetDatum(io->locator.dbOid);
+    values[4] = ObjectIdGetDatum(io->locator.relNumber);
+    values[5] = Int16GetDatum((int16)io->forknum);
+    if (BlockNumberIsValid(io->blocknum)) {
+      values[6] = Int64GetDatum((int64)io->blocknum);
+    } else {
+      nulls[6] = true;
+    }
+    values[7] = Int32GetDatum((int32)io->nblocks);
+    if (io->io_id >= 0) {
+      values[8] = Int32GetDatum(io->io_id);
+    } else {
+      nulls[8] = true;
+    }
+    values[9] = TimestampTzGetDatum(io->started_at);
+    values[10] = Int64GetDatum(Max(now - io->started_at, 0));
+
+    tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+  }
+  pfree(ios);
+
+  return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(smgr_stats_current_slow_io);
+
+Datum smgr_stats_current_slow_io(PG_FUNCTION_ARGS) {
+  ReturnSetInfo* rsinfo = (ReturnSetInfo*)fcinfo->resultinfo;
+  InitMaterializedSRF(fcinfo, 0);
+
+  int count;
+  SmgrStatsSlowIO* ios = smgr_stats_slow_io_snapshot(&count, false);
+  for (int i = 0; i < count; i++) {
+    SmgrStatsSlowIO* io = &ios[i];
+    Datum values[SLOW_IO_NUM_COLUMNS];
+    bool nulls[SLOW_IO_NUM_COLUMNS] = {0};
+
+    values[0] = TimestampTzGetDatum(io->completed_at);
+    values[1] = Int32GetDatum(io->pid);
+    values[2] = CStringGetTextDatum(GetBackendTypeDesc(io->backend_type));
+    values[3] = CStringGetTextDatum(smgr_stats_inflight_op_name(io->op));
+    values[4] = ObjectIdGetDatum(io->locator.spcOid);
+    values[5] = ObjectIdGetDatum(io->locator.dbOid);
+    values[6] = ObjectIdGetDatum(io->locator.relNumber);
+    values[7] = Int16GetDatum((int16)io->forknum);
+    if (BlockNumberIsValid(io->blocknum)) {
+      values[8] = Int64GetDatum((int64)io->blocknum);
+    } else {
+      nulls[8] = true;
+    }
+    values[9] = Int32GetDatum((int32)io->nblocks);
+    values[10] = Int64GetDatum((int64)io->elapsed_us);
+
+    tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+  }
+  pfree(ios);
+
+  return (Datum)0;
+}
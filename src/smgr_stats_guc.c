@@ -2,31 +2,190 @@
 
 #include "utils/guc.h"
 
+#include "smgr_stats_clock.h"
+#include "smgr_stats_filter.h"
 #include "smgr_stats_guc.h"
+#include "smgr_stats_handle.h"
 
 /* GUC variables */
+bool smgr_stats_enabled = true;
 char* smgr_stats_database = "postgres";
 int smgr_stats_collection_interval = 60;
 int smgr_stats_track_temp_tables = SMGR_STATS_TEMP_AGGREGATE;
+int smgr_stats_track_partitions = SMGR_STATS_PARTITIONS_OFF;
+int smgr_stats_partition_hot_leaves = 0;
 int smgr_stats_retention_hours = 168; /* 7 days */
+int smgr_stats_cold_release_buckets = 0;
+int smgr_stats_cold_release_max_active_seconds = 60;
+bool smgr_stats_backend_buffering = false;
+bool smgr_stats_fold_forks = false;
+bool smgr_stats_track_backend_type = false;
+int smgr_stats_backend_flush_interval = 1000; /* ms */
+int smgr_stats_timing_sample_rate = 1;
+int smgr_stats_clock_source = SMGR_STATS_CLOCK_AUTO;
+bool smgr_stats_adaptive_prefetch = false;
+int smgr_stats_prefetch_max_distance = 256;
+int smgr_stats_stripes = 8;
+int smgr_stats_stripe_threshold = 1000;
+int smgr_stats_query_top_n = 0;
+int smgr_stats_slow_io_threshold = 1000; /* ms */
+char* smgr_stats_include_databases = "";
+char* smgr_stats_exclude_databases = "";
+char* smgr_stats_include_tablespaces = "";
+char* smgr_stats_exclude_tablespaces = "";
+char* smgr_stats_include_forks = "";
+char* smgr_stats_exclude_forks = "";
+char* smgr_stats_include_relkinds = "";
+char* smgr_stats_exclude_relkinds = "";
 
 static const struct config_enum_entry track_temp_tables_options[] = {{"off", SMGR_STATS_TEMP_OFF, false},
                                                                      {"individual", SMGR_STATS_TEMP_INDIVIDUAL, false},
                                                                      {"aggregate", SMGR_STATS_TEMP_AGGREGATE, false},
                                                                      {NULL, 0, false}};
 
+static const struct config_enum_entry track_partitions_options[] = {
+    {"off", SMGR_STATS_PARTITIONS_OFF, false}, {"aggregate", SMGR_STATS_PARTITIONS_AGGREGATE, false}, {NULL, 0, false}};
+
+static const struct config_enum_entry clock_source_options[] = {{"auto", SMGR_STATS_CLOCK_AUTO, false},
+                                                                {"system", SMGR_STATS_CLOCK_SYSTEM, false},
+                                                                {"tsc", SMGR_STATS_CLOCK_TSC, false},
+                                                                {NULL, 0, false}};
+
+/* The temp table mode changes which entry a relation maps to */
+static void assign_track_temp_tables(int newval, void* extra) {
+  (void)newval;
+  (void)extra;
+  smgr_stats_handles_invalidate();
+}
+
+/* Folding changes which entry a fork maps to */
+static void assign_fold_forks(bool newval, void* extra) {
+  (void)newval;
+  (void)extra;
+  smgr_stats_handles_invalidate();
+}
+
+/* Backends pick their stripe from the count, drop the resolved ones */
+static void assign_stripes(int newval, void* extra) {
+  (void)newval;
+  (void)extra;
+  smgr_stats_handles_invalidate();
+}
+
 void smgr_stats_register_gucs(void) {
+  DefineCustomBoolVariable("smgr_stats.enabled", "Track storage manager I/O.", NULL, &smgr_stats_enabled, true,
+                           PGC_SUSET, 0, NULL, NULL, NULL);
+
   DefineCustomStringVariable("smgr_stats.database", "Database where the history table is stored.", NULL,
                              &smgr_stats_database, "postgres", PGC_POSTMASTER, 0, NULL, NULL, NULL);
 
-  DefineCustomIntVariable("smgr_stats.collection_interval", "Seconds between stats collections.", NULL,
+  DefineCustomIntVariable("smgr_stats.collection_interval", "Seconds between stats collections.",
+                          "smgr_stats.io_limits is also reloaded once per collection.",
                           &smgr_stats_collection_interval, 60, 1, 3600, PGC_SIGHUP, 0, NULL, NULL, NULL);
 
   DefineCustomEnumVariable("smgr_stats.track_temp_tables",
                            "How to track temporary table I/O (off, individual, aggregate).", NULL,
                            &smgr_stats_track_temp_tables, SMGR_STATS_TEMP_AGGREGATE, track_temp_tables_options,
-                           PGC_SUSET, 0, NULL, NULL, NULL);
+                           PGC_SUSET, 0, NULL, assign_track_temp_tables, NULL);
+
+  DefineCustomEnumVariable("smgr_stats.track_partitions",
+                           "How to track leaf partition I/O (off, aggregate into the partitioned root).", NULL,
+                           &smgr_stats_track_partitions, SMGR_STATS_PARTITIONS_OFF, track_partitions_options,
+                           PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable("smgr_stats.partition_hot_leaves",
+                          "Number of busiest leaf partitions still tracked individually in aggregate mode.", NULL,
+                          &smgr_stats_partition_hot_leaves, 0, 0, 10000, PGC_SIGHUP, 0, NULL, NULL, NULL);
 
   DefineCustomIntVariable("smgr_stats.retention_hours", "Hours to retain history data (0 = forever).", NULL,
                           &smgr_stats_retention_hours, 168, 0, 87600 /* 10 years */, PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable("smgr_stats.cold_release_buckets",
+                          "Release the OS page cache of relations with no I/O for this many buckets (0 = never).",
+                          NULL, &smgr_stats_cold_release_buckets, 0, 0, 1000000, PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable("smgr_stats.cold_release_max_active_seconds",
+                          "Only release relations active for at most this long in the buckets before going idle.",
+                          NULL, &smgr_stats_cold_release_max_active_seconds, 60, 0, INT_MAX, PGC_SIGHUP, GUC_UNIT_S,
+                          NULL, NULL, NULL);
+
+  DefineCustomBoolVariable("smgr_stats.backend_buffering",
+                           "Accumulate stats in backend-local memory and flush them to shared memory in batches.",
+                           NULL, &smgr_stats_backend_buffering, false, PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable("smgr_stats.backend_flush_interval",
+                          "Maximum time buffered backend stats stay local while a statement is running.", NULL,
+                          &smgr_stats_backend_flush_interval, 1000, 1, 60000, PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL,
+                          NULL);
+
+  DefineCustomBoolVariable("smgr_stats.fold_forks",
+                           "Record FSM, VM and init fork I/O in the main-fork entry, with per-fork counters.", NULL,
+                           &smgr_stats_fold_forks, false, PGC_SIGHUP, 0, NULL, assign_fold_forks, NULL);
+
+  DefineCustomBoolVariable("smgr_stats.track_backend_type",
+                           "Keep separate stats per backend type (client backend, checkpointer, autovacuum, ...).",
+                           NULL, &smgr_stats_track_backend_type, false, PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable("smgr_stats.timing_sample_rate",
+                          "Time only 1 in N reads and writes (latency histograms and burstiness are scaled up).",
+                          NULL, &smgr_stats_timing_sample_rate, 1, 1, 1000000, PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+  DefineCustomEnumVariable("smgr_stats.clock_source", "Clock used to time I/O (auto, system, tsc).", NULL,
+                           &smgr_stats_clock_source, SMGR_STATS_CLOCK_AUTO, clock_source_options, PGC_POSTMASTER, 0,
+                           NULL, NULL, NULL);
+
+  DefineCustomBoolVariable("smgr_stats.adaptive_prefetch",
+                           "Prefetch ahead of sequential read runs, scaled to the file's usual run length.", NULL,
+                           &smgr_stats_adaptive_prefetch, false, PGC_SUSET, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable("smgr_stats.prefetch_max_distance", "Maximum adaptive read-ahead distance.", NULL,
+                          &smgr_stats_prefetch_max_distance, 256, 1, 65536, PGC_SUSET, GUC_UNIT_BLOCKS, NULL, NULL,
+                          NULL);
+
+  DefineCustomIntVariable("smgr_stats.stripes", "Number of stripes a hot entry is split into (1 = never stripe).",
+                          NULL, &smgr_stats_stripes, 8, 1, 64, PGC_SIGHUP, 0, NULL, assign_stripes, NULL);
+
+  DefineCustomIntVariable("smgr_stats.stripe_threshold",
+                          "Contended lock acquisitions per collection interval after which an entry is striped.",
+                          NULL, &smgr_stats_stripe_threshold, 1000, 0, INT_MAX, PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable("smgr_stats.query_top_n",
+                          "Number of (queryid, relation file) pairs whose I/O is tracked per bucket (0 = off).", NULL,
+                          &smgr_stats_query_top_n, 0, 0, 100000, PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable("smgr_stats.slow_io_threshold",
+                          "Record every I/O taking at least this long in smgr_stats.slow_io (-1 = off).", NULL,
+                          &smgr_stats_slow_io_threshold, 1000, -1, INT_MAX, PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
+
+  DefineCustomStringVariable("smgr_stats.include_databases", "Only track I/O in these databases (OIDs, 0 = shared).",
+                             NULL, &smgr_stats_include_databases, "", PGC_SIGHUP, GUC_LIST_INPUT,
+                             smgr_stats_check_oid_list, smgr_stats_assign_include_databases, NULL);
+
+  DefineCustomStringVariable("smgr_stats.exclude_databases", "Do not track I/O in these databases (OIDs).", NULL,
+                             &smgr_stats_exclude_databases, "", PGC_SIGHUP, GUC_LIST_INPUT,
+                             smgr_stats_check_oid_list, smgr_stats_assign_exclude_databases, NULL);
+
+  DefineCustomStringVariable("smgr_stats.include_tablespaces", "Only track I/O in these tablespaces (OIDs).", NULL,
+                             &smgr_stats_include_tablespaces, "", PGC_SIGHUP, GUC_LIST_INPUT,
+                             smgr_stats_check_oid_list, smgr_stats_assign_include_tablespaces, NULL);
+
+  DefineCustomStringVariable("smgr_stats.exclude_tablespaces", "Do not track I/O in these tablespaces (OIDs).", NULL,
+                             &smgr_stats_exclude_tablespaces, "", PGC_SIGHUP, GUC_LIST_INPUT,
+                             smgr_stats_check_oid_list, smgr_stats_assign_exclude_tablespaces, NULL);
+
+  DefineCustomStringVariable("smgr_stats.include_forks", "Only track I/O on these forks (main, fsm, vm, init).", NULL,
+                             &smgr_stats_include_forks, "", PGC_SIGHUP, GUC_LIST_INPUT,
+                             smgr_stats_check_fork_list, smgr_stats_assign_include_forks, NULL);
+
+  DefineCustomStringVariable("smgr_stats.exclude_forks", "Do not track I/O on these forks.", NULL,
+                             &smgr_stats_exclude_forks, "", PGC_SIGHUP, GUC_LIST_INPUT, smgr_stats_check_fork_list,
+                             smgr_stats_assign_exclude_forks, NULL);
+
+  DefineCustomStringVariable("smgr_stats.include_relkinds", "Only track relations of these kinds (pg_class.relkind).",
+                             NULL, &smgr_stats_include_relkinds, "", PGC_SIGHUP, GUC_LIST_INPUT,
+                             smgr_stats_check_relkind_list, smgr_stats_assign_include_relkinds, NULL);
+
+  DefineCustomStringVariable("smgr_stats.exclude_relkinds", "Do not track relations of these kinds.", NULL,
+                             &smgr_stats_exclude_relkinds, "", PGC_SIGHUP, GUC_LIST_INPUT,
+                             smgr_stats_check_relkind_list, smgr_stats_assign_exclude_relkinds, NULL);
 }
@@ -7,9 +7,39 @@ typedef enum SmgrStatsTempTracking {
   SMGR_STATS_TEMP_AGGREGATE = 2
 } SmgrStatsTempTracking;
 
+typedef enum SmgrStatsPartitionTracking {
+  SMGR_STATS_PARTITIONS_OFF = 0,
+  SMGR_STATS_PARTITIONS_AGGREGATE = 1
+} SmgrStatsPartitionTracking;
+
+extern bool smgr_stats_enabled;
 extern char* smgr_stats_database;
 extern int smgr_stats_collection_interval;
 extern int smgr_stats_track_temp_tables;
+extern int smgr_stats_track_partitions;
+extern int smgr_stats_partition_hot_leaves;
 extern int smgr_stats_retention_hours;
+extern int smgr_stats_cold_release_buckets;
+extern int smgr_stats_cold_release_max_active_seconds;
+extern bool smgr_stats_backend_buffering;
+extern bool smgr_stats_fold_forks;
+extern bool smgr_stats_track_backend_type;
+extern int smgr_stats_backend_flush_interval;
+extern int smgr_stats_timing_sample_rate;
+extern int smgr_stats_clock_source;
+extern bool smgr_stats_adaptive_prefetch;
+extern int smgr_stats_prefetch_max_distance;
+extern int smgr_stats_stripes;
+extern int smgr_stats_stripe_threshold;
+extern int smgr_stats_query_top_n;
+extern int smgr_stats_slow_io_threshold;
+extern char* smgr_stats_include_databases;
+extern char* smgr_stats_exclude_databases;
+extern char* smgr_stats_include_tablespaces;
+extern char* smgr_stats_exclude_tablespaces;
+extern char* smgr_stats_include_forks;
+extern char* smgr_stats_exclude_forks;
+extern char* smgr_stats_include_relkinds;
+extern char* smgr_stats_exclude_relkinds;
 
 extern void smgr_stats_register_gucs(void);
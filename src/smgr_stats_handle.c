@@ -0,0 +1,164 @@
+#include "postgres.h"
+
+#include "common/hashfn.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "utils/memutils.h"
+
+#include "smgr_stats_filter.h"
+#include "smgr_stats_guc.h"
+#include "smgr_stats_handle.h"
+#include "smgr_stats_metadata.h"
+
+/* Number of direct-mapped slots. Must be a power of 2. */
+#define SMGR_STATS_HANDLE_SLOTS 256
+
+typedef struct SmgrStatsHandleSlot {
+  SMgrRelation reln;                              /* Owning relation, NULL if free */
+  RelFileLocator locator;                         /* Detects a freed SMgrRelation whose address was reused */
+  uint64 generation;                              /* Handle generation the entries were resolved under */
+  SmgrStatsSharedEntry* entries[MAX_FORKNUM + 1]; /* Pinned entries, NULL until the fork is first used */
+  SmgrStatsSharedEntry* stripes[MAX_FORKNUM + 1]; /* Pinned stripe of a striped entry, ops go there */
+  uint8 relkind_checked;                          /* Forks whose relkind was checked against the filters */
+  uint8 relkind_excluded;                         /* Forks filtered out by relkind */
+} SmgrStatsHandleSlot;
+
+static SmgrStatsHandleSlot* handle_slots = NULL;
+static uint64 handle_generation = 1;
+static bool handles_released = false;
+
+static void release_fork(SmgrStatsHandleSlot* slot, ForkNumber forknum) {
+  if (slot->entries[forknum]) {
+    smgr_stats_unpin_entry(slot->entries[forknum]);
+    slot->entries[forknum] = NULL;
+  }
+  if (slot->stripes[forknum]) {
+    smgr_stats_unpin_entry(slot->stripes[forknum]);
+    slot->stripes[forknum] = NULL;
+  }
+  slot->relkind_checked &= (uint8) ~(1 << forknum);
+  slot->relkind_excluded &= (uint8) ~(1 << forknum);
+}
+
+static void release_slot(SmgrStatsHandleSlot* slot) {
+  for (ForkNumber i = 0; i <= MAX_FORKNUM; i++) {
+    release_fork(slot, i);
+  }
+  slot->reln = NULL;
+}
+
+/* Drop all pins at exit, otherwise the entries could never be evicted */
+static void handles_before_shmem_exit(int code, Datum arg) {
+  (void)code;
+  (void)arg;
+  for (int i = 0; i < SMGR_STATS_HANDLE_SLOTS; i++) {
+    release_slot(&handle_slots[i]);
+  }
+  handles_released = true;
+}
+
+static inline SmgrStatsHandleSlot* slot_of(SMgrRelation reln) {
+  return &handle_slots[murmurhash64((uint64)(uintptr_t)reln) & (SMGR_STATS_HANDLE_SLOTS - 1)];
+}
+
+/* Does the slot belong to reln, resolved under the current generation? */
+static inline bool slot_is_current(const SmgrStatsHandleSlot* slot, SMgrRelation reln) {
+  return slot->reln == reln && slot->generation == handle_generation &&
+         RelFileLocatorEquals(slot->locator, reln->smgr_rlocator.locator);
+}
+
+SmgrStatsSharedEntry* smgr_stats_handle_get(SMgrRelation reln, ForkNumber forknum, const SmgrStatsKey* tracking_key) {
+  if (unlikely(handles_released)) {
+    return NULL;
+  }
+  if (unlikely(!handle_slots)) {
+    if (CritSectionCount > 0) {
+      return NULL;
+    }
+    handle_slots = MemoryContextAllocZero(TopMemoryContext, sizeof(SmgrStatsHandleSlot) * SMGR_STATS_HANDLE_SLOTS);
+    before_shmem_exit(handles_before_shmem_exit, (Datum)0);
+  }
+
+  SmgrStatsHandleSlot* slot = slot_of(reln);
+
+  if (unlikely(!slot_is_current(slot, reln))) {
+    /* Stale or owned by another relation: take the slot over */
+    release_slot(slot);
+    slot->reln = reln;
+    slot->locator = reln->smgr_rlocator.locator;
+    slot->generation = handle_generation;
+  }
+
+  SmgrStatsSharedEntry* shared = slot->entries[forknum];
+  if (unlikely(shared == NULL || !smgr_stats_same_logical_key(&shared->key, tracking_key))) {
+    /* First use of the fork, or its I/O now goes elsewhere (a leaf partition was mapped to its root) */
+    release_fork(slot, forknum);
+    bool needs_metadata;
+    shared = smgr_stats_pin_entry(tracking_key, true, &needs_metadata);
+    if (!shared) {
+      return NULL; /* Doesn't exist yet, and can't be created in a critical section */
+    }
+    if (needs_metadata && CritSectionCount == 0 && !smgr_stats_has_synthetic_metadata(tracking_key)) {
+      smgr_stats_add_pending_metadata(tracking_key);
+    }
+    slot->entries[forknum] = shared;
+  }
+
+  uint8 fork_bit = (uint8)(1 << forknum);
+  if (unlikely(smgr_stats_filter.relkinds_active && !(slot->relkind_checked & fork_bit))) {
+    /* Unlocked peek; until metadata shows up (end of transaction) the I/O is tracked */
+    char relkind = shared->meta.relkind;
+    if (shared->meta.metadata_valid && relkind != '\0') {
+      slot->relkind_checked |= fork_bit;
+      if (!smgr_stats_filter_relkind(relkind)) {
+        slot->relkind_excluded |= fork_bit;
+      }
+    }
+  }
+  if (unlikely(slot->relkind_excluded & fork_bit)) {
+    return NULL;
+  }
+
+  if (likely(slot->stripes[forknum] == NULL)) {
+    if (likely(smgr_stats_stripes <= 1 || pg_atomic_read_u32(&shared->striped) == 0)) {
+      return shared;
+    }
+    /* The collector striped the entry; keep the logical one pinned for its metadata */
+    SmgrStatsKey stripe_key = *tracking_key;
+    stripe_key.stripe = smgr_stats_my_stripe(smgr_stats_stripes);
+    slot->stripes[forknum] = smgr_stats_pin_entry(&stripe_key, true, NULL);
+  }
+  return slot->stripes[forknum];
+}
+
+Oid smgr_stats_handle_reloid(SMgrRelation reln, ForkNumber forknum, const SmgrStatsKey* tracking_key) {
+  if (!smgr_stats_handle_get(reln, forknum, tracking_key)) {
+    return InvalidOid;
+  }
+  /* Stripes carry no metadata, the logical entry does; unlocked peek as for relkind */
+  SmgrStatsSharedEntry* shared = slot_of(reln)->entries[forknum];
+  return shared->meta.metadata_valid ? shared->meta.reloid : InvalidOid;
+}
+
+SmgrStatsSharedEntry* smgr_stats_handle_peek(SMgrRelation reln, ForkNumber forknum) {
+  if (!handle_slots || handles_released) {
+    return NULL;
+  }
+  SmgrStatsHandleSlot* slot = slot_of(reln);
+  if (!slot_is_current(slot, reln) || (slot->relkind_excluded & (1 << forknum))) {
+    return NULL;
+  }
+  return slot->stripes[forknum] ? slot->stripes[forknum] : slot->entries[forknum];
+}
+
+void smgr_stats_handle_release(SMgrRelation reln, ForkNumber forknum) {
+  if (!handle_slots || handles_released) {
+    return;
+  }
+  SmgrStatsHandleSlot* slot = slot_of(reln);
+  if (slot->reln == reln) {
+    release_fork(slot, forknum);
+  }
+}
+
+void smgr_stats_handles_invalidate(void) { handle_generation++; }
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "storage/smgr.h"
+
+#include "smgr_stats_store.h"
+
+/*
+ * Backend-local handle cache.
+ *
+ * Steady-state I/O on an SMgrRelation goes straight to a pinned shared entry
+ * instead of building a key, hashing it and probing the dshash on every call.
+ * Handles (and the entries behind them) are materialized on the relation's
+ * first physical I/O, not when it is opened.
+ * A handle is the pinned entry pointer plus the handle generation it was
+ * resolved under. Slots are direct-mapped by SMgrRelation address and
+ * validated against the relation's locator, so a freed and reused SMgrRelation
+ * is detected. Bumping the generation (when a setting changes how keys are
+ * chosen) makes the backend re-resolve its handles on next use; a fork whose
+ * key changed on its own (a leaf partition mapped to its root) is re-resolved
+ * when the pinned entry's key no longer matches the tracking key. Pinned entries
+ * are never evicted, and counter resets happen in place, so a cached pointer
+ * stays valid for as long as the handle holds its pin. Once the collector
+ * stripes a hot entry, the handle also pins this backend's stripe and returns
+ * that instead.
+ */
+
+/* Return the pinned entry for (reln, forknum), resolving (and creating) it on a
+ * cache miss. tracking_key is checked against the pinned entry's key and used on a
+ * miss or to find the stripe. The caller must not unpin it.
+ * Returns NULL if the relation's kind is filtered out, once the handles have
+ * been released at backend exit, or in a critical section if the entry (or
+ * stripe) would have to be created. */
+extern SmgrStatsSharedEntry* smgr_stats_handle_get(SMgrRelation reln, ForkNumber forknum,
+                                                   const SmgrStatsKey* tracking_key);
+
+/* pg_class OID recorded in the logical entry for (reln, forknum), resolving the handle
+ * like smgr_stats_handle_get. InvalidOid if filtered out or the metadata isn't known yet. */
+extern Oid smgr_stats_handle_reloid(SMgrRelation reln, ForkNumber forknum, const SmgrStatsKey* tracking_key);
+
+/* The entry (or stripe) ops on (reln, forknum) currently go to, without resolving
+ * anything. NULL if the fork has no valid handle. */
+extern SmgrStatsSharedEntry* smgr_stats_handle_peek(SMgrRelation reln, ForkNumber forknum);
+
+/* Drop the handle's pins for (reln, forknum), when the relation closes the fork. */
+extern void smgr_stats_handle_release(SMgrRelation reln, ForkNumber forknum);
+
+/* Invalidate all handles of this backend; they are re-resolved on next use. */
+extern void smgr_stats_handles_invalidate(void);
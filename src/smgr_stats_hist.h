@@ -1,5 +1,6 @@
 #pragma once
 
+#include "port/atomics.h"
 #include "port/pg_bitutils.h"
 #include "postgres.h"
 
@@ -29,16 +30,22 @@ typedef struct SmgrStatsTimingHist {
  *   ...
  *   value 2^30+   -> clamped   -> bin 31 (overflow)
  */
-static inline void smgr_stats_hist_record(SmgrStatsTimingHist* hist, uint64 value_us) {
-  int bin;
+static inline int smgr_stats_hist_bin(uint64 value_us) {
   if (value_us == 0) {
-    bin = 0;
-  } else {
-    bin = Min(pg_leftmost_one_pos64(value_us) + 1, SMGR_STATS_HIST_BINS - 1);
+    return 0;
   }
-  hist->bins[bin]++;
-  hist->count++;
-  hist->total_us += value_us;
+  return Min(pg_leftmost_one_pos64(value_us) + 1, SMGR_STATS_HIST_BINS - 1);
+}
+
+/*
+ * With sampled timing (smgr_stats.timing_sample_rate) each timed observation
+ * stands for `weight` operations; bins, count and total are scaled at record
+ * time so histograms stay unbiased estimates even if the rate changes.
+ */
+static inline void smgr_stats_hist_record(SmgrStatsTimingHist* hist, uint64 value_us, uint32 weight) {
+  hist->bins[smgr_stats_hist_bin(value_us)] += weight;
+  hist->count += weight;
+  hist->total_us += value_us * weight;
   if (value_us < hist->min_us) {
     hist->min_us = value_us;
   }
@@ -56,5 +63,86 @@ static inline void smgr_stats_hist_reset(SmgrStatsTimingHist* hist) {
   hist->max_us = 0;
 }
 
+/* Add all observations of src into dst. Histograms are mergeable bin by bin. */
+static inline void smgr_stats_hist_merge(SmgrStatsTimingHist* dst, const SmgrStatsTimingHist* src) {
+  if (src->count == 0) {
+    return;
+  }
+  for (int i = 0; i < SMGR_STATS_HIST_BINS; i++) {
+    dst->bins[i] += src->bins[i];
+  }
+  dst->count += src->count;
+  dst->total_us += src->total_us;
+  if (src->min_us < dst->min_us) {
+    dst->min_us = src->min_us;
+  }
+  if (src->max_us > dst->max_us) {
+    dst->max_us = src->max_us;
+  }
+}
+
+/*
+ * Shared-memory variant of SmgrStatsTimingHist. Backends record into it
+ * concurrently with fetch-add; min/max are maintained with CAS loops.
+ */
+typedef struct SmgrStatsAtomicHist {
+  pg_atomic_uint64 bins[SMGR_STATS_HIST_BINS];
+  pg_atomic_uint64 count;
+  pg_atomic_uint64 total_us;
+  pg_atomic_uint64 min_us; /* PG_UINT64_MAX sentinel when empty */
+  pg_atomic_uint64 max_us;
+} SmgrStatsAtomicHist;
+
+static inline void smgr_stats_atomic_min_u64(pg_atomic_uint64* ptr, uint64 value) {
+  uint64 cur = pg_atomic_read_u64(ptr);
+  while (value < cur && !pg_atomic_compare_exchange_u64(ptr, &cur, value)) {
+  }
+}
+
+static inline void smgr_stats_atomic_hist_init(SmgrStatsAtomicHist* hist) {
+  for (int i = 0; i < SMGR_STATS_HIST_BINS; i++) {
+    pg_atomic_init_u64(&hist->bins[i], 0);
+  }
+  pg_atomic_init_u64(&hist->count, 0);
+  pg_atomic_init_u64(&hist->total_us, 0);
+  pg_atomic_init_u64(&hist->min_us, PG_UINT64_MAX);
+  pg_atomic_init_u64(&hist->max_us, 0);
+}
+
+static inline void smgr_stats_atomic_hist_record(SmgrStatsAtomicHist* hist, uint64 value_us, uint32 weight) {
+  pg_atomic_fetch_add_u64(&hist->bins[smgr_stats_hist_bin(value_us)], weight);
+  pg_atomic_fetch_add_u64(&hist->count, weight);
+  pg_atomic_fetch_add_u64(&hist->total_us, value_us * weight);
+  smgr_stats_atomic_min_u64(&hist->min_us, value_us);
+  pg_atomic_monotonic_advance_u64(&hist->max_us, value_us);
+}
+
+/* Add a local histogram into a shared one. */
+static inline void smgr_stats_atomic_hist_add(SmgrStatsAtomicHist* dst, const SmgrStatsTimingHist* src) {
+  if (src->count == 0) {
+    return;
+  }
+  for (int i = 0; i < SMGR_STATS_HIST_BINS; i++) {
+    if (src->bins[i] > 0) {
+      pg_atomic_fetch_add_u64(&dst->bins[i], src->bins[i]);
+    }
+  }
+  pg_atomic_fetch_add_u64(&dst->count, src->count);
+  pg_atomic_fetch_add_u64(&dst->total_us, src->total_us);
+  smgr_stats_atomic_min_u64(&dst->min_us, src->min_us);
+  pg_atomic_monotonic_advance_u64(&dst->max_us, src->max_us);
+}
+
+/* Copy a shared histogram out, optionally resetting it. Concurrent records land in either period. */
+static inline void smgr_stats_atomic_hist_read(SmgrStatsAtomicHist* hist, SmgrStatsTimingHist* out, bool reset) {
+  for (int i = 0; i < SMGR_STATS_HIST_BINS; i++) {
+    out->bins[i] = reset ? pg_atomic_exchange_u64(&hist->bins[i], 0) : pg_atomic_read_u64(&hist->bins[i]);
+  }
+  out->count = reset ? pg_atomic_exchange_u64(&hist->count, 0) : pg_atomic_read_u64(&hist->count);
+  out->total_us = reset ? pg_atomic_exchange_u64(&hist->total_us, 0) : pg_atomic_read_u64(&hist->total_us);
+  out->min_us = reset ? pg_atomic_exchange_u64(&hist->min_us, PG_UINT64_MAX) : pg_atomic_read_u64(&hist->min_us);
+  out->max_us = reset ? pg_atomic_exchange_u64(&hist->max_us, 0) : pg_atomic_read_u64(&hist->max_us);
+}
+
 /* Convert a histogram to a SQL bigint[] Datum. */
 extern Datum smgr_stats_hist_to_array_datum(const SmgrStatsTimingHist* hist);
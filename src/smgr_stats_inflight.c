@@ -0,0 +1,201 @@
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "miscadmin.h"
+#include "storage/aio.h"
+#include "storage/dsm_registry.h"
+#include "storage/ipc.h"
+#include "storage/proc.h"
+
+#include "smgr_stats_clock.h"
+#include "smgr_stats_inflight.h"
+
+/* Copies of a slot that changed underneath the reader this many times are skipped */
+#define SMGR_STATS_INFLIGHT_READ_ATTEMPTS 100
+
+typedef struct SmgrStatsInflightSlot {
+  uint32 changecount; /* Odd while the owner is writing */
+  bool in_use;
+  SmgrStatsInflightIO io;
+} SmgrStatsInflightSlot;
+
+typedef struct SmgrStatsInflightTable {
+  int nprocs;
+  int slots_per_proc; /* Slot 0 for synchronous I/O, the others for async reads */
+  SmgrStatsInflightSlot slots[FLEXIBLE_ARRAY_MEMBER];
+} SmgrStatsInflightTable;
+
+static SmgrStatsInflightTable* inflight_table = NULL;
+
+/* This process's row, once cleared of a previous owner's leftovers and its callbacks registered */
+static SmgrStatsInflightSlot* my_row = NULL;
+
+static inline int inflight_nprocs(void) { return MaxBackends + NUM_AUXILIARY_PROCS; }
+
+static inline int inflight_slots_per_proc(void) { return 1 + Max(io_max_concurrency, 1); }
+
+static Size inflight_table_size(void) {
+  return add_size(offsetof(SmgrStatsInflightTable, slots),
+                  mul_size(sizeof(SmgrStatsInflightSlot), mul_size(inflight_nprocs(), inflight_slots_per_proc())));
+}
+
+static void inflight_table_init(void* ptr, void* arg) {
+  (void)arg;
+  SmgrStatsInflightTable* t = ptr;
+  t->nprocs = inflight_nprocs();
+  t->slots_per_proc = inflight_slots_per_proc();
+  memset(t->slots, 0, sizeof(SmgrStatsInflightSlot) * t->nprocs * t->slots_per_proc);
+}
+
+static SmgrStatsInflightTable* get_inflight_table(void) {
+  if (!inflight_table) {
+    bool found;
+    inflight_table = GetNamedDSMSegment("pg_smgrstat_inflight", inflight_table_size(), inflight_table_init, &found,
+                                        NULL);
+  }
+  return inflight_table;
+}
+
+static inline void slot_write_begin(volatile SmgrStatsInflightSlot* slot) {
+  slot->changecount++;
+  pg_write_barrier();
+}
+
+static inline void slot_write_end(volatile SmgrStatsInflightSlot* slot) {
+  pg_write_barrier();
+  slot->changecount++;
+}
+
+static void slot_clear(volatile SmgrStatsInflightSlot* slot) {
+  if (!slot->in_use) {
+    return;
+  }
+  slot_write_begin(slot);
+  slot->in_use = false;
+  slot_write_end(slot);
+}
+
+static void inflight_before_shmem_exit(int code, Datum arg) {
+  (void)code;
+  (void)arg;
+  for (int i = 0; i < inflight_table->slots_per_proc; i++) {
+    slot_clear(&my_row[i]);
+  }
+  my_row = NULL;
+}
+
+/* A synchronous call that errored out never reached its end */
+static void inflight_xact_callback(XactEvent event, void* arg) {
+  (void)arg;
+  if (event == XACT_EVENT_ABORT || event == XACT_EVENT_PARALLEL_ABORT) {
+    smgr_stats_inflight_end(0);
+  }
+}
+
+/* This process's row, claimed on first use. NULL if it has none, or can't claim it in a critical section. */
+static SmgrStatsInflightSlot* claim_row(void) {
+  if (likely(my_row)) {
+    return my_row;
+  }
+  if (CritSectionCount > 0 || MyProcNumber == INVALID_PROC_NUMBER) {
+    return NULL;
+  }
+  SmgrStatsInflightTable* t = get_inflight_table();
+  if (MyProcNumber >= t->nprocs) {
+    return NULL;
+  }
+  SmgrStatsInflightSlot* row = &t->slots[MyProcNumber * t->slots_per_proc];
+  for (int i = 0; i < t->slots_per_proc; i++) {
+    slot_clear(&row[i]); /* Left by a process that had this proc number and died */
+  }
+  before_shmem_exit(inflight_before_shmem_exit, (Datum)0);
+  RegisterXactCallback(inflight_xact_callback, NULL);
+  my_row = row;
+  return my_row;
+}
+
+int smgr_stats_inflight_begin(SmgrStatsInflightOp op, const RelFileLocator* locator, ForkNumber forknum,
+                              BlockNumber blocknum, BlockNumber nblocks, int io_id) {
+  SmgrStatsInflightSlot* row = claim_row();
+  if (!row) {
+    return -1;
+  }
+
+  int slot = 0;
+  if (io_id >= 0) {
+    for (slot = 1; slot < inflight_table->slots_per_proc && row[slot].in_use; slot++) {
+    }
+    if (slot == inflight_table->slots_per_proc) {
+      return -1;
+    }
+  }
+
+  volatile SmgrStatsInflightSlot* s = &row[slot];
+  slot_write_begin(s);
+  s->in_use = true;
+  s->io.pid = MyProcPid;
+  s->io.op = op;
+  s->io.locator = *locator;
+  s->io.forknum = forknum;
+  s->io.blocknum = blocknum;
+  s->io.nblocks = nblocks;
+  s->io.io_id = io_id;
+  s->io.started_at = smgr_stats_clock_now();
+  slot_write_end(s);
+  return slot;
+}
+
+void smgr_stats_inflight_end(int slot) {
+  if (slot < 0 || !my_row) {
+    return;
+  }
+  slot_clear(&my_row[slot]);
+}
+
+SmgrStatsInflightIO* smgr_stats_inflight_snapshot(int* count) {
+  SmgrStatsInflightTable* t = get_inflight_table();
+  int capacity = 64;
+  SmgrStatsInflightIO* result = palloc(sizeof(SmgrStatsInflightIO) * capacity);
+
+  *count = 0;
+  for (int i = 0; i < t->nprocs * t->slots_per_proc; i++) {
+    volatile SmgrStatsInflightSlot* slot = &t->slots[i];
+    for (int attempt = 0; attempt < SMGR_STATS_INFLIGHT_READ_ATTEMPTS; attempt++) {
+      uint32 before = slot->changecount;
+      pg_read_barrier();
+      bool in_use = slot->in_use;
+      SmgrStatsInflightIO io = *(SmgrStatsInflightIO*)&slot->io;
+      pg_read_barrier();
+      if (slot->changecount != before || (before & 1) != 0) {
+        continue; /* The owner was writing it */
+      }
+      if (in_use) {
+        if (*count == capacity) {
+          capacity *= 2;
+          result = repalloc(result, sizeof(SmgrStatsInflightIO) * capacity);
+        }
+        result[(*count)++] = io;
+      }
+      break;
+    }
+  }
+  return result;
+}
+
+const char* smgr_stats_inflight_op_name(SmgrStatsInflightOp op) {
+  switch (op) {
+    case SMGR_STATS_INFLIGHT_READ:
+      return "read";
+    case SMGR_STATS_INFLIGHT_WRITE:
+      return "write";
+    case SMGR_STATS_INFLIGHT_EXTEND:
+      return "extend";
+    case SMGR_STATS_INFLIGHT_ZEROEXTEND:
+      return "zeroextend";
+    case SMGR_STATS_INFLIGHT_TRUNCATE:
+      return "truncate";
+    case SMGR_STATS_INFLIGHT_FSYNC:
+      return "fsync";
+  }
+  return "unknown";
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "common/relpath.h"
+#include "storage/block.h"
+#include "storage/relfilelocator.h"
+#include "utils/timestamp.h"
+
+/*
+ * Live view of the I/Os in flight (smgr_stats.in_flight()), the I/O
+ * counterpart of pg_stat_activity.
+ *
+ * Every process owns a row of slots in a named DSM segment, indexed by its
+ * proc number: slot 0 for its synchronous call (readv, writev, extend, ...)
+ * and one per async read it can have in flight (io_max_concurrency). Only the
+ * owner writes its slots, bracketing each update with a change count like
+ * PgBackendStatus, so readers copy a slot without locks and retry if it
+ * changed underneath them. A synchronous call that errors out leaves its slot
+ * behind until the owner's next call, its transaction's abort or its exit.
+ */
+
+typedef enum SmgrStatsInflightOp {
+  SMGR_STATS_INFLIGHT_READ,
+  SMGR_STATS_INFLIGHT_WRITE,
+  SMGR_STATS_INFLIGHT_EXTEND,
+  SMGR_STATS_INFLIGHT_ZEROEXTEND,
+  SMGR_STATS_INFLIGHT_TRUNCATE,
+  SMGR_STATS_INFLIGHT_FSYNC,
+} SmgrStatsInflightOp;
+
+typedef struct SmgrStatsInflightIO {
+  int pid;
+  SmgrStatsInflightOp op;
+  RelFileLocator locator;
+  ForkNumber forknum;
+  BlockNumber blocknum; /* InvalidBlockNumber if the op has no block range */
+  BlockNumber nblocks;
+  int io_id; /* AIO handle id, -1 for synchronous I/O */
+  TimestampTz started_at;
+} SmgrStatsInflightIO;
+
+/* Publish an I/O about to start; io_id is the AIO handle id for an async read, -1 otherwise.
+ * Returns the slot to pass to smgr_stats_inflight_end, or -1 if it can't be shown. */
+extern int smgr_stats_inflight_begin(SmgrStatsInflightOp op, const RelFileLocator* locator, ForkNumber forknum,
+                                     BlockNumber blocknum, BlockNumber nblocks, int io_id);
+
+/* The I/O in slot ended. No-op for -1. Safe in critical sections. */
+extern void smgr_stats_inflight_end(int slot);
+
+/* Consistent copies of all in-flight I/Os. Returns a palloc'd array and sets *count. */
+extern SmgrStatsInflightIO* smgr_stats_inflight_snapshot(int* count);
+
+/* Name of an op, as shown by smgr_stats.in_flight() */
+extern const char* smgr_stats_inflight_op_name(SmgrStatsInflightOp op);
@@ -0,0 +1,204 @@
+#include "postgres.h"
+
+#include "executor/spi.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/dsm_registry.h"
+#include "storage/latch.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+#include "utils/wait_event.h"
+
+#include "smgr_stats_clock.h"
+#include "smgr_stats_limit.h"
+#include "smgr_stats_store.h"
+#include "smgr_stats_worker.h"
+
+/* Buckets hold at most this many seconds' worth of tokens */
+#define SMGR_STATS_LIMIT_BURST_SECONDS 1.0
+
+typedef struct SmgrStatsIoLimit {
+  Oid spcoid;            /* InvalidOid matches any tablespace */
+  Oid dboid;             /* InvalidOid matches any database */
+  Oid reloid;            /* InvalidOid matches any relation */
+  uint32 iops;           /* 0 = no ops limit */
+  uint32 blocks_per_sec; /* 0 = no blocks limit */
+  slock_t mutex;         /* Protects the bucket state below */
+  double op_tokens;      /* May go negative: debt paid back by sleeping */
+  double block_tokens;
+  TimestampTz refilled_at;
+} SmgrStatsIoLimit;
+
+typedef struct SmgrStatsLimitControl {
+  pg_atomic_uint32 count; /* Limits in effect; 0 while they are being replaced */
+  bool by_relation;       /* Some limit has a reloid */
+  slock_t load_mutex;     /* Serializes loads */
+  SmgrStatsIoLimit limits[SMGR_STATS_MAX_IO_LIMITS];
+} SmgrStatsLimitControl;
+
+static SmgrStatsLimitControl* limit_control = NULL;
+
+static void limit_control_init(void* ptr, void* arg) {
+  (void)arg;
+  SmgrStatsLimitControl* ctl = ptr;
+  memset(ctl, 0, sizeof(SmgrStatsLimitControl));
+  pg_atomic_init_u32(&ctl->count, 0);
+  SpinLockInit(&ctl->load_mutex);
+  for (int i = 0; i < SMGR_STATS_MAX_IO_LIMITS; i++) {
+    SpinLockInit(&ctl->limits[i].mutex);
+  }
+}
+
+static SmgrStatsLimitControl* get_limit_control(void) {
+  if (!limit_control) {
+    bool found;
+    limit_control =
+        GetNamedDSMSegment("pg_smgrstat_limits", sizeof(SmgrStatsLimitControl), limit_control_init, &found, NULL);
+  }
+  return limit_control;
+}
+
+bool smgr_stats_limits_active(void) {
+  if (smgr_stats_am_collector || CritSectionCount > 0) {
+    return false;
+  }
+  if (MyBackendType != B_BACKEND && MyBackendType != B_AUTOVAC_WORKER && MyBackendType != B_BG_WORKER) {
+    return false;
+  }
+  return pg_atomic_read_u32(&get_limit_control()->count) > 0;
+}
+
+bool smgr_stats_limits_by_relation(void) { return get_limit_control()->by_relation; }
+
+static inline bool limit_matches(const SmgrStatsIoLimit* limit, const RelFileLocator* locator, Oid reloid) {
+  return (limit->spcoid == InvalidOid || limit->spcoid == locator->spcOid) &&
+         (limit->dboid == InvalidOid || limit->dboid == locator->dbOid) &&
+         (limit->reloid == InvalidOid || limit->reloid == reloid);
+}
+
+/* Refill one dimension of a bucket and take `cost` from it. Returns the wait in seconds (0 if not in debt). */
+static inline double take_tokens(double* tokens, uint32 rate, double elapsed_s, double cost) {
+  if (rate == 0) {
+    return 0.0;
+  }
+  *tokens = Min(*tokens + elapsed_s * rate, rate * SMGR_STATS_LIMIT_BURST_SECONDS) - cost;
+  return *tokens < 0 ? -*tokens / rate : 0.0;
+}
+
+uint64 smgr_stats_throttle(const RelFileLocator* locator, Oid reloid, BlockNumber nblocks) {
+  SmgrStatsLimitControl* ctl = get_limit_control();
+  uint32 count = pg_atomic_read_u32(&ctl->count);
+  pg_read_barrier();
+
+  TimestampTz now = smgr_stats_clock_now();
+  double wait_s = 0.0;
+  for (uint32 i = 0; i < count; i++) {
+    SmgrStatsIoLimit* limit = &ctl->limits[i];
+    if (!limit_matches(limit, locator, reloid)) {
+      continue;
+    }
+    SpinLockAcquire(&limit->mutex);
+    double elapsed_s = now > limit->refilled_at ? (double)(now - limit->refilled_at) / USECS_PER_SEC : 0.0;
+    limit->refilled_at = Max(limit->refilled_at, now);
+    double op_wait = take_tokens(&limit->op_tokens, limit->iops, elapsed_s, 1.0);
+    double block_wait = take_tokens(&limit->block_tokens, limit->blocks_per_sec, elapsed_s, (double)nblocks);
+    SpinLockRelease(&limit->mutex);
+    wait_s = Max(wait_s, Max(op_wait, block_wait));
+  }
+
+  if (wait_s <= 0.0) {
+    return 0;
+  }
+  uint64 wait_us = (uint64)Min(wait_s * USECS_PER_SEC, (double)SMGR_STATS_MAX_THROTTLE_US);
+  if (wait_us == 0) {
+    return 0;
+  }
+  if (!INTERRUPTS_CAN_BE_PROCESSED()) {
+    /* A write flushed under its buffer's content lock: the debt stays in the buckets for the next op */
+    return 0;
+  }
+
+  /* Interruptible, so a cancel or a statement_timeout doesn't wait for the debt to be paid */
+  TimestampTz deadline = GetCurrentTimestamp() + (TimestampTz)wait_us;
+  for (;;) {
+    long remaining_ms = (long)((deadline - GetCurrentTimestamp() + 999) / 1000);
+    if (remaining_ms <= 0) {
+      break;
+    }
+    (void)WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, remaining_ms, PG_WAIT_EXTENSION);
+    ResetLatch(MyLatch);
+    CHECK_FOR_INTERRUPTS();
+  }
+
+  smgr_stats_counter_add(SMGR_STATS_COUNTER_THROTTLED_OPS, 1);
+  smgr_stats_counter_add(SMGR_STATS_COUNTER_THROTTLE_DELAY_US, wait_us);
+  return wait_us;
+}
+
+static inline bool same_limit(const SmgrStatsIoLimit* a, const SmgrStatsIoLimit* b) {
+  return a->spcoid == b->spcoid && a->dboid == b->dboid && a->reloid == b->reloid && a->iops == b->iops &&
+         a->blocks_per_sec == b->blocks_per_sec;
+}
+
+int smgr_stats_load_io_limits(void) {
+  SPI_execute(
+      "SELECT coalesce(spcoid, 0), coalesce(dboid, 0), coalesce(reloid, 0),"
+      " coalesce(iops, 0), coalesce(blocks_per_sec, 0) "
+      "FROM smgr_stats.io_limits ORDER BY spcoid, dboid, reloid",
+      true, 0);
+
+  uint64 rows = SPI_processed;
+  if (rows > SMGR_STATS_MAX_IO_LIMITS) {
+    ereport(WARNING, (errmsg("pg_smgrstat: only the first %d of %lu I/O limits are enforced", SMGR_STATS_MAX_IO_LIMITS,
+                             (unsigned long)rows)));
+    rows = SMGR_STATS_MAX_IO_LIMITS;
+  }
+
+  SmgrStatsIoLimit loaded[SMGR_STATS_MAX_IO_LIMITS];
+  for (uint64 i = 0; i < rows; i++) {
+    HeapTuple tuple = SPI_tuptable->vals[i];
+    TupleDesc desc = SPI_tuptable->tupdesc;
+    bool isnull;
+    loaded[i] = (SmgrStatsIoLimit){
+        .spcoid = DatumGetObjectId(SPI_getbinval(tuple, desc, 1, &isnull)),
+        .dboid = DatumGetObjectId(SPI_getbinval(tuple, desc, 2, &isnull)),
+        .reloid = DatumGetObjectId(SPI_getbinval(tuple, desc, 3, &isnull)),
+        .iops = (uint32)DatumGetInt32(SPI_getbinval(tuple, desc, 4, &isnull)),
+        .blocks_per_sec = (uint32)DatumGetInt32(SPI_getbinval(tuple, desc, 5, &isnull)),
+    };
+  }
+
+  SmgrStatsLimitControl* ctl = get_limit_control();
+  SpinLockAcquire(&ctl->load_mutex);
+  bool changed = rows != pg_atomic_read_u32(&ctl->count);
+  for (uint64 i = 0; i < rows && !changed; i++) {
+    changed = !same_limit(&ctl->limits[i], &loaded[i]);
+  }
+  if (changed) {
+    /* Any change replaces all limits, and their buckets start full */
+    pg_atomic_write_u32(&ctl->count, 0);
+    pg_write_barrier();
+    TimestampTz now = smgr_stats_clock_now();
+    bool by_relation = false;
+    for (uint64 i = 0; i < rows; i++) {
+      SmgrStatsIoLimit* limit = &ctl->limits[i];
+      SpinLockAcquire(&limit->mutex);
+      limit->spcoid = loaded[i].spcoid;
+      limit->dboid = loaded[i].dboid;
+      limit->reloid = loaded[i].reloid;
+      limit->iops = loaded[i].iops;
+      limit->blocks_per_sec = loaded[i].blocks_per_sec;
+      limit->op_tokens = limit->iops * SMGR_STATS_LIMIT_BURST_SECONDS;
+      limit->block_tokens = limit->blocks_per_sec * SMGR_STATS_LIMIT_BURST_SECONDS;
+      limit->refilled_at = now;
+      SpinLockRelease(&limit->mutex);
+      by_relation |= limit->reloid != InvalidOid;
+    }
+    ctl->by_relation = by_relation;
+    pg_write_barrier();
+    pg_atomic_write_u32(&ctl->count, (uint32)rows);
+  }
+  SpinLockRelease(&ctl->load_mutex);
+
+  return (int)rows;
+}
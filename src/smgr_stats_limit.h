@@ -0,0 +1,50 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "storage/block.h"
+#include "storage/relfilelocator.h"
+
+/*
+ * I/O rate limits (smgr_stats.io_limits).
+ *
+ * Each row of the table is a token bucket for ops per second and/or blocks
+ * per second, scoped to a tablespace, a database, a relation or any mix of
+ * them (NULL matches anything). The collector copies the table into a fixed
+ * array in shared memory once per collection interval (an SPI query run
+ * every cycle, even when the table is empty), or at once on
+ * smgr_stats.reload_io_limits(). Buckets hold at most one second's worth of
+ * tokens.
+ *
+ * Reads and writes of regular backends, autovacuum and background workers
+ * (but not the collector) take tokens from every bucket they match before
+ * the I/O is issued; a bucket may go into debt, and the op waits on its latch
+ * until the deepest one is paid back, at most one second per op. The wait is
+ * interruptible, but the op's buffers are already marked I/O-in-progress, so
+ * other backends that need the same blocks wait along with it. Ops that can't
+ * process interrupts (critical sections, writes flushed under a buffer
+ * content lock) are charged but never delayed; the next op that can wait
+ * pays their debt. Relation limits match the pg_class OID recorded in the
+ * relation's stats entry, so they take effect once its metadata is resolved,
+ * and a partitioned root's limit covers the leaves aggregated into it.
+ */
+
+/* Most rows of smgr_stats.io_limits that are enforced */
+#define SMGR_STATS_MAX_IO_LIMITS 64
+
+/* Waits longer than this per op are cut short */
+#define SMGR_STATS_MAX_THROTTLE_US 1000000
+
+/* True if any limit is loaded and this process may be throttled. Cheap enough for every op. */
+extern bool smgr_stats_limits_active(void);
+
+/* True if some loaded limit is scoped to a relation, so callers need to pass its reloid. */
+extern bool smgr_stats_limits_by_relation(void);
+
+/* Take tokens for one op of nblocks on locator (reloid may be InvalidOid if unknown) and wait as
+ * long as the matching buckets require, if interrupts can be processed. Returns the delay in microseconds. */
+extern uint64 smgr_stats_throttle(const RelFileLocator* locator, Oid reloid, BlockNumber nblocks);
+
+/* Read smgr_stats.io_limits and install it if it changed. SPI must be connected.
+ * Returns the number of limits in effect. */
+extern int smgr_stats_load_io_limits(void);
@@ -1,23 +1,51 @@
 #include "postgres.h"
 
+#include "common/hashfn.h"
 #include "datatype/timestamp.h"
-#include "portability/instr_time.h"
+#include "port/pg_bitutils.h"
 #include "storage/aio.h"
+#include "storage/fd.h"
 #include "storage/smgr.h"
+#include "utils/backend_status.h"
 #include "utils/injection_point.h"
 #include "utils/memutils.h"
 
+#include "smgr_stats_aio.h"
+#include "smgr_stats_clock.h"
+#include "smgr_stats_filter.h"
 #include "smgr_stats_guc.h"
+#include "smgr_stats_handle.h"
+#include "smgr_stats_inflight.h"
+#include "smgr_stats_limit.h"
 #include "smgr_stats_link.h"
 #include "smgr_stats_metadata.h"
+#include "smgr_stats_partition.h"
+#include "smgr_stats_pending.h"
+#include "smgr_stats_query.h"
 #include "smgr_stats_seq.h"
+#include "smgr_stats_slow_io.h"
 #include "smgr_stats_store.h"
+#include "smgr_stats_tablespace.h"
+#include "smgr_stats_worker.h"
 
 /*
- * Determine the tracking key for an I/O operation, handling temp table modes.
- * Returns false if this operation should not be tracked (temp table with mode=off).
+ * Determine the tracking key for an I/O operation, handling the collector, temp table and
+ * partition aggregation modes. Returns false if this operation should not be tracked (tracking disabled,
+ * filtered out, or temp table with mode=off). Checked before any timing, so
+ * untracked I/O costs only these few tests.
  */
 static inline bool smgr_stats_determine_key(SMgrRelation reln, ForkNumber forknum, SmgrStatsKey* key_out) {
+  if (unlikely(!smgr_stats_enabled)) {
+    return false;
+  }
+  if (unlikely(smgr_stats_am_collector)) {
+    /* Catalog reads, history inserts, retention: the extension's own footprint, kept out of the relations' stats */
+    *key_out = smgr_stats_collector_key();
+    return true;
+  }
+  if (!smgr_stats_filter_file(&reln->smgr_rlocator.locator, forknum)) {
+    return false;
+  }
   if (SmgrIsTemp(reln)) {
     switch ((SmgrStatsTempTracking)smgr_stats_track_temp_tables) {
       case SMGR_STATS_TEMP_OFF:
@@ -26,10 +54,17 @@ static inline bool smgr_stats_determine_key(SMgrRelation reln, ForkNumber forknu
         break; /* Use real key below */
       case SMGR_STATS_TEMP_AGGREGATE:
         *key_out = smgr_stats_temp_aggregate_key(reln->smgr_rlocator.locator.dbOid);
+        key_out->backend_type = smgr_stats_key_backend_type();
         return true;
     }
   }
-  *key_out = (SmgrStatsKey){.locator = reln->smgr_rlocator.locator, .forknum = forknum};
+  /* With fold_forks, FSM/VM/init I/O lands in the main-fork entry (per-fork counters kept there) */
+  *key_out = (SmgrStatsKey){.locator = reln->smgr_rlocator.locator,
+                            .forknum = smgr_stats_fold_forks ? MAIN_FORKNUM : forknum,
+                            .backend_type = smgr_stats_key_backend_type()};
+  if (unlikely(smgr_stats_track_partitions == SMGR_STATS_PARTITIONS_AGGREGATE)) {
+    smgr_stats_partition_map_key(key_out);
+  }
   return true;
 }
 
@@ -45,313 +80,1057 @@ static inline void smgr_stats_update_activity(SmgrStatsEntry* entry, TimestampTz
   }
 }
 
-static inline void smgr_stats_record_burstiness(SmgrStatsBurstiness* burst, TimestampTz now) {
+/* With sampled timing only timed ops take part, and the gap between two of them spans
+ * about `weight` ops, so it is scaled down accordingly. */
+static inline void smgr_stats_record_burstiness(SmgrStatsBurstiness* burst, TimestampTz now, uint32 weight) {
   if (burst->last_op_time != 0) {
     double iat_us = (double)(now - burst->last_op_time);
-    smgr_stats_welford_record(&burst->iat, iat_us);
+    smgr_stats_welford_record(&burst->iat, iat_us / weight);
   }
   burst->last_op_time = now;
 }
 
+typedef enum SmgrStatsOpKind {
+  SMGR_STATS_OP_READ,
+  SMGR_STATS_OP_WRITE,
+  SMGR_STATS_OP_EXTEND,
+  SMGR_STATS_OP_TRUNCATE,
+  SMGR_STATS_OP_FSYNC,
+  SMGR_STATS_OP_META,
+} SmgrStatsOpKind;
+
+/* One observed SMGR operation. Applied to a pending (backend-local) or a shared entry. */
+typedef struct SmgrStatsOp {
+  SmgrStatsOpKind kind;
+  BlockNumber nblocks;
+  SmgrStatsSeqResult seq; /* READ/WRITE only */
+  uint32 timing_weight;   /* Ops this timing sample stands for, 0 if not timed */
+  uint64 elapsed_us;      /* Only if timing_weight > 0 */
+  uint64 throttle_us;     /* READ/WRITE: time held back by smgr_stats.io_limits before the I/O */
+  bool aio_phases;        /* READ: timed async read with every phase stamped */
+  uint64 aio_phase_us[SMGR_STATS_NUM_AIO_PHASES];
+  bool zeroed;            /* EXTEND: zeroextend rather than extend */
+  SmgrStatsMetaOp meta;   /* META only */
+  TimestampTz now;
+  bool folded;     /* Recorded into the main-fork entry on behalf of `fork` */
+  ForkNumber fork; /* Only if folded */
+} SmgrStatsOp;
+
+/* Ops since the last timed one (per backend), for smgr_stats.timing_sample_rate. Metadata ops
+ * are sampled on their own, so a call pattern like nblocks-read-nblocks-read can't starve reads. */
+static uint32 ops_since_timed = 0;
+static uint32 meta_ops_since_timed = 0;
+
+static inline uint32 smgr_stats_sample_weight(uint32* since_timed) {
+  uint32 rate = (uint32)smgr_stats_timing_sample_rate;
+  if (rate <= 1) {
+    return 1;
+  }
+  if (++*since_timed < rate) {
+    return 0;
+  }
+  *since_timed = 0;
+  return rate;
+}
+
+/* Decide whether to time this data op. Returns its weight, or 0 to skip timing. */
+static inline uint32 smgr_stats_timing_weight(void) { return smgr_stats_sample_weight(&ops_since_timed); }
+
+/* Same for a metadata op (nblocks, exists, ...) */
+static inline uint32 smgr_stats_meta_timing_weight(void) { return smgr_stats_sample_weight(&meta_ops_since_timed); }
+
+static inline void smgr_stats_apply_op(SmgrStatsEntry* entry, const SmgrStatsOp* op) {
+  switch (op->kind) {
+    case SMGR_STATS_OP_READ:
+      entry->reads++;
+      entry->read_blocks += op->nblocks;
+      entry->sizes.reads[smgr_stats_size_bin(op->nblocks)]++;
+      if (op->folded) {
+        entry->forks.reads[op->fork]++;
+      }
+      if (op->seq.is_sequential) {
+        entry->sequential_reads++;
+      } else {
+        entry->random_reads++;
+      }
+      if (op->seq.completed_run > 0) {
+        smgr_stats_welford_record(&entry->read_runs, (double)op->seq.completed_run);
+      }
+      if (op->timing_weight > 0) {
+        smgr_stats_hist_record(&entry->read_timing, op->elapsed_us, op->timing_weight);
+        smgr_stats_record_burstiness(&entry->read_burst, op->now, op->timing_weight);
+        entry->timing_sample_rate = Max(entry->timing_sample_rate, op->timing_weight);
+      }
+      if (op->throttle_us > 0) {
+        smgr_stats_hist_record(&entry->throttle_timing, op->throttle_us, 1);
+      }
+      if (op->aio_phases) {
+        for (int p = 0; p < SMGR_STATS_NUM_AIO_PHASES; p++) {
+          smgr_stats_hist_record(&entry->aio_phase_timing[p], op->aio_phase_us[p], op->timing_weight);
+        }
+      }
+      break;
+    case SMGR_STATS_OP_WRITE:
+      entry->writes++;
+      entry->write_blocks += op->nblocks;
+      entry->sizes.writes[smgr_stats_size_bin(op->nblocks)]++;
+      if (op->folded) {
+        entry->forks.writes[op->fork]++;
+      }
+      if (op->seq.is_sequential) {
+        entry->sequential_writes++;
+      } else {
+        entry->random_writes++;
+      }
+      if (op->seq.completed_run > 0) {
+        smgr_stats_welford_record(&entry->write_runs, (double)op->seq.completed_run);
+      }
+      if (op->timing_weight > 0) {
+        smgr_stats_hist_record(&entry->write_timing, op->elapsed_us, op->timing_weight);
+        smgr_stats_record_burstiness(&entry->write_burst, op->now, op->timing_weight);
+        entry->timing_sample_rate = Max(entry->timing_sample_rate, op->timing_weight);
+      }
+      if (op->throttle_us > 0) {
+        smgr_stats_hist_record(&entry->throttle_timing, op->throttle_us, 1);
+      }
+      break;
+    case SMGR_STATS_OP_EXTEND:
+      entry->extends++;
+      entry->extend_blocks += op->nblocks;
+      if (op->zeroed) {
+        entry->sizes.zeroextends[smgr_stats_size_bin(op->nblocks)]++;
+      }
+      if (op->folded) {
+        entry->forks.extends[op->fork]++;
+      }
+      if (op->timing_weight > 0) {
+        smgr_stats_hist_record(op->zeroed ? &entry->zeroextend_timing : &entry->extend_timing, op->elapsed_us,
+                               op->timing_weight);
+        entry->timing_sample_rate = Max(entry->timing_sample_rate, op->timing_weight);
+      }
+      break;
+    case SMGR_STATS_OP_TRUNCATE:
+      entry->truncates++;
+      entry->truncated_blocks += op->nblocks;
+      smgr_stats_hist_record(&entry->truncate_timing, op->elapsed_us, 1);
+      break;
+    case SMGR_STATS_OP_FSYNC:
+      entry->fsyncs++;
+      smgr_stats_hist_record(&entry->fsync_timing, op->elapsed_us, 1);
+      break;
+    case SMGR_STATS_OP_META:
+      entry->meta_ops.calls[op->meta]++;
+      entry->meta_ops.blocks[op->meta] += op->nblocks;
+      entry->meta_ops.time_us[op->meta] += op->elapsed_us * op->timing_weight;
+      break;
+  }
+  smgr_stats_update_activity(entry, op->now);
+}
+
+/* Same as smgr_stats_apply_op, on a pinned shared entry: counters and bins are atomic,
+ * only the Welford state takes this backend's shard spinlock. */
+static inline void smgr_stats_apply_op_shared(SmgrStatsSharedEntry* shared, const SmgrStatsOp* op) {
+  switch (op->kind) {
+    case SMGR_STATS_OP_READ: {
+      pg_atomic_fetch_add_u64(&shared->reads, 1);
+      pg_atomic_fetch_add_u64(&shared->read_blocks, op->nblocks);
+      pg_atomic_fetch_add_u64(&shared->sizes.reads[smgr_stats_size_bin(op->nblocks)], 1);
+      if (op->folded) {
+        pg_atomic_fetch_add_u64(&shared->forks.reads[op->fork], 1);
+      }
+      pg_atomic_fetch_add_u64(op->seq.is_sequential ? &shared->sequential_reads : &shared->random_reads, 1);
+      double iat_us = -1.0;
+      if (op->timing_weight > 0) {
+        smgr_stats_atomic_hist_record(&shared->read_timing, op->elapsed_us, op->timing_weight);
+        iat_us = smgr_stats_shared_swap_op_time(&shared->read_last_op_time, op->now);
+        pg_atomic_monotonic_advance_u64(&shared->timing_sample_rate, op->timing_weight);
+      }
+      if (op->throttle_us > 0) {
+        smgr_stats_atomic_hist_record(&shared->throttle_timing, op->throttle_us, 1);
+      }
+      if (op->aio_phases) {
+        for (int p = 0; p < SMGR_STATS_NUM_AIO_PHASES; p++) {
+          smgr_stats_atomic_hist_record(&shared->aio_phase_timing[p], op->aio_phase_us[p], op->timing_weight);
+        }
+      }
+      if (iat_us >= 0 || op->seq.completed_run > 0) {
+        SmgrStatsShard* shard = smgr_stats_lock_shard(shared);
+        if (iat_us >= 0) {
+          smgr_stats_welford_record(&shard->read_iat, iat_us / op->timing_weight);
+        }
+        if (op->seq.completed_run > 0) {
+          smgr_stats_welford_record(&shard->read_runs, (double)op->seq.completed_run);
+        }
+        smgr_stats_unlock_shard(shard);
+      }
+      break;
+    }
+    case SMGR_STATS_OP_WRITE: {
+      pg_atomic_fetch_add_u64(&shared->writes, 1);
+      pg_atomic_fetch_add_u64(&shared->write_blocks, op->nblocks);
+      pg_atomic_fetch_add_u64(&shared->sizes.writes[smgr_stats_size_bin(op->nblocks)], 1);
+      if (op->folded) {
+        pg_atomic_fetch_add_u64(&shared->forks.writes[op->fork], 1);
+      }
+      pg_atomic_fetch_add_u64(op->seq.is_sequential ? &shared->sequential_writes : &shared->random_writes, 1);
+      double iat_us = -1.0;
+      if (op->timing_weight > 0) {
+        smgr_stats_atomic_hist_record(&shared->write_timing, op->elapsed_us, op->timing_weight);
+        iat_us = smgr_stats_shared_swap_op_time(&shared->write_last_op_time, op->now);
+        pg_atomic_monotonic_advance_u64(&shared->timing_sample_rate, op->timing_weight);
+      }
+      if (op->throttle_us > 0) {
+        smgr_stats_atomic_hist_record(&shared->throttle_timing, op->throttle_us, 1);
+      }
+      if (iat_us >= 0 || op->seq.completed_run > 0) {
+        SmgrStatsShard* shard = smgr_stats_lock_shard(shared);
+        if (iat_us >= 0) {
+          smgr_stats_welford_record(&shard->write_iat, iat_us / op->timing_weight);
+        }
+        if (op->seq.completed_run > 0) {
+          smgr_stats_welford_record(&shard->write_runs, (double)op->seq.completed_run);
+        }
+        smgr_stats_unlock_shard(shard);
+      }
+      break;
+    }
+    case SMGR_STATS_OP_EXTEND:
+      pg_atomic_fetch_add_u64(&shared->extends, 1);
+      pg_atomic_fetch_add_u64(&shared->extend_blocks, op->nblocks);
+      if (op->zeroed) {
+        pg_atomic_fetch_add_u64(&shared->sizes.zeroextends[smgr_stats_size_bin(op->nblocks)], 1);
+      }
+      if (op->folded) {
+        pg_atomic_fetch_add_u64(&shared->forks.extends[op->fork], 1);
+      }
+      if (op->timing_weight > 0) {
+        smgr_stats_atomic_hist_record(op->zeroed ? &shared->zeroextend_timing : &shared->extend_timing,
+                                      op->elapsed_us, op->timing_weight);
+        pg_atomic_monotonic_advance_u64(&shared->timing_sample_rate, op->timing_weight);
+      }
+      break;
+    case SMGR_STATS_OP_TRUNCATE:
+      pg_atomic_fetch_add_u64(&shared->truncates, 1);
+      pg_atomic_fetch_add_u64(&shared->truncated_blocks, op->nblocks);
+      smgr_stats_atomic_hist_record(&shared->truncate_timing, op->elapsed_us, 1);
+      break;
+    case SMGR_STATS_OP_FSYNC:
+      pg_atomic_fetch_add_u64(&shared->fsyncs, 1);
+      smgr_stats_atomic_hist_record(&shared->fsync_timing, op->elapsed_us, 1);
+      break;
+    case SMGR_STATS_OP_META:
+      pg_atomic_fetch_add_u64(&shared->meta_ops.calls[op->meta], 1);
+      if (op->nblocks > 0) {
+        pg_atomic_fetch_add_u64(&shared->meta_ops.blocks[op->meta], op->nblocks);
+      }
+      if (op->timing_weight > 0) {
+        pg_atomic_fetch_add_u64(&shared->meta_ops.time_us[op->meta], op->elapsed_us * op->timing_weight);
+      }
+      break;
+  }
+  smgr_stats_shared_update_activity(shared, op->now);
+}
+
+/* Count a read, write or extend towards the statement that issued it (smgr_stats.query_top_n) */
+static inline void smgr_stats_attribute_query(int64 queryid, const SmgrStatsKey* key, const SmgrStatsOp* op) {
+  if (likely(smgr_stats_query_top_n == 0) || queryid == 0) {
+    return;
+  }
+  SmgrStatsQueryCounters delta = {0};
+  uint64 us = op->elapsed_us * op->timing_weight; /* Untimed ops count 0, timed ones stand for their weight */
+  switch (op->kind) {
+    case SMGR_STATS_OP_READ:
+      delta.reads = 1;
+      delta.read_blocks = op->nblocks;
+      delta.read_us = us;
+      break;
+    case SMGR_STATS_OP_WRITE:
+      delta.writes = 1;
+      delta.write_blocks = op->nblocks;
+      delta.write_us = us;
+      break;
+    case SMGR_STATS_OP_EXTEND:
+      delta.extends = 1;
+      delta.extend_blocks = op->nblocks;
+      break;
+    default:
+      return;
+  }
+  smgr_stats_query_record(queryid, key, &delta, op->now);
+}
+
+/*
+ * Ops in a critical section (a truncate in RelationTruncate, say) whose entry
+ * doesn't exist yet can't create it: that allocates. They are parked here and
+ * recorded by the next op outside a critical section.
+ */
+#define SMGR_STATS_PARKED_OPS 16
+
+typedef struct SmgrStatsParkedOp {
+  SmgrStatsKey key;
+  SmgrStatsOp op;
+} SmgrStatsParkedOp;
+
+static SmgrStatsParkedOp parked_ops[SMGR_STATS_PARKED_OPS];
+static int parked_ops_count = 0;
+
+/* Slow I/Os from critical sections, put into the ring along with the parked ops */
+static SmgrStatsSlowIO parked_slow_ios[SMGR_STATS_PARKED_OPS];
+static int parked_slow_ios_count = 0;
+
+static void smgr_stats_park_op(const SmgrStatsKey* key, const SmgrStatsOp* op) {
+  if (parked_ops_count == SMGR_STATS_PARKED_OPS) {
+    smgr_stats_counter_add(SMGR_STATS_COUNTER_PARKED_OPS_DROPPED, 1);
+    return;
+  }
+  parked_ops[parked_ops_count++] = (SmgrStatsParkedOp){.key = *key, .op = *op};
+}
+
+static void smgr_stats_record_parked(void) {
+  for (int i = 0; i < parked_ops_count; i++) {
+    SmgrStatsParkedOp* parked = &parked_ops[i];
+    if (smgr_stats_pending_active()) {
+      smgr_stats_apply_op(&smgr_stats_pending_get(&parked->key, true)->stats, &parked->op);
+      continue;
+    }
+    bool needs_metadata;
+    SmgrStatsSharedEntry* shared = smgr_stats_pin_entry(&parked->key, true, &needs_metadata);
+    if (needs_metadata && !smgr_stats_has_synthetic_metadata(&parked->key)) {
+      smgr_stats_add_pending_metadata(&parked->key);
+    }
+    if (!shared->meta.metadata_valid || smgr_stats_filter_relkind(shared->meta.relkind)) {
+      smgr_stats_apply_op_shared(shared, &parked->op);
+    }
+    smgr_stats_unpin_entry(shared);
+  }
+  parked_ops_count = 0;
+
+  for (int i = 0; i < parked_slow_ios_count; i++) {
+    smgr_stats_slow_io_record(&parked_slow_ios[i]);
+  }
+  parked_slow_ios_count = 0;
+}
+
+/* Record a synchronous operation, either into the backend-local pending entry or directly
+ * into the shared entry cached in the relation's handle. */
+static void smgr_stats_record(SMgrRelation reln, ForkNumber forknum, const SmgrStatsKey* key, SmgrStatsOp* op) {
+  op->folded = smgr_stats_fold_forks;
+  op->fork = forknum;
+  smgr_stats_attribute_query(pgstat_get_my_query_id(), key, op);
+
+  if (unlikely(CritSectionCount > 0)) {
+    /* Only entries that already exist can be used here */
+    SmgrStatsPendingEntry* pending = smgr_stats_pending_active() ? smgr_stats_pending_get(key, false) : NULL;
+    SmgrStatsSharedEntry* shared = pending ? NULL : smgr_stats_handle_get(reln, forknum, key);
+    if (pending) {
+      smgr_stats_apply_op(&pending->stats, op);
+    } else if (shared) {
+      smgr_stats_apply_op_shared(shared, op);
+    } else {
+      smgr_stats_park_op(key, op);
+    }
+    return;
+  }
+  if (unlikely(parked_ops_count > 0 || parked_slow_ios_count > 0)) {
+    smgr_stats_record_parked();
+  }
+
+  if (smgr_stats_pending_active()) {
+    SmgrStatsPendingEntry* pending = smgr_stats_pending_get(key, true);
+    smgr_stats_apply_op(&pending->stats, op);
+    smgr_stats_pending_maybe_flush(op->now);
+    return;
+  }
+
+  SmgrStatsSharedEntry* shared = smgr_stats_handle_get(reln, forknum, key);
+  if (!shared) {
+    return; /* Filtered out by relkind, or backend exiting */
+  }
+  smgr_stats_apply_op_shared(shared, op);
+}
+
+/* Record an I/O that took at least smgr_stats.slow_io_threshold in the slow I/O ring. In a critical section
+ * the record is parked instead, and put into the ring with the next recorded op. */
+static inline void smgr_stats_check_slow(SmgrStatsInflightOp kind, const RelFileLocator* locator, ForkNumber forknum,
+                                         BlockNumber blocknum, BlockNumber nblocks, SmgrStatsInstant start,
+                                         SmgrStatsInstant end) {
+  if (smgr_stats_slow_io_threshold < 0) {
+    return;
+  }
+  uint64 elapsed_us = smgr_stats_clock_elapsed_us(start, end);
+  if (elapsed_us < (uint64)smgr_stats_slow_io_threshold * 1000) {
+    return;
+  }
+  SmgrStatsSlowIO io = {
+      .op = kind,
+      .locator = *locator,
+      .forknum = forknum,
+      .blocknum = blocknum,
+      .nblocks = nblocks,
+      .elapsed_us = elapsed_us,
+      .pid = MyProcPid,
+      .backend_type = MyBackendType,
+      .completed_at = smgr_stats_clock_wall(end),
+  };
+  if (unlikely(CritSectionCount > 0)) {
+    if (parked_slow_ios_count < SMGR_STATS_PARKED_OPS) {
+      parked_slow_ios[parked_slow_ios_count++] = io;
+    } else {
+      smgr_stats_counter_add(SMGR_STATS_COUNTER_SLOW_IO_DROPPED, 1);
+    }
+    return;
+  }
+  smgr_stats_slow_io_record(&io);
+}
+
 static PgAioHandleCallbackID smgr_stats_aio_cb_id = PGAIO_HCB_INVALID;
 
-/* Per-AIO-slot state: populated at startreadv time, consumed at complete_local time. */
+/*
+ * The handle generation is only reachable through storage/aio_internal.h, and
+ * pgaio_io_get_wref() can't be called from the completion callbacks. Instead each
+ * tracked read gets a 7-bit sequence number from its backend, carried in the
+ * callback's cb_data next to the flag telling whether its phases are timed.
+ */
+#define AIO_CB_TIMED 0x01
+#define AIO_CB_SEQ(cb_data) ((uint8)((cb_data) >> 1))
+#define AIO_CB_DATA(seq, timed) ((uint8)(((seq) << 1) | ((timed) ? AIO_CB_TIMED : 0)))
+#define AIO_SEQ_MAX 127
+
+static uint8 aio_last_seq = 0;
+
+/* An async read of this backend in flight: populated at startreadv time, consumed at complete_local time. */
 typedef struct SmgrStatsAioSlot {
-  instr_time start_time;
+  bool in_use;
+  int io_id;                   /* pgaio_io_get_id() */
+  uint8 seq;                   /* Tells this read from an earlier one on the same handle, 1..AIO_SEQ_MAX */
+  SmgrStatsInstant start_time; /* Coarse unless timing_weight > 0 */
+  SmgrStatsInstant staged_at;  /* Set by the stage callback if timing_weight > 0 */
+  SmgrStatsTablespace* ts;     /* Counts the read as in flight until it completes */
+  int inflight;                /* Its smgr_stats.in_flight() slot, -1 if none */
+  uint32 timing_weight;
+  uint64 throttle_us;
+  int64 queryid; /* Of the statement that started the read; completion may run in another */
   SmgrStatsSeqResult seq_result;
   SmgrStatsKey tracking_key;
-  bool should_track;
+  ForkNumber fork;              /* Real fork, differs from the key's with fold_forks */
+  bool folded;
+  bool local;                   /* Recorded into the pending entry rather than the shared one */
+  SmgrStatsSharedEntry* shared; /* Pinned for the duration of the read, if !local */
 } SmgrStatsAioSlot;
 
+/*
+ * Open-addressing table of in-flight reads keyed exactly by (handle id,
+ * sequence number). Handle ids are global, so indexing by id modulo anything
+ * can alias; here a lookup either finds the read that was started or nothing.
+ * A slot left behind by an earlier read on the same handle (one that never
+ * reached complete_local) is released when the handle's next read is staged,
+ * and counted as a collision.
+ * Sized to twice io_max_concurrency, the most reads a backend can have in
+ * flight, and never allocates after the first read.
+ */
 static SmgrStatsAioSlot* aio_slots = NULL;
+static uint32 aio_slots_mask = 0;
+static uint32 aio_slots_used = 0;
+
+static inline uint32 aio_slot_home(int io_id) { return murmurhash32((uint32)io_id) & aio_slots_mask; }
+
+static int aio_slot_find(int io_id, uint8 seq) {
+  for (uint32 i = aio_slot_home(io_id); aio_slots[i].in_use; i = (i + 1) & aio_slots_mask) {
+    if (aio_slots[i].io_id == io_id && aio_slots[i].seq == seq) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+/* Drop the references a slot holds on its entry, tablespace and in-flight slot. Safe in critical sections. */
+static void aio_slot_release(SmgrStatsAioSlot* slot) {
+  smgr_stats_inflight_end(slot->inflight);
+  slot->inflight = -1;
+  if (slot->ts) {
+    smgr_stats_tablespace_io_end(slot->ts, slot->start_time, smgr_stats_clock_read_coarse());
+    slot->ts = NULL;
+  }
+  if (slot->shared) {
+    smgr_stats_unpin_entry(slot->shared);
+    slot->shared = NULL;
+  }
+  if (slot->local) {
+    SmgrStatsPendingEntry* pending = smgr_stats_pending_get(&slot->tracking_key, false);
+    if (pending) {
+      pending->aio_inflight--;
+    }
+  }
+}
+
+/* Delete by shifting later members of the probe chain back, so lookups never need tombstones. */
+static void aio_slot_remove(uint32 hole) {
+  for (uint32 i = (hole + 1) & aio_slots_mask; aio_slots[i].in_use; i = (i + 1) & aio_slots_mask) {
+    uint32 home = aio_slot_home(aio_slots[i].io_id);
+    if (((i - home) & aio_slots_mask) >= ((i - hole) & aio_slots_mask)) {
+      aio_slots[hole] = aio_slots[i];
+      hole = i;
+    }
+  }
+  aio_slots[hole].in_use = false;
+  aio_slots_used--;
+}
+
+/* Release and remove the slots of earlier reads on handle io_id, which can no longer complete. Safe in
+ * critical sections. */
+static void aio_slot_remove_stale(int io_id, uint8 seq) {
+  uint32 i = aio_slot_home(io_id);
+  while (aio_slots[i].in_use) {
+    if (aio_slots[i].io_id == io_id && aio_slots[i].seq != seq) {
+      smgr_stats_counter_add(SMGR_STATS_COUNTER_AIO_COLLISIONS, 1);
+      aio_slot_release(&aio_slots[i]);
+      aio_slot_remove(i); /* Shifts a later slot into i, look at it again */
+      continue;
+    }
+    i = (i + 1) & aio_slots_mask;
+  }
+}
+
+/* Claim the slot for a read about to start. Returns NULL if the read can't be tracked. */
+static SmgrStatsAioSlot* aio_slot_insert(int io_id, uint8 seq) {
+  if (unlikely(!aio_slots)) {
+    uint32 capacity = pg_nextpower2_32(Max(2 * io_max_concurrency, 16));
+    aio_slots = MemoryContextAllocZero(TopMemoryContext, capacity * sizeof(SmgrStatsAioSlot));
+    aio_slots_mask = capacity - 1;
+  }
+
+  uint32 i = aio_slot_home(io_id);
+  for (; aio_slots[i].in_use; i = (i + 1) & aio_slots_mask) {
+    if (aio_slots[i].io_id == io_id && aio_slots[i].seq == seq) {
+      /* A read AIO_SEQ_MAX reads ago on this handle never reported completion; reuse its slot */
+      smgr_stats_counter_add(SMGR_STATS_COUNTER_AIO_COLLISIONS, 1);
+      aio_slot_release(&aio_slots[i]);
+      return &aio_slots[i];
+    }
+  }
 
-/* Recursion guard for metadata resolution (which may trigger smgropen recursively) */
+  /* Keep one slot free so probe loops terminate */
+  if (aio_slots_used >= aio_slots_mask) {
+    smgr_stats_counter_add(SMGR_STATS_COUNTER_AIO_COLLISIONS, 1);
+    return NULL;
+  }
+  aio_slots_used++;
+  aio_slots[i].in_use = true;
+  aio_slots[i].io_id = io_id;
+  aio_slots[i].seq = seq;
+  return &aio_slots[i];
+}
 
 /* Flag to track when we're inside an I/O operation (prevents metadata resolution in smgr_open) */
 static bool in_smgr_stats_io = false;
 
 static PgAioResult smgr_stats_readv_complete(PgAioHandle* ioh, PgAioResult prior_result, uint8 cb_data) {
-  (void)cb_data;
+  int pos = aio_slots ? aio_slot_find(pgaio_io_get_id(ioh), AIO_CB_SEQ(cb_data)) : -1;
+  if (pos < 0) {
+    /* Callbacks are only registered for tracked reads, so this is a read we lost track of */
+    smgr_stats_counter_add(SMGR_STATS_COUNTER_AIO_MISSES, 1);
+    return prior_result;
+  }
+  SmgrStatsAioSlot slot = aio_slots[pos];
+  aio_slot_remove((uint32)pos);
+
+  /* Runs in a critical section: only look up the pending entry, never create it */
+  SmgrStatsPendingEntry* pending = NULL;
+  if (slot.local) {
+    pending = smgr_stats_pending_get(&slot.tracking_key, false);
+    if (pending) {
+      pending->aio_inflight--;
+    }
+  }
+
   if (prior_result.status != PGAIO_RS_OK) {
+    smgr_stats_tablespace_io_end(slot.ts, slot.start_time, smgr_stats_clock_read_coarse());
+    smgr_stats_inflight_end(slot.inflight);
+    if (slot.shared) {
+      smgr_stats_unpin_entry(slot.shared);
+    }
     return prior_result;
   }
 
   INJECTION_POINT("smgr-stats-aio-read-complete", NULL);
 
-  if (!aio_slots) {
-    return prior_result;
-  }
+  PgAioTargetData* td = pgaio_io_get_target_data(ioh);
 
-  int slot = pgaio_io_get_id(ioh) % io_max_concurrency;
+  SmgrStatsInstant end = slot.timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  smgr_stats_tablespace_io_end(slot.ts, slot.start_time, end);
+  smgr_stats_inflight_end(slot.inflight);
+  smgr_stats_check_slow(SMGR_STATS_INFLIGHT_READ, &td->smgr.rlocator, td->smgr.forkNum, td->smgr.blockNum,
+                        td->smgr.nblocks, slot.start_time, end);
+
+  SmgrStatsOp op = {
+      .kind = SMGR_STATS_OP_READ,
+      .nblocks = td->smgr.nblocks,
+      .seq = slot.seq_result,
+      .timing_weight = slot.timing_weight,
+      .elapsed_us = slot.timing_weight > 0 ? smgr_stats_clock_elapsed_us(slot.start_time, end) : 0,
+      .throttle_us = slot.throttle_us,
+      .now = smgr_stats_clock_wall(end),
+      .folded = slot.folded,
+      .fork = slot.fork,
+  };
+  SmgrStatsInstant completed_at;
+  if (slot.timing_weight > 0 && slot.staged_at != 0 &&
+      smgr_stats_aio_completion(pgaio_io_get_id(ioh), AIO_CB_SEQ(cb_data), &completed_at)) {
+    op.aio_phases = true;
+    op.aio_phase_us[SMGR_STATS_AIO_STAGE] = smgr_stats_clock_elapsed_us(slot.start_time, slot.staged_at);
+    op.aio_phase_us[SMGR_STATS_AIO_DEVICE] = smgr_stats_clock_elapsed_us(slot.staged_at, completed_at);
+    op.aio_phase_us[SMGR_STATS_AIO_COMPLETION] = smgr_stats_clock_elapsed_us(completed_at, end);
+  }
+  smgr_stats_attribute_query(slot.queryid, &slot.tracking_key, &op);
 
-  /* Skip if we decided not to track this at startreadv time */
-  if (!aio_slots[slot].should_track) {
+  /*
+   * No metadata resolution or flushing here - AIO completion may trigger syscache
+   * access which conflicts with AIO constraints. Metadata is resolved by the
+   * background worker when collecting stats.
+   */
+  if (slot.local) {
+    if (pending) {
+      smgr_stats_apply_op(&pending->stats, &op);
+    }
     return prior_result;
   }
 
-  PgAioTargetData* td = pgaio_io_get_target_data(ioh);
-  SmgrStatsSeqResult seq = aio_slots[slot].seq_result;
-
-  SmgrStatsEntry* entry = smgr_stats_find_entry(&aio_slots[slot].tracking_key);
-  if (entry) {
-    entry->reads++;
-    entry->read_blocks += td->smgr.nblocks;
-    if (seq.is_sequential) {
-      entry->sequential_reads++;
-    } else {
-      entry->random_reads++;
-    }
-    if (seq.completed_run > 0) {
-      smgr_stats_welford_record(&entry->read_runs, (double)seq.completed_run);
-    }
+  if (slot.shared) {
+    smgr_stats_apply_op_shared(slot.shared, &op);
+    smgr_stats_unpin_entry(slot.shared);
+  }
 
-    instr_time end;
-    INSTR_TIME_SET_CURRENT(end);
-    INSTR_TIME_SUBTRACT(end, aio_slots[slot].start_time);
-    uint64 elapsed_us = INSTR_TIME_GET_MICROSEC(end);
-    smgr_stats_hist_record(&entry->read_timing, elapsed_us);
+  return prior_result;
+}
 
-    TimestampTz now = GetCurrentTimestamp();
-    smgr_stats_record_burstiness(&entry->read_burst, now);
-    smgr_stats_update_activity(entry, now);
+/* Issue the read-ahead that sequential detection planned, clipped to the end of the file */
+static void smgr_stats_prefetch_ahead(SMgrRelation reln, ForkNumber forknum, const SmgrStatsSeqResult* seq,
+                                      SmgrChainIndex chain_index) {
+  if (likely(seq->prefetch_nblocks == 0) || (io_direct_flags & IO_DIRECT_DATA)) {
+    return;
+  }
+  BlockNumber size = smgr_nblocks_next(reln, forknum, chain_index + 1); /* Not counted as the caller's nblocks */
+  if (seq->prefetch_from >= size) {
+    return;
+  }
+  BlockNumber n = Min(seq->prefetch_nblocks, size - seq->prefetch_from);
+  if (smgr_prefetch_next(reln, forknum, seq->prefetch_from, (int)n, chain_index + 1)) {
+    smgr_stats_counter_add(SMGR_STATS_COUNTER_PREFETCHED_BLOCKS, n);
+  }
+}
 
-    smgr_stats_release_entry(entry);
+/* Hold the op back if it exceeds an I/O limit. Runs before the I/O is timed, so the delay
+ * shows up only in throttle_timing. Returns the delay in microseconds. */
+static uint64 smgr_stats_maybe_throttle(SMgrRelation reln, ForkNumber forknum, const SmgrStatsKey* key,
+                                        BlockNumber nblocks) {
+  if (likely(!smgr_stats_limits_active())) {
+    return 0;
+  }
+  Oid reloid = smgr_stats_limits_by_relation() ? smgr_stats_handle_reloid(reln, forknum, key) : InvalidOid;
+  return smgr_stats_throttle(&reln->smgr_rlocator.locator, reloid, nblocks);
+}
 
-    /*
-     * No metadata resolution here - AIO completion may trigger syscache access
-     * which conflicts with AIO constraints. Metadata is resolved by the
-     * background worker when collecting stats.
-     */
+/* Runs in the issuing backend when the read is staged, which may be well before it is submitted.
+ * Staging a read on the handle means an earlier read on it is over, so its slot goes. */
+static void smgr_stats_readv_stage(PgAioHandle* ioh, uint8 cb_data) {
+  if (!aio_slots) {
+    return;
+  }
+  int io_id = pgaio_io_get_id(ioh);
+  aio_slot_remove_stale(io_id, AIO_CB_SEQ(cb_data));
+  if (cb_data & AIO_CB_TIMED) {
+    int pos = aio_slot_find(io_id, AIO_CB_SEQ(cb_data));
+    if (pos >= 0) {
+      aio_slots[pos].staged_at = smgr_stats_clock_read();
+    }
   }
+}
 
+/* Runs in whichever process completes the read, so it can only leave a shared stamp */
+static PgAioResult smgr_stats_readv_complete_shared(PgAioHandle* ioh, PgAioResult prior_result, uint8 cb_data) {
+  if (cb_data & AIO_CB_TIMED) {
+    smgr_stats_aio_stamp_completion(pgaio_io_get_id(ioh), AIO_CB_SEQ(cb_data), smgr_stats_clock_read());
+  }
   return prior_result;
 }
 
 static const PgAioHandleCallbacks smgr_stats_aio_cbs = {
+    .stage = smgr_stats_readv_stage,
+    .complete_shared = smgr_stats_readv_complete_shared,
     .complete_local = smgr_stats_readv_complete,
 };
 
 static void smgr_stats_readv(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum, void** buffers,
                              BlockNumber nblocks, SmgrChainIndex chain_index) {
-  instr_time start;
-  INSTR_TIME_SET_CURRENT(start);
+  SmgrStatsKey tracking_key;
+  if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    smgr_readv_next(reln, forknum, blocknum, buffers, nblocks, chain_index + 1);
+    return;
+  }
+
+  uint64 throttle_us = smgr_stats_maybe_throttle(reln, forknum, &tracking_key, nblocks);
+  uint32 timing_weight = smgr_stats_timing_weight();
+  SmgrStatsInstant start = timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  smgr_stats_tablespace_sync_start(reln->smgr_rlocator.locator.spcOid, start);
+
+  int inflight = smgr_stats_inflight_begin(SMGR_STATS_INFLIGHT_READ, &reln->smgr_rlocator.locator, forknum, blocknum,
+                                           nblocks, -1);
 
   in_smgr_stats_io = true;
   smgr_readv_next(reln, forknum, blocknum, buffers, nblocks, chain_index + 1);
   in_smgr_stats_io = false;
   INJECTION_POINT("smgr-stats-after-readv", NULL);
-
-  SmgrStatsKey tracking_key;
-  if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
-    return; /* Temp table with tracking=off */
-  }
-
-  instr_time end;
-  INSTR_TIME_SET_CURRENT(end);
-  INSTR_TIME_SUBTRACT(end, start);
-  uint64 elapsed_us = INSTR_TIME_GET_MICROSEC(end);
+  SmgrStatsInstant end = timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  smgr_stats_tablespace_sync_end(end);
+  smgr_stats_inflight_end(inflight);
+  smgr_stats_check_slow(SMGR_STATS_INFLIGHT_READ, &reln->smgr_rlocator.locator, forknum, blocknum, nblocks, start, end);
 
   /* Use real key for sequential detection (preserves accuracy even in aggregate mode) */
   SmgrStatsKey real_key = {.locator = reln->smgr_rlocator.locator, .forknum = forknum};
-  SmgrStatsSeqResult seq = smgr_stats_check_sequential(&real_key, blocknum, nblocks, true);
 
-  bool found;
-  SmgrStatsEntry* entry = smgr_stats_get_entry(&tracking_key, &found);
-  if ((!found || !entry->meta.metadata_valid) && !smgr_stats_is_temp_aggregate_key(&tracking_key)) {
-    smgr_stats_add_pending_metadata(&tracking_key);
-  }
-  entry->reads++;
-  entry->read_blocks += nblocks;
-  if (seq.is_sequential) {
-    entry->sequential_reads++;
-  } else {
-    entry->random_reads++;
-  }
-  if (seq.completed_run > 0) {
-    smgr_stats_welford_record(&entry->read_runs, (double)seq.completed_run);
-  }
-  smgr_stats_hist_record(&entry->read_timing, elapsed_us);
-  TimestampTz now = GetCurrentTimestamp();
-  smgr_stats_record_burstiness(&entry->read_burst, now);
-  smgr_stats_update_activity(entry, now);
-  smgr_stats_release_entry(entry);
+  SmgrStatsOp op = {
+      .kind = SMGR_STATS_OP_READ,
+      .nblocks = nblocks,
+      .seq = smgr_stats_check_sequential(&real_key, smgr_stats_handle_peek(reln, forknum), blocknum, nblocks, true),
+      .timing_weight = timing_weight,
+      .elapsed_us = timing_weight > 0 ? smgr_stats_clock_elapsed_us(start, end) : 0,
+      .throttle_us = throttle_us,
+      .now = smgr_stats_clock_wall(end),
+  };
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
+  smgr_stats_prefetch_ahead(reln, forknum, &op.seq, chain_index);
 }
 
 static void smgr_stats_startreadv(PgAioHandle* ioh, SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
                                   void** buffers, BlockNumber nblocks, SmgrChainIndex chain_index) {
-  /* Lazily allocate per-slot state array */
-  if (!aio_slots) {
-    aio_slots = MemoryContextAllocZero(TopMemoryContext, io_max_concurrency * sizeof(SmgrStatsAioSlot));
-  }
-
-  int slot = pgaio_io_get_id(ioh) % io_max_concurrency;
-
   SmgrStatsKey tracking_key;
-  bool should_track = smgr_stats_determine_key(reln, forknum, &tracking_key);
-
-  aio_slots[slot].should_track = should_track;
-  if (!should_track) {
+  SmgrStatsAioSlot* slot = NULL;
+  uint8 seq = 0;
+  if (smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    seq = aio_last_seq = aio_last_seq % AIO_SEQ_MAX + 1;
+    slot = aio_slot_insert(pgaio_io_get_id(ioh), seq);
+  }
+  if (!slot) {
     smgr_startreadv_next(ioh, reln, forknum, blocknum, buffers, nblocks, chain_index + 1);
     return;
   }
 
-  aio_slots[slot].tracking_key = tracking_key;
+  slot->tracking_key = tracking_key;
+  slot->fork = forknum;
+  slot->folded = smgr_stats_fold_forks;
 
-  /* Ensure entry exists before I/O (so completion callback can find it without allocating) */
-  bool found;
-  SmgrStatsEntry* entry = smgr_stats_get_entry(&tracking_key, &found);
-  if ((!found || !entry->meta.metadata_valid) && !smgr_stats_is_temp_aggregate_key(&tracking_key)) {
-    smgr_stats_add_pending_metadata(&tracking_key);
+  /*
+   * Resolve the entry before I/O, so the completion callback never allocates. The shared
+   * entry gets its own pin: the handle slot may be taken over before the read completes.
+   */
+  slot->local = smgr_stats_pending_active();
+  slot->shared = NULL;
+  if (slot->local) {
+    smgr_stats_pending_get(&tracking_key, true)->aio_inflight++;
+  } else {
+    SmgrStatsSharedEntry* shared = smgr_stats_handle_get(reln, forknum, &tracking_key);
+    if (shared) {
+      smgr_stats_repin_entry(shared);
+      slot->shared = shared;
+    }
   }
-  smgr_stats_release_entry(entry);
 
-  INSTR_TIME_SET_CURRENT(aio_slots[slot].start_time);
+  slot->throttle_us = smgr_stats_maybe_throttle(reln, forknum, &tracking_key, nblocks);
+  slot->queryid = pgstat_get_my_query_id();
+  slot->timing_weight = smgr_stats_timing_weight();
+  slot->staged_at = 0;
+  slot->start_time = slot->timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  slot->ts = smgr_stats_tablespace_io_start(reln->smgr_rlocator.locator.spcOid, slot->start_time);
+  slot->inflight = smgr_stats_inflight_begin(SMGR_STATS_INFLIGHT_READ, &reln->smgr_rlocator.locator, forknum, blocknum,
+                                             nblocks, pgaio_io_get_id(ioh));
 
   /* Use real key for sequential detection (preserves accuracy even in aggregate mode) */
   SmgrStatsKey real_key = {.locator = reln->smgr_rlocator.locator, .forknum = forknum};
-  aio_slots[slot].seq_result = smgr_stats_check_sequential(&real_key, blocknum, nblocks, true);
+  slot->seq_result =
+      smgr_stats_check_sequential(&real_key, smgr_stats_handle_peek(reln, forknum), blocknum, nblocks, true);
 
-  pgaio_io_register_callbacks(ioh, smgr_stats_aio_cb_id, 0);
+  /* cb_data carries the read's sequence number and tells the callbacks whether to stamp the phases */
+  pgaio_io_register_callbacks(ioh, smgr_stats_aio_cb_id, AIO_CB_DATA(seq, slot->timing_weight > 0));
   smgr_startreadv_next(ioh, reln, forknum, blocknum, buffers, nblocks, chain_index + 1);
+  smgr_stats_prefetch_ahead(reln, forknum, &slot->seq_result, chain_index);
 }
 
 static void smgr_stats_writev(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum, const void** buffers,
                               BlockNumber nblocks, bool skip_fsync, SmgrChainIndex chain_index) {
-  instr_time start;
-  INSTR_TIME_SET_CURRENT(start);
+  SmgrStatsKey tracking_key;
+  if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    smgr_writev_next(reln, forknum, blocknum, buffers, nblocks, skip_fsync, chain_index + 1);
+    return;
+  }
+
+  uint64 throttle_us = smgr_stats_maybe_throttle(reln, forknum, &tracking_key, nblocks);
+  uint32 timing_weight = smgr_stats_timing_weight();
+  SmgrStatsInstant start = timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  smgr_stats_tablespace_sync_start(reln->smgr_rlocator.locator.spcOid, start);
+
+  int inflight = smgr_stats_inflight_begin(SMGR_STATS_INFLIGHT_WRITE, &reln->smgr_rlocator.locator, forknum, blocknum,
+                                           nblocks, -1);
 
   in_smgr_stats_io = true;
   smgr_writev_next(reln, forknum, blocknum, buffers, nblocks, skip_fsync, chain_index + 1);
   in_smgr_stats_io = false;
   INJECTION_POINT("smgr-stats-after-writev", NULL);
-
-  SmgrStatsKey tracking_key;
-  if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
-    return; /* Temp table with tracking=off */
-  }
-
-  instr_time end;
-  INSTR_TIME_SET_CURRENT(end);
-  INSTR_TIME_SUBTRACT(end, start);
-  uint64 elapsed_us = INSTR_TIME_GET_MICROSEC(end);
+  SmgrStatsInstant end = timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  smgr_stats_tablespace_sync_end(end);
+  smgr_stats_inflight_end(inflight);
+  smgr_stats_check_slow(SMGR_STATS_INFLIGHT_WRITE, &reln->smgr_rlocator.locator, forknum, blocknum, nblocks, start,
+                        end);
 
   /* Use real key for sequential detection (preserves accuracy even in aggregate mode) */
   SmgrStatsKey real_key = {.locator = reln->smgr_rlocator.locator, .forknum = forknum};
-  SmgrStatsSeqResult seq = smgr_stats_check_sequential(&real_key, blocknum, nblocks, false);
 
-  bool found;
-  SmgrStatsEntry* entry = smgr_stats_get_entry(&tracking_key, &found);
-  if ((!found || !entry->meta.metadata_valid) && !smgr_stats_is_temp_aggregate_key(&tracking_key)) {
-    smgr_stats_add_pending_metadata(&tracking_key);
-  }
-  entry->writes++;
-  entry->write_blocks += nblocks;
-  if (seq.is_sequential) {
-    entry->sequential_writes++;
-  } else {
-    entry->random_writes++;
-  }
-  if (seq.completed_run > 0) {
-    smgr_stats_welford_record(&entry->write_runs, (double)seq.completed_run);
-  }
-  smgr_stats_hist_record(&entry->write_timing, elapsed_us);
-  TimestampTz now = GetCurrentTimestamp();
-  smgr_stats_record_burstiness(&entry->write_burst, now);
-  smgr_stats_update_activity(entry, now);
-  smgr_stats_release_entry(entry);
+  SmgrStatsOp op = {
+      .kind = SMGR_STATS_OP_WRITE,
+      .nblocks = nblocks,
+      .seq = smgr_stats_check_sequential(&real_key, NULL, blocknum, nblocks, false),
+      .timing_weight = timing_weight,
+      .elapsed_us = timing_weight > 0 ? smgr_stats_clock_elapsed_us(start, end) : 0,
+      .throttle_us = throttle_us,
+      .now = smgr_stats_clock_wall(end),
+  };
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
 }
 
+/*
+ * Extends are timed like reads and writes (subject to smgr_stats.timing_sample_rate); untimed
+ * ones still read the coarse clock for slow I/O capture. Truncates and syncs are rare and slow,
+ * so every one is timed. Either way the key is determined first, so untracked relations skip
+ * the clock reads. Truncates mostly run in a critical section: they are not shown in
+ * smgr_stats.in_flight() there, and are recorded through smgr_stats_record's critical-section
+ * path, which parks the op (and any slow I/O record) when its entry doesn't exist yet.
+ */
 static void smgr_stats_extend(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum, const void* buffer,
                               bool skip_fsync, SmgrChainIndex chain_index) {
-  smgr_extend_next(reln, forknum, blocknum, buffer, skip_fsync, chain_index + 1);
-
   SmgrStatsKey tracking_key;
   if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    smgr_extend_next(reln, forknum, blocknum, buffer, skip_fsync, chain_index + 1);
     return;
   }
 
-  bool found;
-  SmgrStatsEntry* entry = smgr_stats_get_entry(&tracking_key, &found);
-  if ((!found || !entry->meta.metadata_valid) && !smgr_stats_is_temp_aggregate_key(&tracking_key)) {
-    smgr_stats_add_pending_metadata(&tracking_key);
-  }
-  entry->extends++;
-  entry->extend_blocks++;
-  smgr_stats_update_activity(entry, GetCurrentTimestamp());
-  smgr_stats_release_entry(entry);
+  uint32 timing_weight = smgr_stats_timing_weight();
+  SmgrStatsInstant start = timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  int inflight =
+      smgr_stats_inflight_begin(SMGR_STATS_INFLIGHT_EXTEND, &reln->smgr_rlocator.locator, forknum, blocknum, 1, -1);
+  smgr_extend_next(reln, forknum, blocknum, buffer, skip_fsync, chain_index + 1);
+  smgr_stats_inflight_end(inflight);
+  SmgrStatsInstant end = timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  smgr_stats_check_slow(SMGR_STATS_INFLIGHT_EXTEND, &reln->smgr_rlocator.locator, forknum, blocknum, 1, start, end);
+
+  SmgrStatsOp op = {
+      .kind = SMGR_STATS_OP_EXTEND,
+      .nblocks = 1,
+      .timing_weight = timing_weight,
+      .elapsed_us = timing_weight > 0 ? smgr_stats_clock_elapsed_us(start, end) : 0,
+      .now = smgr_stats_clock_wall(end),
+  };
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
 }
 
 static void smgr_stats_zeroextend(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum, int nblocks,
                                   bool skip_fsync, SmgrChainIndex chain_index) {
-  smgr_zeroextend_next(reln, forknum, blocknum, nblocks, skip_fsync, chain_index + 1);
-
   SmgrStatsKey tracking_key;
   if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    smgr_zeroextend_next(reln, forknum, blocknum, nblocks, skip_fsync, chain_index + 1);
     return;
   }
 
-  bool found;
-  SmgrStatsEntry* entry = smgr_stats_get_entry(&tracking_key, &found);
-  if ((!found || !entry->meta.metadata_valid) && !smgr_stats_is_temp_aggregate_key(&tracking_key)) {
-    smgr_stats_add_pending_metadata(&tracking_key);
-  }
-  entry->extends++;
-  entry->extend_blocks += nblocks;
-  smgr_stats_update_activity(entry, GetCurrentTimestamp());
-  smgr_stats_release_entry(entry);
+  uint32 timing_weight = smgr_stats_timing_weight();
+  SmgrStatsInstant start = timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  int inflight = smgr_stats_inflight_begin(SMGR_STATS_INFLIGHT_ZEROEXTEND, &reln->smgr_rlocator.locator, forknum,
+                                           blocknum, (BlockNumber)nblocks, -1);
+  smgr_zeroextend_next(reln, forknum, blocknum, nblocks, skip_fsync, chain_index + 1);
+  smgr_stats_inflight_end(inflight);
+  SmgrStatsInstant end = timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  smgr_stats_check_slow(SMGR_STATS_INFLIGHT_ZEROEXTEND, &reln->smgr_rlocator.locator, forknum, blocknum,
+                        (BlockNumber)nblocks, start, end);
+
+  SmgrStatsOp op = {
+      .kind = SMGR_STATS_OP_EXTEND,
+      .nblocks = nblocks,
+      .timing_weight = timing_weight,
+      .elapsed_us = timing_weight > 0 ? smgr_stats_clock_elapsed_us(start, end) : 0,
+      .zeroed = true,
+      .now = smgr_stats_clock_wall(end),
+  };
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
 }
 
 static void smgr_stats_truncate(SMgrRelation reln, ForkNumber forknum, BlockNumber old_nblocks, BlockNumber nblocks,
                                 SmgrChainIndex chain_index) {
-  smgr_truncate_next(reln, forknum, old_nblocks, nblocks, chain_index + 1);
-
   SmgrStatsKey tracking_key;
   if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    smgr_truncate_next(reln, forknum, old_nblocks, nblocks, chain_index + 1);
     return;
   }
 
-  bool found;
-  SmgrStatsEntry* entry = smgr_stats_get_entry(&tracking_key, &found);
-  if ((!found || !entry->meta.metadata_valid) && !smgr_stats_is_temp_aggregate_key(&tracking_key)) {
-    smgr_stats_add_pending_metadata(&tracking_key);
+  /* Shown as the range cut off. RelationTruncate truncates in a critical section, where nothing is registered. */
+  int inflight = -1;
+  if (CritSectionCount == 0) {
+    inflight = smgr_stats_inflight_begin(SMGR_STATS_INFLIGHT_TRUNCATE, &reln->smgr_rlocator.locator, forknum, nblocks,
+                                         old_nblocks > nblocks ? old_nblocks - nblocks : 0, -1);
   }
-  entry->truncates++;
-  smgr_stats_update_activity(entry, GetCurrentTimestamp());
-  smgr_stats_release_entry(entry);
+  SmgrStatsInstant start = smgr_stats_clock_read();
+  smgr_truncate_next(reln, forknum, old_nblocks, nblocks, chain_index + 1);
+  SmgrStatsInstant end = smgr_stats_clock_read();
+  smgr_stats_inflight_end(inflight);
+  smgr_stats_check_slow(SMGR_STATS_INFLIGHT_TRUNCATE, &reln->smgr_rlocator.locator, forknum, nblocks,
+                        old_nblocks > nblocks ? old_nblocks - nblocks : 0, start, end);
+
+  SmgrStatsOp op = {
+      .kind = SMGR_STATS_OP_TRUNCATE,
+      .nblocks = old_nblocks > nblocks ? old_nblocks - nblocks : 0,
+      .elapsed_us = smgr_stats_clock_elapsed_us(start, end),
+      .now = smgr_stats_clock_wall(end),
+  };
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
 }
 
 static void smgr_stats_immedsync(SMgrRelation reln, ForkNumber forknum, SmgrChainIndex chain_index) {
-  smgr_immedsync_next(reln, forknum, chain_index + 1);
-
   SmgrStatsKey tracking_key;
   if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    smgr_immedsync_next(reln, forknum, chain_index + 1);
     return;
   }
 
-  bool found;
-  SmgrStatsEntry* entry = smgr_stats_get_entry(&tracking_key, &found);
-  if ((!found || !entry->meta.metadata_valid) && !smgr_stats_is_temp_aggregate_key(&tracking_key)) {
-    smgr_stats_add_pending_metadata(&tracking_key);
+  int inflight = -1;
+  if (CritSectionCount == 0) {
+    inflight = smgr_stats_inflight_begin(SMGR_STATS_INFLIGHT_FSYNC, &reln->smgr_rlocator.locator, forknum,
+                                         InvalidBlockNumber, 0, -1);
+  }
+  SmgrStatsInstant start = smgr_stats_clock_read();
+  smgr_immedsync_next(reln, forknum, chain_index + 1);
+  SmgrStatsInstant end = smgr_stats_clock_read();
+  smgr_stats_inflight_end(inflight);
+  smgr_stats_check_slow(SMGR_STATS_INFLIGHT_FSYNC, &reln->smgr_rlocator.locator, forknum, InvalidBlockNumber, 0, start,
+                        end);
+
+  SmgrStatsOp op = {
+      .kind = SMGR_STATS_OP_FSYNC,
+      .elapsed_us = smgr_stats_clock_elapsed_us(start, end),
+      .now = smgr_stats_clock_wall(end),
+  };
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
+}
+
+/*
+ * Metadata ops move no data, but smgrnblocks is an lseek per segment and opens
+ * the segments on the way, so storms of them on wide partitioned tables show up
+ * as CPU. They are counted and timed (sampled like data ops) per file. They are
+ * not tracked in critical sections, where the entry could not be created.
+ */
+static inline uint32 smgr_stats_meta_begin(SmgrStatsInstant* start) {
+  uint32 timing_weight = smgr_stats_meta_timing_weight();
+  *start = timing_weight > 0 ? smgr_stats_clock_read() : 0;
+  return timing_weight;
+}
+
+static SmgrStatsOp smgr_stats_meta_end(SmgrStatsMetaOp meta, BlockNumber nblocks, uint32 timing_weight,
+                                       SmgrStatsInstant start) {
+  SmgrStatsInstant end = timing_weight > 0 ? smgr_stats_clock_read() : smgr_stats_clock_read_coarse();
+  return (SmgrStatsOp){
+      .kind = SMGR_STATS_OP_META,
+      .meta = meta,
+      .nblocks = nblocks,
+      .timing_weight = timing_weight,
+      .elapsed_us = timing_weight > 0 ? smgr_stats_clock_elapsed_us(start, end) : 0,
+      .now = smgr_stats_clock_wall(end),
+  };
+}
+
+static BlockNumber smgr_stats_nblocks(SMgrRelation reln, ForkNumber forknum, SmgrChainIndex chain_index) {
+  SmgrStatsKey tracking_key;
+  if (CritSectionCount > 0 || !smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    return smgr_nblocks_next(reln, forknum, chain_index + 1);
+  }
+
+  SmgrStatsInstant start;
+  uint32 timing_weight = smgr_stats_meta_begin(&start);
+  BlockNumber result = smgr_nblocks_next(reln, forknum, chain_index + 1);
+  SmgrStatsOp op = smgr_stats_meta_end(SMGR_STATS_META_NBLOCKS, 0, timing_weight, start);
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
+  return result;
+}
+
+static bool smgr_stats_exists(SMgrRelation reln, ForkNumber forknum, SmgrChainIndex chain_index) {
+  SmgrStatsKey tracking_key;
+  if (CritSectionCount > 0 || !smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    return smgr_exists_next(reln, forknum, chain_index + 1);
+  }
+
+  SmgrStatsInstant start;
+  uint32 timing_weight = smgr_stats_meta_begin(&start);
+  bool result = smgr_exists_next(reln, forknum, chain_index + 1);
+  SmgrStatsOp op = smgr_stats_meta_end(SMGR_STATS_META_EXISTS, 0, timing_weight, start);
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
+  return result;
+}
+
+static bool smgr_stats_prefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum, int nblocks,
+                                SmgrChainIndex chain_index) {
+  SmgrStatsKey tracking_key;
+  if (CritSectionCount > 0 || !smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    return smgr_prefetch_next(reln, forknum, blocknum, nblocks, chain_index + 1);
   }
-  entry->fsyncs++;
-  smgr_stats_update_activity(entry, GetCurrentTimestamp());
-  smgr_stats_release_entry(entry);
+
+  SmgrStatsInstant start;
+  uint32 timing_weight = smgr_stats_meta_begin(&start);
+  bool result = smgr_prefetch_next(reln, forknum, blocknum, nblocks, chain_index + 1);
+  SmgrStatsOp op = smgr_stats_meta_end(SMGR_STATS_META_PREFETCH, (BlockNumber)nblocks, timing_weight, start);
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
+  return result;
 }
 
-static void smgr_stats_open(SMgrRelation reln, SmgrChainIndex chain_index) {
-  smgr_open_next(reln, chain_index + 1);
+static void smgr_stats_writeback(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum, BlockNumber nblocks,
+                                 SmgrChainIndex chain_index) {
+  SmgrStatsKey tracking_key;
+  if (CritSectionCount > 0 || !smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    smgr_writeback_next(reln, forknum, blocknum, nblocks, chain_index + 1);
+    return;
+  }
+
+  SmgrStatsInstant start;
+  uint32 timing_weight = smgr_stats_meta_begin(&start);
+  smgr_writeback_next(reln, forknum, blocknum, nblocks, chain_index + 1);
+  SmgrStatsOp op = smgr_stats_meta_end(SMGR_STATS_META_WRITEBACK, nblocks, timing_weight, start);
+  smgr_stats_record(reln, forknum, &tracking_key, &op);
+}
 
+/*
+ * smgrclose closes every fork, most of which may never have been touched or may
+ * not exist, so only forks this backend did I/O on are counted; the others would
+ * create entries of their own. The handle's pins go with the close, letting idle
+ * entries be evicted without waiting for the slot to be taken over.
+ */
+static void smgr_stats_close(SMgrRelation reln, ForkNumber forknum, SmgrChainIndex chain_index) {
   SmgrStatsKey tracking_key;
-  if (!smgr_stats_determine_key(reln, MAIN_FORKNUM, &tracking_key)) {
+  if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
+    smgr_close_next(reln, forknum, chain_index + 1);
+    smgr_stats_handle_release(reln, forknum);
     return;
   }
 
-  bool found;
-  SmgrStatsEntry* entry = smgr_stats_get_entry(&tracking_key, &found);
-  if ((!found || !entry->meta.metadata_valid) && !smgr_stats_is_temp_aggregate_key(&tracking_key)) {
-    smgr_stats_add_pending_metadata(&tracking_key);
+  SmgrStatsInstant start;
+  uint32 timing_weight = smgr_stats_meta_begin(&start);
+  smgr_close_next(reln, forknum, chain_index + 1);
+  SmgrStatsOp op = smgr_stats_meta_end(SMGR_STATS_META_CLOSE, 0, timing_weight, start);
+
+  if (smgr_stats_pending_active()) {
+    SmgrStatsPendingEntry* pending = smgr_stats_pending_get(&tracking_key, false);
+    if (pending) {
+      smgr_stats_apply_op(&pending->stats, &op);
+    }
+  } else {
+    SmgrStatsSharedEntry* shared = smgr_stats_handle_peek(reln, forknum);
+    if (shared) {
+      smgr_stats_apply_op_shared(shared, &op);
+    }
   }
-  smgr_stats_release_entry(entry);
+  smgr_stats_handle_release(reln, forknum);
 }
 
 static void smgr_stats_create(RelFileLocator relold, SMgrRelation reln, ForkNumber forknum, bool is_redo,
@@ -367,23 +1146,12 @@ static void smgr_stats_create(RelFileLocator relold, SMgrRelation reln, ForkNumb
     smgr_stats_queue_relfile_assoc(&relold, &reln->smgr_rlocator.locator, forknum, is_redo);
   }
 
-  SmgrStatsKey tracking_key;
-  if (!smgr_stats_determine_key(reln, forknum, &tracking_key)) {
-    return;
-  }
-
-  bool found;
-  SmgrStatsEntry* entry = smgr_stats_get_entry(&tracking_key, &found);
-  if ((!found || !entry->meta.metadata_valid) && !smgr_stats_is_temp_aggregate_key(&tracking_key)) {
-    smgr_stats_add_pending_metadata(&tracking_key);
-  }
-  smgr_stats_release_entry(entry);
+  /* No entry yet: it is created by the first real I/O on the new file */
 }
 
 static const struct f_smgr smgr_stats_smgr = {
     .name = "smgr_stats",
     .chain_position = SMGR_CHAIN_MODIFIER,
-    .smgr_open = smgr_stats_open,
     .smgr_create = smgr_stats_create,
     .smgr_readv = smgr_stats_readv,
     .smgr_startreadv = smgr_stats_startreadv,
@@ -392,6 +1160,11 @@ static const struct f_smgr smgr_stats_smgr = {
     .smgr_zeroextend = smgr_stats_zeroextend,
     .smgr_truncate = smgr_stats_truncate,
     .smgr_immedsync = smgr_stats_immedsync,
+    .smgr_nblocks = smgr_stats_nblocks,
+    .smgr_exists = smgr_stats_exists,
+    .smgr_prefetch = smgr_stats_prefetch,
+    .smgr_writeback = smgr_stats_writeback,
+    .smgr_close = smgr_stats_close,
 };
 
 void smgr_stats_register_link(void) {
@@ -20,6 +20,8 @@
 #include "utils/syscache.h"
 
 #include "smgr_stats_metadata.h"
+#include "smgr_stats_pending.h"
+#include "smgr_stats_query.h"
 #include "smgr_stats_store.h"
 
 /* Backend-local list of keys needing metadata resolution */
@@ -30,7 +32,91 @@ static ExecutorEnd_hook_type prev_executor_end_hook = NULL;
 static ProcessUtility_hook_type prev_process_utility_hook = NULL;
 static bool hooks_registered = false;
 
+/* Highest backend_type an entry can be keyed by */
+static inline int32 last_backend_type(void) {
+  return smgr_stats_track_backend_type ? (int32)(BACKEND_NUM_TYPES - 1) : (int32)B_INVALID;
+}
+
+/*
+ * Give the metadata to every fork and backend_type variant of key's relation
+ * that has none yet. Stripes carry no metadata.
+ */
+static void propagate_metadata(const SmgrStatsKey* key, const SmgrStatsEntryMeta* meta) {
+  SmgrStatsKey variant = *key;
+  variant.stripe = 0;
+  for (ForkNumber forknum = MAIN_FORKNUM; forknum <= MAX_FORKNUM; forknum++) {
+    variant.forknum = forknum;
+    for (int32 backend_type = B_INVALID; backend_type <= last_backend_type(); backend_type++) {
+      variant.backend_type = backend_type;
+      SmgrStatsSharedEntry* entry = smgr_stats_find_entry(&variant);
+      if (entry != NULL) {
+        if (!entry->meta.metadata_valid) {
+          entry->meta = *meta;
+        }
+        smgr_stats_release_entry(entry);
+      }
+    }
+  }
+}
+
+/*
+ * Copy metadata into key's entry from another backend_type variant of the
+ * same fork, if one has it. Processes that can't look the relation up
+ * themselves (the checkpointer, or a backend of another database) get their
+ * entries' metadata this way. Returns true if the entry has metadata now.
+ */
+static bool copy_variant_metadata(const SmgrStatsKey* key) {
+  SmgrStatsKey variant = *key;
+  variant.stripe = 0;
+  for (int32 backend_type = B_INVALID; backend_type <= last_backend_type(); backend_type++) {
+    if (backend_type == key->backend_type) {
+      continue;
+    }
+    variant.backend_type = backend_type;
+    SmgrStatsSharedEntry* entry = smgr_stats_find_entry(&variant);
+    if (entry == NULL) {
+      continue;
+    }
+    SmgrStatsEntryMeta meta = entry->meta;
+    smgr_stats_release_entry(entry);
+    if (!meta.metadata_valid) {
+      continue;
+    }
+
+    entry = smgr_stats_find_entry(key);
+    if (entry != NULL) {
+      if (!entry->meta.metadata_valid) {
+        entry->meta = meta;
+      }
+      smgr_stats_release_entry(entry);
+    }
+    return true;
+  }
+  return false;
+}
+
+/* True if some backend_type variant of key's relation fork exists without metadata */
+static bool any_variant_needs_metadata(const SmgrStatsKey* key) {
+  SmgrStatsKey variant = *key;
+  for (int32 backend_type = B_INVALID; backend_type <= last_backend_type(); backend_type++) {
+    variant.backend_type = backend_type;
+    SmgrStatsSharedEntry* entry = smgr_stats_find_entry(&variant);
+    if (entry != NULL) {
+      bool needs = !entry->meta.metadata_valid;
+      smgr_stats_release_entry(entry);
+      if (needs) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 void smgr_stats_add_pending_metadata(const SmgrStatsKey* key) {
+  if (smgr_stats_track_backend_type && copy_variant_metadata(key)) {
+    return;
+  }
+
   /* Only track entries for our database (or global entries) */
   if (key->locator.dbOid != MyDatabaseId && key->locator.dbOid != 0) {
     return;
@@ -62,7 +148,7 @@ void smgr_stats_resolve_pending_metadata(void) {
     /* Resolve entries for our database and global/shared catalogs (dbOid=0) */
     if (key->locator.dbOid == MyDatabaseId || key->locator.dbOid == 0) {
       /* Step 1: Check if resolution is needed (holding lock) */
-      SmgrStatsEntry* stats = smgr_stats_find_entry(key);
+      SmgrStatsSharedEntry* stats = smgr_stats_find_entry(key);
       if (stats != NULL && !stats->meta.metadata_valid) {
         /* Step 2: Release lock before syscache access */
         smgr_stats_release_entry(stats);
@@ -79,6 +165,7 @@ void smgr_stats_resolve_pending_metadata(void) {
               stats->meta = resolved_meta;
             }
             smgr_stats_release_entry(stats);
+            propagate_metadata(key, &resolved_meta);
           }
         }
         /* If lookup failed or entry was removed, nothing to do */
@@ -93,27 +180,6 @@ void smgr_stats_resolve_pending_metadata(void) {
   pending_metadata_keys = NIL;
 }
 
-/*
- * Update entry metadata and propagate to other forks.
- * Takes ownership of the entry lock (releases it before returning).
- */
-static void update_entry_and_forks(SmgrStatsEntry* entry, SmgrStatsKey* key, const SmgrStatsEntryMeta* meta) {
-  entry->meta = *meta;
-  smgr_stats_release_entry(entry);
-
-  /* Also update other forks if they have entries */
-  for (ForkNumber forknum = MAIN_FORKNUM + 1; forknum <= MAX_FORKNUM; forknum++) {
-    key->forknum = forknum;
-    entry = smgr_stats_find_entry(key);
-    if (entry != NULL) {
-      if (!entry->meta.metadata_valid) {
-        entry->meta = *meta;
-      }
-      smgr_stats_release_entry(entry);
-    }
-  }
-}
-
 /*
  * Check if a pg_class tuple should be processed for metadata resolution.
  * Returns the relfilenumber if valid, InvalidRelFileNumber otherwise.
@@ -205,16 +271,11 @@ static int collect_metadata_from_page(Page page, BlockNumber blkno, Snapshot sna
     info->key.locator.dbOid = db_oid;
     info->key.locator.relNumber = relfilenumber;
     info->key.forknum = MAIN_FORKNUM;
+    info->key.backend_type = B_INVALID;
+    info->key.stripe = 0;
 
-    /* Check if we have an entry that needs resolution */
-    SmgrStatsEntry* entry = smgr_stats_find_entry(&info->key);
-    if (entry == NULL) {
-      continue;
-    }
-
-    info->needs_resolution = !entry->meta.metadata_valid;
-    smgr_stats_release_entry(entry);
-
+    /* The copy may have been written by this backend, the checkpointer or both */
+    info->needs_resolution = any_variant_needs_metadata(&info->key);
     if (!info->needs_resolution) {
       continue;
     }
@@ -243,15 +304,8 @@ static void apply_collected_metadata(PgClassMetaInfo* infos, int count) {
     SmgrStatsEntryMeta meta;
     build_metadata_from_info(info, &meta);
 
-    /* Re-acquire entry and update if still needed */
-    SmgrStatsEntry* entry = smgr_stats_find_entry(&info->key);
-    if (entry != NULL) {
-      if (!entry->meta.metadata_valid) {
-        update_entry_and_forks(entry, &info->key, &meta);
-      } else {
-        smgr_stats_release_entry(entry);
-      }
-    }
+    /* Re-acquire each entry and update it if still needed */
+    propagate_metadata(&info->key, &meta);
   }
 }
 
@@ -319,7 +373,9 @@ static void smgr_stats_executor_end(QueryDesc* query_desc) {
     standard_ExecutorEnd(query_desc);
   }
 
-  /* Resolve pending metadata after query completes */
+  /* Flush buffered stats (may create entries) and resolve pending metadata after query completes */
+  smgr_stats_pending_flush();
+  smgr_stats_query_flush();
   smgr_stats_resolve_pending_metadata();
 }
 
@@ -366,7 +422,9 @@ static void smgr_stats_process_utility(PlannedStmt* pstmt, const char* query_str
   }
   PG_FINALLY();
   {
-    /* Resolve pending metadata even on failure */
+    /* Flush buffered stats and resolve pending metadata even on failure */
+    smgr_stats_pending_flush();
+    smgr_stats_query_flush();
     smgr_stats_resolve_pending_metadata();
 
     if (new_db_name != NULL) {
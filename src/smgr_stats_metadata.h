@@ -21,7 +21,10 @@
  */
 
 /* Add a key to the backend-local pending metadata list. Called from SMGR hooks
- * when a new entry is created. The key is copied to TopMemoryContext. */
+ * when a new entry is created. The key is copied to TopMemoryContext. With
+ * smgr_stats.track_backend_type, an entry whose relation is already known
+ * under another backend_type takes that metadata instead. Resolved metadata
+ * is given to every fork and backend_type variant of the relation. */
 extern void smgr_stats_add_pending_metadata(const SmgrStatsKey* key);
 
 /* Resolve all pending metadata entries for this backend's database.
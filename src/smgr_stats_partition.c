@@ -0,0 +1,249 @@
+#include "postgres.h"
+
+#include "common/hashfn.h"
+#include "lib/dshash.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/dsm_registry.h"
+#include "storage/smgr.h"
+#include "utils/memutils.h"
+
+#include "smgr_stats_guc.h"
+#include "smgr_stats_partition.h"
+
+/* Number of backend-local cache slots. Must be a power of 2. */
+#define SMGR_STATS_PART_CACHE_SLOTS 1024
+
+/* A backend reports a leaf's activity to the shared map once per this many ops */
+#define SMGR_STATS_PART_SAMPLE 64
+
+typedef struct SmgrStatsPartMapEntry {
+  RelFileLocator leaf;  /* Must be first (dshash requirement) */
+  Oid root_reloid;      /* Top-most partitioned ancestor */
+  bool hot;             /* Tracked individually, set by the collector */
+  pg_atomic_uint64 ops; /* Sampled ops since the last hot-leaf selection */
+} SmgrStatsPartMapEntry;
+
+/* One version per backend cache slot, bumped whenever a leaf hashing to that slot is mapped,
+ * forgotten or changes hotness, so a change only invalidates the cache slots it affects */
+typedef struct SmgrStatsPartControl {
+  pg_atomic_uint64 versions[SMGR_STATS_PART_CACHE_SLOTS];
+} SmgrStatsPartControl;
+
+typedef struct SmgrStatsPartCacheSlot {
+  RelFileLocator locator;
+  uint64 version; /* Slot version the answer was read under, 0 if empty */
+  bool mapped;    /* The relation is a known leaf partition */
+  bool hot;
+  Oid root_reloid;
+  uint32 ops; /* Ops not yet reported to the shared map */
+} SmgrStatsPartCacheSlot;
+
+typedef struct SmgrStatsLeafActivity {
+  RelFileLocator leaf;
+  uint64 ops;
+} SmgrStatsLeafActivity;
+
+static const dshash_parameters partmap_params = {
+    .key_size = sizeof(RelFileLocator),
+    .entry_size = sizeof(SmgrStatsPartMapEntry),
+    .compare_function = dshash_memcmp,
+    .hash_function = dshash_memhash,
+    .copy_function = dshash_memcpy,
+};
+
+static dshash_table* partmap = NULL;
+static SmgrStatsPartControl* part_control = NULL;
+static SmgrStatsPartCacheSlot* part_cache = NULL;
+
+static void part_control_init(void* ptr, void* arg) {
+  (void)arg;
+  SmgrStatsPartControl* control = ptr;
+  for (int i = 0; i < SMGR_STATS_PART_CACHE_SLOTS; i++) {
+    pg_atomic_init_u64(&control->versions[i], 1);
+  }
+}
+
+static SmgrStatsPartControl* get_part_control(void) {
+  if (!part_control) {
+    bool found;
+    part_control =
+        GetNamedDSMSegment("pg_smgrstat_partctl", sizeof(SmgrStatsPartControl), part_control_init, &found, NULL);
+  }
+  return part_control;
+}
+
+static inline uint32 part_cache_index(const RelFileLocator* locator) {
+  return murmurhash32(locator->relNumber) & (SMGR_STATS_PART_CACHE_SLOTS - 1);
+}
+
+/* Make backends look up leaf again */
+static void invalidate_leaf(const RelFileLocator* leaf) {
+  pg_atomic_fetch_add_u64(&get_part_control()->versions[part_cache_index(leaf)], 1);
+}
+
+static dshash_table* get_partmap(void) {
+  if (!partmap) {
+    bool found;
+    partmap = GetNamedDSHash("pg_smgrstat_partmap", &partmap_params, &found);
+  }
+  return partmap;
+}
+
+static void report_ops(SmgrStatsPartCacheSlot* slot) {
+  SmgrStatsPartMapEntry* entry = dshash_find(get_partmap(), &slot->locator, false);
+  if (entry) {
+    pg_atomic_fetch_add_u64(&entry->ops, slot->ops);
+    dshash_release_lock(get_partmap(), entry);
+  }
+  slot->ops = 0;
+}
+
+static void lookup_slot(SmgrStatsPartCacheSlot* slot) {
+  SmgrStatsPartMapEntry* entry = dshash_find(get_partmap(), &slot->locator, false);
+  slot->mapped = entry != NULL;
+  if (entry) {
+    slot->hot = entry->hot;
+    slot->root_reloid = entry->root_reloid;
+    dshash_release_lock(get_partmap(), entry);
+  }
+}
+
+void smgr_stats_partition_map_key(SmgrStatsKey* key) {
+  if (unlikely(!part_cache || !partmap || !part_control) && CritSectionCount > 0) {
+    return; /* Allocating or attaching isn't allowed here; the leaf is recorded on its own */
+  }
+  if (unlikely(!part_cache)) {
+    part_cache = MemoryContextAllocZero(TopMemoryContext, sizeof(SmgrStatsPartCacheSlot) * SMGR_STATS_PART_CACHE_SLOTS);
+  }
+
+  uint32 index = part_cache_index(&key->locator);
+  uint64 version = pg_atomic_read_u64(&get_part_control()->versions[index]);
+  SmgrStatsPartCacheSlot* slot = &part_cache[index];
+  bool same = RelFileLocatorEquals(slot->locator, key->locator);
+  if (unlikely(!same || slot->version != version)) {
+    if (!same) {
+      if (slot->mapped && slot->ops > 0) {
+        report_ops(slot);
+      }
+      slot->locator = key->locator;
+      slot->ops = 0;
+    }
+    lookup_slot(slot);
+    slot->version = version;
+  }
+
+  if (!slot->mapped) {
+    return;
+  }
+  if (unlikely(++slot->ops >= SMGR_STATS_PART_SAMPLE)) {
+    report_ops(slot);
+  }
+  if (!slot->hot) {
+    smgr_stats_set_partition_aggregate(key, slot->root_reloid);
+  }
+}
+
+void smgr_stats_partition_register(const RelFileLocator* locator, Oid root_reloid) {
+  bool found;
+  SmgrStatsPartMapEntry* entry = dshash_find_or_insert(get_partmap(), locator, &found);
+  bool changed = !found || entry->root_reloid != root_reloid;
+  if (!found) {
+    entry->hot = false;
+    pg_atomic_init_u64(&entry->ops, 0);
+  }
+  entry->root_reloid = root_reloid;
+  dshash_release_lock(get_partmap(), entry);
+
+  if (changed) {
+    invalidate_leaf(locator);
+  }
+  if (!found) {
+    smgr_stats_counter_add(SMGR_STATS_COUNTER_PARTITION_LEAVES, 1);
+  }
+}
+
+static int compare_activity_desc(const void* a, const void* b) {
+  uint64 ops_a = ((const SmgrStatsLeafActivity*)a)->ops;
+  uint64 ops_b = ((const SmgrStatsLeafActivity*)b)->ops;
+  return ops_a > ops_b ? -1 : (ops_a < ops_b ? 1 : 0);
+}
+
+static int compare_activity_leaf(const void* a, const void* b) {
+  return memcmp(&((const SmgrStatsLeafActivity*)a)->leaf, &((const SmgrStatsLeafActivity*)b)->leaf,
+                sizeof(RelFileLocator));
+}
+
+/* Forget idle leaves whose files are gone (dropped, or rewritten to a new relfilenode). Checked
+ * outside the map's locks, since smgrexists goes through the I/O hooks, which look up the map. */
+static void prune_leaves(dshash_table* map, const RelFileLocator* idle, int count) {
+  for (int i = 0; i < count; i++) {
+    SMgrRelation reln = smgropen(idle[i], INVALID_PROC_NUMBER);
+    bool exists = smgrexists(reln, MAIN_FORKNUM);
+    smgrclose(reln);
+    if (!exists && dshash_delete_key(map, &idle[i])) {
+      invalidate_leaf(&idle[i]);
+    }
+  }
+}
+
+void smgr_stats_partition_maintain(void) {
+  if (smgr_stats_track_partitions == SMGR_STATS_PARTITIONS_OFF) {
+    return;
+  }
+
+  dshash_table* map = get_partmap();
+  dshash_seq_status status;
+  SmgrStatsPartMapEntry* entry;
+
+  /* Take the activity sampled since the last selection; leaves without any are pruning candidates */
+  int capacity = 64;
+  int count = 0;
+  SmgrStatsLeafActivity* active = palloc(sizeof(SmgrStatsLeafActivity) * capacity);
+  int idle_capacity = 64;
+  int idle_count = 0;
+  RelFileLocator* idle = palloc(sizeof(RelFileLocator) * idle_capacity);
+  dshash_seq_init(&status, map, false);
+  while ((entry = dshash_seq_next(&status)) != NULL) {
+    uint64 ops = pg_atomic_exchange_u64(&entry->ops, 0);
+    if (ops == 0) {
+      if (idle_count == idle_capacity) {
+        idle_capacity *= 2;
+        idle = repalloc(idle, sizeof(RelFileLocator) * idle_capacity);
+      }
+      idle[idle_count++] = entry->leaf;
+      continue;
+    }
+    if (smgr_stats_partition_hot_leaves == 0) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity *= 2;
+      active = repalloc(active, sizeof(SmgrStatsLeafActivity) * capacity);
+    }
+    active[count++] = (SmgrStatsLeafActivity){.leaf = entry->leaf, .ops = ops};
+  }
+  dshash_seq_term(&status);
+
+  prune_leaves(map, idle, idle_count);
+  pfree(idle);
+
+  int n_hot = Min(count, smgr_stats_partition_hot_leaves);
+  if (n_hot > 0) {
+    qsort(active, count, sizeof(SmgrStatsLeafActivity), compare_activity_desc);
+    qsort(active, n_hot, sizeof(SmgrStatsLeafActivity), compare_activity_leaf);
+  }
+
+  dshash_seq_init(&status, map, true);
+  while ((entry = dshash_seq_next(&status)) != NULL) {
+    SmgrStatsLeafActivity probe = {.leaf = entry->leaf};
+    bool hot =
+        n_hot > 0 && bsearch(&probe, active, n_hot, sizeof(SmgrStatsLeafActivity), compare_activity_leaf) != NULL;
+    if (hot != entry->hot) {
+      entry->hot = hot;
+      invalidate_leaf(&entry->leaf);
+    }
+  }
+  dshash_seq_term(&status);
+  pfree(active);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "storage/relfilelocator.h"
+
+#include "smgr_stats_store.h"
+
+/*
+ * Partition aggregation (smgr_stats.track_partitions = aggregate).
+ *
+ * I/O on a leaf partition (or an index partition) is recorded under a
+ * synthetic key for its partitioned root instead of one entry per leaf. The
+ * leaf-to-root map is a dshash keyed by the leaf's RelFileLocator, filled in
+ * by whichever backend resolves the leaf's metadata (pg_inherits is only
+ * readable there), so the first I/O on a leaf is still recorded individually.
+ * Each backend caches answers in a small direct-mapped array. Every cache slot
+ * has a version in shared memory, bumped when a leaf hashing to it changes,
+ * so the I/O path does a shared lookup only after one of the leaves sharing
+ * its slot changed.
+ *
+ * Leaf activity is sampled into the map, and each collection the
+ * smgr_stats.partition_hot_leaves busiest leaves are flagged "hot" and go back
+ * to being tracked individually. Leaves with no activity whose files no
+ * longer exist (dropped partitions, rewritten relfilenodes) are removed.
+ */
+
+/* Rewrite a leaf partition's key to its root's aggregate key, unless the leaf is hot.
+ * Called from the I/O hooks; does a shared lookup only on a local cache miss. */
+extern void smgr_stats_partition_map_key(SmgrStatsKey* key);
+
+/* Record that the relation stored at locator is a partition of root_reloid.
+ * Called during metadata resolution. */
+extern void smgr_stats_partition_register(const RelFileLocator* locator, Oid root_reloid);
+
+/* Pick the hot leaves from the activity sampled since the last call and forget leaves whose
+ * files are gone. Collector only. */
+extern void smgr_stats_partition_maintain(void);
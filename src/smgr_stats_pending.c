@@ -0,0 +1,133 @@
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "utils/hsearch.h"
+
+#include "smgr_stats_guc.h"
+#include "smgr_stats_metadata.h"
+#include "smgr_stats_pending.h"
+#include "smgr_stats_store.h"
+
+static HTAB* pending_hash = NULL;
+static bool has_pending = false;
+static bool exiting = false;
+static TimestampTz last_flush = 0;
+static uint64 seen_flush_requests = 0;
+
+static void pending_remove(SmgrStatsPendingEntry* pending) {
+  if (pending->shared) {
+    smgr_stats_unpin_entry(pending->shared);
+  }
+  hash_search(pending_hash, &pending->key, HASH_REMOVE, NULL);
+}
+
+static void pending_before_shmem_exit(int code, Datum arg) {
+  (void)code;
+  (void)arg;
+  smgr_stats_pending_flush();
+
+  /* Drop the pins, later I/O (if any) writes through */
+  HASH_SEQ_STATUS seq;
+  SmgrStatsPendingEntry* pending;
+  hash_seq_init(&seq, pending_hash);
+  while ((pending = hash_seq_search(&seq)) != NULL) {
+    pending_remove(pending);
+  }
+  hash_destroy(pending_hash);
+  pending_hash = NULL;
+  exiting = true;
+}
+
+static HTAB* get_pending_hash(void) {
+  if (!pending_hash) {
+    HASHCTL ctl = {
+        .keysize = sizeof(SmgrStatsKey),
+        .entrysize = sizeof(SmgrStatsPendingEntry),
+    };
+    pending_hash = hash_create("smgr_stats_pending", 64, &ctl, HASH_ELEM | HASH_BLOBS);
+    before_shmem_exit(pending_before_shmem_exit, (Datum)0);
+  }
+  return pending_hash;
+}
+
+bool smgr_stats_pending_active(void) {
+  if (!smgr_stats_backend_buffering || exiting) {
+    return false;
+  }
+  /* Only processes that run statements (and therefore flush at statement end) buffer */
+  return MyBackendType == B_BACKEND || MyBackendType == B_AUTOVAC_WORKER || MyBackendType == B_BG_WORKER;
+}
+
+SmgrStatsPendingEntry* smgr_stats_pending_get(const SmgrStatsKey* key, bool create) {
+  create = create && CritSectionCount == 0; /* HASH_ENTER can allocate */
+  if (!create && !pending_hash) {
+    return NULL;
+  }
+
+  bool found;
+  SmgrStatsPendingEntry* pending = hash_search(get_pending_hash(), key, create ? HASH_ENTER : HASH_FIND, &found);
+  if (!pending) {
+    return NULL;
+  }
+  if (!found) {
+    pending->key = *key;
+    pending->aio_inflight = 0;
+    pending->shared = NULL;
+    smgr_stats_entry_init(&pending->stats);
+    pending->stats.key = *key;
+  }
+  pending->dirty = true;
+  has_pending = true;
+  return pending;
+}
+
+void smgr_stats_pending_maybe_flush(TimestampTz now) {
+  if (!has_pending || CritSectionCount > 0) {
+    return;
+  }
+
+  uint64 requests = smgr_stats_flush_requests();
+  if (requests == seen_flush_requests &&
+      !TimestampDifferenceExceeds(last_flush, now, smgr_stats_backend_flush_interval)) {
+    return;
+  }
+  smgr_stats_pending_flush();
+}
+
+void smgr_stats_pending_flush(void) {
+  if (!has_pending) {
+    return;
+  }
+
+  seen_flush_requests = smgr_stats_flush_requests();
+
+  HASH_SEQ_STATUS seq;
+  SmgrStatsPendingEntry* pending;
+  hash_seq_init(&seq, pending_hash);
+  while ((pending = hash_seq_search(&seq)) != NULL) {
+    if (!pending->dirty) {
+      /* Idle for a whole flush cycle: drop it, unless an async read still needs it */
+      if (pending->aio_inflight == 0) {
+        pending_remove(pending);
+      }
+      continue;
+    }
+
+    /* Only the first flush of an entry goes through the dshash */
+    if (!pending->shared) {
+      bool needs_metadata;
+      pending->shared = smgr_stats_pin_entry(&pending->key, true, &needs_metadata);
+      if (needs_metadata && !smgr_stats_has_synthetic_metadata(&pending->key)) {
+        smgr_stats_add_pending_metadata(&pending->key);
+      }
+    }
+    smgr_stats_shared_add(pending->shared, &pending->stats);
+
+    smgr_stats_entry_reset(&pending->stats);
+    pending->dirty = false;
+  }
+
+  has_pending = false;
+  last_flush = GetCurrentTimestamp();
+}
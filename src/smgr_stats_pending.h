@@ -0,0 +1,46 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "utils/timestamp.h"
+
+#include "smgr_stats_store.h"
+
+/*
+ * Backend-local pending stats (smgr_stats.backend_buffering).
+ *
+ * Instead of taking an exclusive dshash partition lock on every I/O, regular
+ * backends accumulate counters, histograms and Welford state in a local hash
+ * keyed by SmgrStatsKey and merge them into the shared entries in batches:
+ *   - at the end of every statement (ExecutorEnd / ProcessUtility hooks)
+ *   - from the I/O hooks once smgr_stats.backend_flush_interval has elapsed
+ *   - from the I/O hooks when the background worker has requested a flush
+ *   - at backend exit
+ *
+ * Burstiness (inter-arrival times) is measured per backend in this mode.
+ * Auxiliary processes (checkpointer, bgwriter, startup) always write through,
+ * since they have no statement boundaries to flush at.
+ */
+
+typedef struct SmgrStatsPendingEntry {
+  SmgrStatsKey key;             /* Hash key, must be first */
+  bool dirty;                   /* Touched since the last flush */
+  int aio_inflight;             /* Async reads started but not completed; keeps the entry across flushes */
+  SmgrStatsSharedEntry* shared; /* Pinned shared entry, resolved on first flush */
+  SmgrStatsEntry stats;         /* Per-period stats, merged into the shared entry on flush */
+} SmgrStatsPendingEntry;
+
+/* True if I/O in this backend should be accumulated locally. */
+extern bool smgr_stats_pending_active(void);
+
+/* Find (or with create=true, create) the pending entry for a key and mark it dirty.
+ * It is never created in a critical section, so this doesn't allocate there or in
+ * AIO completion callbacks (create=false); NULL if there is no entry. */
+extern SmgrStatsPendingEntry* smgr_stats_pending_get(const SmgrStatsKey* key, bool create);
+
+/* Flush if the flush interval has elapsed or the worker asked for it. No-op inside
+ * critical sections. Called from the synchronous I/O hooks. */
+extern void smgr_stats_pending_maybe_flush(TimestampTz now);
+
+/* Merge all pending stats into shared memory. */
+extern void smgr_stats_pending_flush(void);
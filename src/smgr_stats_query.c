@@ -0,0 +1,236 @@
+#include "postgres.h"
+
+#include "common/hashfn.h"
+#include "miscadmin.h"
+#include "port/pg_bitutils.h"
+#include "storage/dsm_registry.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+
+#include "smgr_stats_guc.h"
+#include "smgr_stats_query.h"
+
+/* Slots of the backend-local batch. Must be a power of 2. */
+#define SMGR_STATS_QUERY_LOCAL_SLOTS 64
+
+/* The batch is merged once this many slots are used (outside critical sections) */
+#define SMGR_STATS_QUERY_LOCAL_FLUSH_AT (SMGR_STATS_QUERY_LOCAL_SLOTS * 3 / 4)
+
+typedef struct SmgrStatsQueryLocalSlot {
+  bool used;
+  SmgrStatsQueryKey key;
+  SmgrStatsQueryCounters counters;
+} SmgrStatsQueryLocalSlot;
+
+/*
+ * Shared table: `capacity` entries followed by an open-addressing index of
+ * entry numbers (-1 = empty) with twice as many slots, all under one LWLock.
+ * Lookups go through the index; only replacing the lightest pair scans the
+ * entries.
+ */
+typedef struct SmgrStatsQueryTable {
+  LWLock lock;
+  int capacity;
+  int used;
+  uint32 index_mask;
+  SmgrStatsQueryEntry entries[FLEXIBLE_ARRAY_MEMBER];
+  /* int32 index[index_mask + 1] follows the entries */
+} SmgrStatsQueryTable;
+
+/* Statically allocated, so AIO completions never allocate */
+static SmgrStatsQueryLocalSlot local_slots[SMGR_STATS_QUERY_LOCAL_SLOTS];
+static int local_used = 0;
+static TimestampTz last_flush = 0;
+static uint64 seen_flush_requests = 0;
+static bool exit_callback_registered = false;
+
+static SmgrStatsQueryTable* query_table = NULL;
+
+static inline uint32 query_index_slots(int capacity) { return pg_nextpower2_32((uint32)Max(2 * capacity, 16)); }
+
+static inline int32* query_index(SmgrStatsQueryTable* t) { return (int32*)&t->entries[t->capacity]; }
+
+static Size query_table_size(void) {
+  return add_size(offsetof(SmgrStatsQueryTable, entries),
+                  add_size(mul_size(sizeof(SmgrStatsQueryEntry), smgr_stats_query_top_n),
+                           mul_size(sizeof(int32), query_index_slots(smgr_stats_query_top_n))));
+}
+
+static void query_table_init(void* ptr, void* arg) {
+  (void)arg;
+  SmgrStatsQueryTable* t = ptr;
+  LWLockInitialize(&t->lock, LWLockNewTrancheId("pg_smgrstat_queries"));
+  t->capacity = smgr_stats_query_top_n;
+  t->used = 0;
+  t->index_mask = query_index_slots(t->capacity) - 1;
+  memset(query_index(t), 0xff, sizeof(int32) * (t->index_mask + 1));
+}
+
+static SmgrStatsQueryTable* get_query_table(void) {
+  if (!query_table) {
+    bool found;
+    query_table = GetNamedDSMSegment("pg_smgrstat_queries", query_table_size(), query_table_init, &found, NULL);
+  }
+  return query_table;
+}
+
+static inline uint32 query_key_hash(const SmgrStatsQueryKey* key) {
+  return hash_bytes((const unsigned char*)key, sizeof(SmgrStatsQueryKey));
+}
+
+static inline bool query_key_equal(const SmgrStatsQueryKey* a, const SmgrStatsQueryKey* b) {
+  return memcmp(a, b, sizeof(SmgrStatsQueryKey)) == 0;
+}
+
+static inline void counters_add(SmgrStatsQueryCounters* dst, const SmgrStatsQueryCounters* src) {
+  dst->reads += src->reads;
+  dst->read_blocks += src->read_blocks;
+  dst->read_us += src->read_us;
+  dst->writes += src->writes;
+  dst->write_blocks += src->write_blocks;
+  dst->write_us += src->write_us;
+  dst->extends += src->extends;
+  dst->extend_blocks += src->extend_blocks;
+}
+
+static inline uint64 counters_weight(const SmgrStatsQueryCounters* c) {
+  return c->read_blocks + c->write_blocks + c->extend_blocks;
+}
+
+/* Index position holding key, or of the empty slot ending its probe chain */
+static uint32 index_probe(SmgrStatsQueryTable* t, const SmgrStatsQueryKey* key) {
+  int32* index = query_index(t);
+  uint32 i = query_key_hash(key) & t->index_mask;
+  while (index[i] >= 0 && !query_key_equal(&t->entries[index[i]].key, key)) {
+    i = (i + 1) & t->index_mask;
+  }
+  return i;
+}
+
+/* Delete by shifting later members of the probe chain back, as for the AIO slots */
+static void index_remove(SmgrStatsQueryTable* t, uint32 hole) {
+  int32* index = query_index(t);
+  for (uint32 i = (hole + 1) & t->index_mask; index[i] >= 0; i = (i + 1) & t->index_mask) {
+    uint32 home = query_key_hash(&t->entries[index[i]].key) & t->index_mask;
+    if (((i - home) & t->index_mask) >= ((i - hole) & t->index_mask)) {
+      index[hole] = index[i];
+      hole = i;
+    }
+  }
+  index[hole] = -1;
+}
+
+/* Space-Saving update for one batched pair. Caller holds the lock exclusively. */
+static void merge_pair(SmgrStatsQueryTable* t, const SmgrStatsQueryKey* key, const SmgrStatsQueryCounters* delta) {
+  int32* index = query_index(t);
+  uint32 pos = index_probe(t, key);
+  if (index[pos] >= 0) {
+    SmgrStatsQueryEntry* e = &t->entries[index[pos]];
+    counters_add(&e->counters, delta);
+    e->weight += counters_weight(delta);
+    return;
+  }
+
+  int32 victim;
+  uint64 inherited = 0;
+  if (t->used < t->capacity) {
+    victim = t->used++;
+  } else {
+    /* Replace the lightest pair; the newcomer inherits its weight as error */
+    victim = 0;
+    for (int i = 1; i < t->used; i++) {
+      if (t->entries[i].weight < t->entries[victim].weight) {
+        victim = i;
+      }
+    }
+    inherited = t->entries[victim].weight;
+    index_remove(t, index_probe(t, &t->entries[victim].key));
+    pos = index_probe(t, key); /* The removal may have shifted the chain */
+    smgr_stats_counter_add(SMGR_STATS_COUNTER_QUERY_EVICTIONS, 1);
+  }
+
+  SmgrStatsQueryEntry* e = &t->entries[victim];
+  e->key = *key;
+  e->counters = *delta;
+  e->error = inherited;
+  e->weight = inherited + counters_weight(delta);
+  index[pos] = victim;
+}
+
+static void query_before_shmem_exit(int code, Datum arg) {
+  (void)code;
+  (void)arg;
+  smgr_stats_query_flush();
+}
+
+void smgr_stats_query_flush(void) {
+  if (local_used == 0 || CritSectionCount > 0) {
+    return;
+  }
+
+  SmgrStatsQueryTable* t = get_query_table();
+  LWLockAcquire(&t->lock, LW_EXCLUSIVE);
+  for (int i = 0; i < SMGR_STATS_QUERY_LOCAL_SLOTS; i++) {
+    if (local_slots[i].used) {
+      merge_pair(t, &local_slots[i].key, &local_slots[i].counters);
+      local_slots[i].used = false;
+    }
+  }
+  LWLockRelease(&t->lock);
+
+  local_used = 0;
+  last_flush = GetCurrentTimestamp();
+  seen_flush_requests = smgr_stats_flush_requests();
+}
+
+void smgr_stats_query_record(int64 queryid, const SmgrStatsKey* key, const SmgrStatsQueryCounters* delta,
+                             TimestampTz now) {
+  SmgrStatsQueryKey qkey;
+  memset(&qkey, 0, sizeof(qkey)); /* Keys are hashed and compared as bytes */
+  qkey.queryid = queryid;
+  qkey.locator = key->locator;
+  qkey.forknum = key->forknum;
+
+  uint32 i = query_key_hash(&qkey) & (SMGR_STATS_QUERY_LOCAL_SLOTS - 1);
+  while (local_slots[i].used && !query_key_equal(&local_slots[i].key, &qkey)) {
+    i = (i + 1) & (SMGR_STATS_QUERY_LOCAL_SLOTS - 1);
+  }
+  if (!local_slots[i].used) {
+    /* Keep one slot free so probe loops terminate */
+    if (local_used >= SMGR_STATS_QUERY_LOCAL_SLOTS - 1) {
+      smgr_stats_counter_add(SMGR_STATS_COUNTER_QUERY_OPS_DROPPED, 1);
+      return;
+    }
+    local_slots[i].used = true;
+    local_slots[i].key = qkey;
+    memset(&local_slots[i].counters, 0, sizeof(SmgrStatsQueryCounters));
+    local_used++;
+  }
+  counters_add(&local_slots[i].counters, delta);
+
+  if (CritSectionCount > 0) {
+    return;
+  }
+  if (unlikely(!exit_callback_registered)) {
+    before_shmem_exit(query_before_shmem_exit, (Datum)0);
+    exit_callback_registered = true;
+  }
+  if (local_used >= SMGR_STATS_QUERY_LOCAL_FLUSH_AT || smgr_stats_flush_requests() != seen_flush_requests ||
+      TimestampDifferenceExceeds(last_flush, now, smgr_stats_backend_flush_interval)) {
+    smgr_stats_query_flush();
+  }
+}
+
+SmgrStatsQueryEntry* smgr_stats_query_snapshot(int* count, bool reset) {
+  SmgrStatsQueryTable* t = get_query_table();
+  LWLockAcquire(&t->lock, reset ? LW_EXCLUSIVE : LW_SHARED);
+  *count = t->used;
+  SmgrStatsQueryEntry* result = palloc(sizeof(SmgrStatsQueryEntry) * Max(t->used, 1));
+  memcpy(result, t->entries, sizeof(SmgrStatsQueryEntry) * t->used);
+  if (reset) {
+    t->used = 0;
+    memset(query_index(t), 0xff, sizeof(int32) * (t->index_mask + 1));
+  }
+  LWLockRelease(&t->lock);
+  return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "storage/relfilelocator.h"
+#include "utils/timestamp.h"
+
+#include "smgr_stats_store.h"
+
+/*
+ * Per-query I/O attribution (smgr_stats.query_top_n).
+ *
+ * Reads, writes and extends are also counted per (queryid, file), where the
+ * queryid is pgstat_get_my_query_id() (parallel workers report their
+ * leader's) and the file is the entry key the I/O was recorded under. Each
+ * backend batches its counts in a small fixed table and merges them into a
+ * shared table at the end of every statement, when its batch fills up, after
+ * smgr_stats.backend_flush_interval, or when the collector asks.
+ *
+ * The shared table keeps the smgr_stats.query_top_n heaviest pairs by blocks
+ * using Space-Saving: when it is full, a new pair replaces the lightest one and
+ * inherits its weight as an error bound, so every pair whose true weight
+ * exceeds total/top_n is guaranteed to be present. The collector persists and
+ * resets the table each bucket. I/O without a queryid (background processes,
+ * or compute_query_id = off) is not attributed.
+ */
+
+typedef struct SmgrStatsQueryCounters {
+  uint64 reads;
+  uint64 read_blocks;
+  uint64 read_us; /* Estimated from sampled timing */
+  uint64 writes;
+  uint64 write_blocks;
+  uint64 write_us;
+  uint64 extends;
+  uint64 extend_blocks;
+} SmgrStatsQueryCounters;
+
+typedef struct SmgrStatsQueryKey {
+  int64 queryid;
+  RelFileLocator locator;
+  ForkNumber forknum;
+} SmgrStatsQueryKey;
+
+typedef struct SmgrStatsQueryEntry {
+  SmgrStatsQueryKey key;
+  SmgrStatsQueryCounters counters;
+  uint64 weight; /* Blocks counted for the pair, including the inherited error */
+  uint64 error;  /* Weight inherited from the pair it replaced: an upper bound on the undercount */
+} SmgrStatsQueryEntry;
+
+/* Attribute one op to queryid and the file of key. Safe in critical sections (AIO
+ * completion): the count is only batched locally there, or dropped if the batch is full. */
+extern void smgr_stats_query_record(int64 queryid, const SmgrStatsKey* key, const SmgrStatsQueryCounters* delta,
+                                    TimestampTz now);
+
+/* Merge this backend's batch into the shared table. */
+extern void smgr_stats_query_flush(void);
+
+/* Copy the shared table, optionally resetting it (collector). Returns a palloc'd array and sets *count. */
+extern SmgrStatsQueryEntry* smgr_stats_query_snapshot(int* count, bool reset);
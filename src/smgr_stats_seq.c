@@ -3,15 +3,24 @@
 #include "storage/ipc.h"
 #include "utils/hsearch.h"
 
+#include "smgr_stats_guc.h"
+#include "smgr_stats_partition.h"
+#include "smgr_stats_pending.h"
 #include "smgr_stats_seq.h"
 #include "smgr_stats_store.h"
 
+/* Runs shorter than this never trigger read-ahead */
+#define SMGR_STATS_PREFETCH_MIN_RUN 8
+
 typedef struct SmgrStatsLocalPattern {
   SmgrStatsKey key;
   BlockNumber last_read_block;
   BlockNumber last_write_block;
   uint64 current_read_run;
   uint64 current_write_run;
+  double read_run_mean;      /* Moving average of this backend's completed read runs on the file */
+  double expected_run;       /* Length the current read run is expected to reach, -1 until looked up */
+  BlockNumber prefetched_to; /* Read-ahead already issued up to here (exclusive) */
 } SmgrStatsLocalPattern;
 
 static HTAB* local_pattern_cache = NULL;
@@ -28,9 +37,49 @@ static HTAB* get_pattern_cache(void) {
   return local_pattern_cache;
 }
 
-SmgrStatsSeqResult smgr_stats_check_sequential(const SmgrStatsKey* key, BlockNumber blocknum, BlockNumber nblocks,
-                                               bool is_read) {
-  SmgrStatsSeqResult result = {.is_sequential = false, .completed_run = 0};
+/*
+ * How far to read ahead of a sequential read run: the blocks it is expected
+ * to have left, prefetching up to where the file's read runs usually end.
+ * The expected length is the mean of the runs all backends completed on the
+ * shared entry this period, looked up once per run; this backend's own
+ * moving average stands in until the period has any. With no history at all
+ * the distance ramps up with the run. Runs that outgrow the usual length get
+ * nothing more.
+ */
+static BlockNumber prefetch_distance(SmgrStatsLocalPattern* pat, SmgrStatsSharedEntry* shared) {
+  double run = (double)pat->current_read_run;
+  if (run < SMGR_STATS_PREFETCH_MIN_RUN) {
+    return 0;
+  }
+  if (pat->expected_run < 0) {
+    pat->expected_run = shared ? smgr_stats_shared_read_run_mean(shared) : 0.0;
+    if (pat->expected_run == 0) {
+      pat->expected_run = pat->read_run_mean;
+    }
+  }
+  double distance = pat->expected_run == 0 ? run : Max(pat->expected_run - run, 0.0);
+  return (BlockNumber)Min(distance, (double)smgr_stats_prefetch_max_distance);
+}
+
+/* Ask for the next window once less than half the distance is left in flight, so
+ * prefetch requests cover many reads each. */
+static void plan_prefetch(SmgrStatsLocalPattern* pat, SmgrStatsSharedEntry* shared, BlockNumber next_block,
+                          SmgrStatsSeqResult* result) {
+  if (pat->prefetched_to == InvalidBlockNumber || pat->prefetched_to < next_block) {
+    pat->prefetched_to = next_block;
+  }
+  BlockNumber distance = prefetch_distance(pat, shared);
+  if (distance == 0 || pat->prefetched_to - next_block >= distance / 2) {
+    return;
+  }
+  result->prefetch_from = pat->prefetched_to;
+  result->prefetch_nblocks = next_block + distance - pat->prefetched_to;
+  pat->prefetched_to = next_block + distance;
+}
+
+SmgrStatsSeqResult smgr_stats_check_sequential(const SmgrStatsKey* key, SmgrStatsSharedEntry* shared,
+                                               BlockNumber blocknum, BlockNumber nblocks, bool is_read) {
+  SmgrStatsSeqResult result = {.is_sequential = false, .completed_run = 0, .prefetch_nblocks = 0};
   bool found;
   SmgrStatsLocalPattern* pat = hash_search(get_pattern_cache(), key, HASH_ENTER, &found);
 
@@ -40,6 +89,9 @@ SmgrStatsSeqResult smgr_stats_check_sequential(const SmgrStatsKey* key, BlockNum
     pat->last_write_block = InvalidBlockNumber;
     pat->current_read_run = 0;
     pat->current_write_run = 0;
+    pat->read_run_mean = 0;
+    pat->expected_run = -1;
+    pat->prefetched_to = InvalidBlockNumber;
   }
 
   BlockNumber* last_block;
@@ -63,6 +115,21 @@ SmgrStatsSeqResult smgr_stats_check_sequential(const SmgrStatsKey* key, BlockNum
   }
 
   *last_block = blocknum + nblocks - 1;
+
+  if (is_read) {
+    if (!result.is_sequential) {
+      pat->prefetched_to = InvalidBlockNumber; /* Read-ahead of the previous run is no longer useful */
+      pat->expected_run = -1;
+    }
+    if (result.completed_run > 0) {
+      pat->read_run_mean = pat->read_run_mean == 0
+                               ? (double)result.completed_run
+                               : pat->read_run_mean + ((double)result.completed_run - pat->read_run_mean) / 4;
+    }
+    if (smgr_stats_adaptive_prefetch) {
+      plan_prefetch(pat, shared, blocknum + nblocks, &result);
+    }
+  }
   return result;
 }
 
@@ -84,16 +151,46 @@ void smgr_stats_flush_runs(int code, Datum arg) {
       continue;
     }
 
-    SmgrStatsEntry* entry = smgr_stats_find_entry(&pat->key);
-    if (!entry) {
-      continue;
+    /* Runs are detected per real fork but recorded where the fork's I/O went */
+    SmgrStatsKey key = pat->key;
+    if (smgr_stats_fold_forks) {
+      key.forknum = MAIN_FORKNUM;
+    }
+    if (smgr_stats_track_partitions == SMGR_STATS_PARTITIONS_AGGREGATE) {
+      smgr_stats_partition_map_key(&key);
+    }
+    key.backend_type = smgr_stats_key_backend_type();
+
+    /* Prefer the backend-local pending entry if this key is being buffered */
+    SmgrStatsPendingEntry* pending = smgr_stats_pending_get(&key, false);
+    SmgrStatsSharedEntry* shared = NULL;
+    SmgrStatsShard* shard = NULL;
+    SmgrStatsRunDist* read_runs;
+    SmgrStatsRunDist* write_runs;
+    if (pending) {
+      read_runs = &pending->stats.read_runs;
+      write_runs = &pending->stats.write_runs;
+    } else {
+      shared = smgr_stats_pin_entry(&key, false, NULL);
+      if (!shared) {
+        continue;
+      }
+      shard = smgr_stats_lock_shard(shared);
+      read_runs = &shard->read_runs;
+      write_runs = &shard->write_runs;
     }
     if (has_read_run) {
-      smgr_stats_welford_record(&entry->read_runs, (double)pat->current_read_run);
+      smgr_stats_welford_record(read_runs, (double)pat->current_read_run);
     }
     if (has_write_run) {
-      smgr_stats_welford_record(&entry->write_runs, (double)pat->current_write_run);
+      smgr_stats_welford_record(write_runs, (double)pat->current_write_run);
+    }
+    if (shared) {
+      smgr_stats_unlock_shard(shard);
+      smgr_stats_unpin_entry(shared);
     }
-    smgr_stats_release_entry(entry);
   }
+
+  /* The pending exit callback may already have run; push the runs recorded above */
+  smgr_stats_pending_flush();
 }
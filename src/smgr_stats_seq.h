@@ -7,13 +7,17 @@
 
 typedef struct SmgrStatsSeqResult {
   bool is_sequential;
-  uint64 completed_run; /* 0 if no run was completed */
+  uint64 completed_run;         /* 0 if no run was completed */
+  BlockNumber prefetch_from;    /* With adaptive_prefetch: read-ahead window to issue, */
+  BlockNumber prefetch_nblocks; /* 0 blocks if none (not clamped to the file size) */
 } SmgrStatsSeqResult;
 
-/* Check whether an I/O operation continues a sequential streak.
+/* Check whether an I/O operation continues a sequential streak, and for reads with
+ * smgr_stats.adaptive_prefetch, plan read-ahead up to where the file's read runs usually
+ * end, as recorded in shared (the pinned entry the read goes to, NULL if not resolved yet).
  * Uses a backend-local cache; safe to call from AIO complete_local callbacks. */
-extern SmgrStatsSeqResult smgr_stats_check_sequential(const SmgrStatsKey* key, BlockNumber blocknum,
-                                                      BlockNumber nblocks, bool is_read);
+extern SmgrStatsSeqResult smgr_stats_check_sequential(const SmgrStatsKey* key, SmgrStatsSharedEntry* shared,
+                                                      BlockNumber blocknum, BlockNumber nblocks, bool is_read);
 
 /* Flush any in-progress sequential runs to shared memory (on_shmem_exit callback). */
 extern void smgr_stats_flush_runs(int code, Datum arg);
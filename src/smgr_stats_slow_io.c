@@ -0,0 +1,130 @@
+#include "postgres.h"
+
+#include "port/atomics.h"
+#include "storage/dsm_registry.h"
+
+#include "smgr_stats_slow_io.h"
+#include "smgr_stats_store.h"
+
+/* Sequence number of a slot while a writer fills it */
+#define SLOW_IO_WRITING PG_UINT64_MAX
+
+typedef struct SmgrStatsSlowIOSlot {
+  pg_atomic_uint64 seq; /* 0 if never written, position + 1 once complete, SLOW_IO_WRITING in between */
+  SmgrStatsSlowIO io;
+} SmgrStatsSlowIOSlot;
+
+typedef struct SmgrStatsSlowIORing {
+  pg_atomic_uint64 head;      /* Next position to take */
+  pg_atomic_uint64 collected; /* Positions below this were persisted (or dropped) by the collector */
+  SmgrStatsSlowIOSlot slots[SMGR_STATS_SLOW_IO_RING];
+} SmgrStatsSlowIORing;
+
+static SmgrStatsSlowIORing* slow_io_ring = NULL;
+
+/* Collector: the unpublished position the last collection stopped at */
+static uint64 stalled_pos = PG_UINT64_MAX;
+
+static void slow_io_ring_init(void* ptr, void* arg) {
+  (void)arg;
+  SmgrStatsSlowIORing* ring = ptr;
+  pg_atomic_init_u64(&ring->head, 0);
+  pg_atomic_init_u64(&ring->collected, 0);
+  for (int i = 0; i < SMGR_STATS_SLOW_IO_RING; i++) {
+    pg_atomic_init_u64(&ring->slots[i].seq, 0);
+  }
+}
+
+static SmgrStatsSlowIORing* get_slow_io_ring(void) {
+  if (!slow_io_ring) {
+    bool found;
+    slow_io_ring =
+        GetNamedDSMSegment("pg_smgrstat_slow_io", sizeof(SmgrStatsSlowIORing), slow_io_ring_init, &found, NULL);
+  }
+  return slow_io_ring;
+}
+
+void smgr_stats_slow_io_record(const SmgrStatsSlowIO* io) {
+  if (!slow_io_ring && CritSectionCount > 0) {
+    return; /* Attaching allocates */
+  }
+  SmgrStatsSlowIORing* ring = get_slow_io_ring();
+
+  uint64 pos = pg_atomic_fetch_add_u64(&ring->head, 1);
+  SmgrStatsSlowIOSlot* slot = &ring->slots[pos % SMGR_STATS_SLOW_IO_RING];
+
+  /*
+   * Claim the slot only from an older position. If it is being written (the ring wrapped around
+   * within one write) or already holds a newer position, give up: the collector counts this
+   * position as dropped.
+   */
+  uint64 seq = pg_atomic_read_u64(&slot->seq);
+  while (seq < pos + 1) {
+    if (pg_atomic_compare_exchange_u64(&slot->seq, &seq, SLOW_IO_WRITING)) {
+      slot->io = *io;
+      pg_write_barrier();
+      pg_atomic_write_u64(&slot->seq, pos + 1);
+      return;
+    }
+  }
+}
+
+SmgrStatsSlowIO* smgr_stats_slow_io_snapshot(int* count, bool consume) {
+  SmgrStatsSlowIORing* ring = get_slow_io_ring();
+  SmgrStatsSlowIO* result = palloc(sizeof(SmgrStatsSlowIO) * SMGR_STATS_SLOW_IO_RING);
+
+  uint64 head = pg_atomic_read_u64(&ring->head);
+  uint64 from = pg_atomic_read_u64(&ring->collected);
+  uint64 overwritten = 0;
+  if (head - from > SMGR_STATS_SLOW_IO_RING) {
+    overwritten = head - from - SMGR_STATS_SLOW_IO_RING;
+    from = head - SMGR_STATS_SLOW_IO_RING;
+  }
+
+  uint64 dropped = overwritten;
+  uint64 collected = head;
+  *count = 0;
+  for (uint64 pos = from; pos < head; pos++) {
+    SmgrStatsSlowIOSlot* slot = &ring->slots[pos % SMGR_STATS_SLOW_IO_RING];
+    uint64 seq = pg_atomic_read_u64(&slot->seq);
+    if (seq == pos + 1) {
+      pg_read_barrier();
+      SmgrStatsSlowIO io = slot->io;
+      pg_read_barrier();
+      if (pg_atomic_read_u64(&slot->seq) == pos + 1) {
+        result[(*count)++] = io;
+      } else {
+        dropped++; /* Overwritten by a newer position while copying */
+      }
+      continue;
+    }
+    if (seq != SLOW_IO_WRITING && seq > pos + 1) {
+      dropped++; /* Its writer gave up, or a newer position overwrote it */
+      continue;
+    }
+
+    /*
+     * Not published yet. The collector stops here and picks it up next time, unless it stopped
+     * here last time too: a write takes microseconds, so its writer gave up.
+     */
+    if (!consume) {
+      continue;
+    }
+    if (pos == stalled_pos) {
+      dropped++;
+      continue;
+    }
+    stalled_pos = pos;
+    collected = pos;
+    break;
+  }
+
+  /* Only the collector consumes, so a plain write is enough */
+  if (consume) {
+    pg_atomic_write_u64(&ring->collected, collected);
+    if (dropped > 0) {
+      smgr_stats_counter_add(SMGR_STATS_COUNTER_SLOW_IO_DROPPED, dropped);
+    }
+  }
+  return result;
+}
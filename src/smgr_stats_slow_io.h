@@ -0,0 +1,44 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "smgr_stats_inflight.h"
+
+/*
+ * Outlier capture: every tracked I/O that takes at least
+ * smgr_stats.slow_io_threshold is recorded with its block range, backend and
+ * time, which the latency histograms can't tell.
+ *
+ * Records go into a fixed ring of SMGR_STATS_SLOW_IO_RING slots in a named
+ * DSM segment. Writers take a position with an atomic increment and claim its
+ * slot with a compare-and-swap on the slot's sequence number, which holds the
+ * position + 1 once the record is complete. A slot is only claimed from an
+ * older position, so a slow writer never replaces a newer record. There are no
+ * locks, so recording is safe in critical sections. The collector persists the
+ * records of each bucket into smgr_stats.slow_io, stopping at a record still
+ * being written. Records overwritten before they were collected, or whose
+ * writer gave up, are counted as slow_io_dropped.
+ */
+
+#define SMGR_STATS_SLOW_IO_RING 1024
+
+typedef struct SmgrStatsSlowIO {
+  SmgrStatsInflightOp op;
+  RelFileLocator locator;
+  ForkNumber forknum;
+  BlockNumber blocknum; /* InvalidBlockNumber if the op has no block range */
+  BlockNumber nblocks;
+  uint64 elapsed_us;
+  int pid;
+  BackendType backend_type;
+  TimestampTz completed_at;
+} SmgrStatsSlowIO;
+
+/* Record a slow I/O. Dropped if the ring slot is being written by another process. */
+extern void smgr_stats_slow_io_record(const SmgrStatsSlowIO* io);
+
+/* Copy the records not yet collected, oldest first, optionally marking them collected (collector).
+ * Returns a palloc'd array. */
+extern SmgrStatsSlowIO* smgr_stats_slow_io_snapshot(int* count, bool consume);
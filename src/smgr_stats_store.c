@@ -6,6 +6,7 @@
 #include "access/xact.h"
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
+#include "catalog/partition.h"
 #include "catalog/pg_class.h"
 #include "catalog/pg_namespace.h"
 #include "catalog/pg_tablespace_d.h"
@@ -20,6 +21,9 @@
 #include "utils/relfilenumbermap.h"
 #include "utils/syscache.h"
 
+#include "smgr_stats_filter.h"
+#include "smgr_stats_guc.h"
+#include "smgr_stats_partition.h"
 #include "smgr_stats_store.h"
 
 /* Ring buffer size for relfile associations. Must be power of 2. */
@@ -34,6 +38,8 @@ typedef struct SmgrStatsRelfileQueue {
 
 typedef struct SmgrStatsControl {
   pg_atomic_uint64 bucket_id;
+  pg_atomic_uint64 flush_requests; /* Bumped by the collector to ask backends to flush pending stats */
+  pg_atomic_uint64 counters[SMGR_STATS_NUM_COUNTERS];
   SmgrStatsRelfileQueue relfile_queue;
 } SmgrStatsControl;
 
@@ -44,6 +50,10 @@ static void stats_control_init(void* ptr, void* arg) {
   (void)arg;
   SmgrStatsControl* ctl = (SmgrStatsControl*)ptr;
   pg_atomic_init_u64(&ctl->bucket_id, 1);
+  pg_atomic_init_u64(&ctl->flush_requests, 0);
+  for (int i = 0; i < SMGR_STATS_NUM_COUNTERS; i++) {
+    pg_atomic_init_u64(&ctl->counters[i], 0);
+  }
   pg_atomic_init_u64(&ctl->relfile_queue.head, 0);
   pg_atomic_init_u64(&ctl->relfile_queue.tail, 0);
 }
@@ -58,7 +68,7 @@ static SmgrStatsControl* get_control(void) {
 
 static const dshash_parameters smgr_stats_hash_params = {
     .key_size = sizeof(SmgrStatsKey),
-    .entry_size = sizeof(SmgrStatsEntry),
+    .entry_size = sizeof(SmgrStatsSharedEntry),
     .compare_function = dshash_memcmp,
     .hash_function = dshash_memhash,
     .copy_function = dshash_memcpy,
@@ -72,7 +82,7 @@ static dshash_table* get_hash(void) {
   return stats_hash;
 }
 
-static void smgr_stats_entry_reset(SmgrStatsEntry* entry) {
+void smgr_stats_entry_reset(SmgrStatsEntry* entry) {
   entry->reads = 0;
   entry->read_blocks = 0;
   entry->writes = 0;
@@ -80,9 +90,18 @@ static void smgr_stats_entry_reset(SmgrStatsEntry* entry) {
   entry->extends = 0;
   entry->extend_blocks = 0;
   entry->truncates = 0;
+  entry->truncated_blocks = 0;
   entry->fsyncs = 0;
   smgr_stats_hist_reset(&entry->read_timing);
   smgr_stats_hist_reset(&entry->write_timing);
+  smgr_stats_hist_reset(&entry->throttle_timing);
+  smgr_stats_hist_reset(&entry->extend_timing);
+  smgr_stats_hist_reset(&entry->zeroextend_timing);
+  smgr_stats_hist_reset(&entry->truncate_timing);
+  smgr_stats_hist_reset(&entry->fsync_timing);
+  for (int p = 0; p < SMGR_STATS_NUM_AIO_PHASES; p++) {
+    smgr_stats_hist_reset(&entry->aio_phase_timing[p]);
+  }
   smgr_stats_welford_reset(&entry->read_burst.iat);
   smgr_stats_welford_reset(&entry->write_burst.iat);
   /* last_op_time preserved for correct IAT across period boundaries */
@@ -96,46 +115,452 @@ static void smgr_stats_entry_reset(SmgrStatsEntry* entry) {
   /* last_active_second preserved for correct dedup across period boundaries */
   entry->first_access = 0;
   entry->last_access = 0;
+  entry->timing_sample_rate = 0;
+  memset(&entry->forks, 0, sizeof(SmgrStatsForkCounters));
+  memset(&entry->meta_ops, 0, sizeof(SmgrStatsMetaOpCounters));
+  memset(&entry->sizes, 0, sizeof(SmgrStatsSizeCounters));
+}
+
+void smgr_stats_entry_init(SmgrStatsEntry* entry) {
+  smgr_stats_entry_reset(entry);
+  entry->last_active_second = 0;
+  entry->read_burst.last_op_time = 0;
+  entry->write_burst.last_op_time = 0;
+  /* Initialize metadata fields */
+  entry->meta.reloid = InvalidOid;
+  entry->meta.main_reloid = InvalidOid;
+  entry->meta.relkind = '\0';
+  memset(&entry->meta.relname, 0, sizeof(NameData));
+  memset(&entry->meta.nspname, 0, sizeof(NameData));
+  entry->meta.metadata_valid = false;
+}
+
+void smgr_stats_entry_merge(SmgrStatsEntry* dst, const SmgrStatsEntry* src) {
+  dst->reads += src->reads;
+  dst->read_blocks += src->read_blocks;
+  dst->writes += src->writes;
+  dst->write_blocks += src->write_blocks;
+  dst->extends += src->extends;
+  dst->extend_blocks += src->extend_blocks;
+  dst->truncates += src->truncates;
+  dst->truncated_blocks += src->truncated_blocks;
+  dst->fsyncs += src->fsyncs;
+  smgr_stats_hist_merge(&dst->read_timing, &src->read_timing);
+  smgr_stats_hist_merge(&dst->write_timing, &src->write_timing);
+  smgr_stats_hist_merge(&dst->throttle_timing, &src->throttle_timing);
+  smgr_stats_hist_merge(&dst->extend_timing, &src->extend_timing);
+  smgr_stats_hist_merge(&dst->zeroextend_timing, &src->zeroextend_timing);
+  smgr_stats_hist_merge(&dst->truncate_timing, &src->truncate_timing);
+  smgr_stats_hist_merge(&dst->fsync_timing, &src->fsync_timing);
+  for (int p = 0; p < SMGR_STATS_NUM_AIO_PHASES; p++) {
+    smgr_stats_hist_merge(&dst->aio_phase_timing[p], &src->aio_phase_timing[p]);
+  }
+  smgr_stats_welford_merge(&dst->read_burst.iat, &src->read_burst.iat);
+  smgr_stats_welford_merge(&dst->write_burst.iat, &src->write_burst.iat);
+  dst->read_burst.last_op_time = Max(dst->read_burst.last_op_time, src->read_burst.last_op_time);
+  dst->write_burst.last_op_time = Max(dst->write_burst.last_op_time, src->write_burst.last_op_time);
+  dst->sequential_reads += src->sequential_reads;
+  dst->random_reads += src->random_reads;
+  dst->sequential_writes += src->sequential_writes;
+  dst->random_writes += src->random_writes;
+  smgr_stats_welford_merge(&dst->read_runs, &src->read_runs);
+  smgr_stats_welford_merge(&dst->write_runs, &src->write_runs);
+  dst->timing_sample_rate = Max(dst->timing_sample_rate, src->timing_sample_rate);
+  for (int f = 0; f <= MAX_FORKNUM; f++) {
+    dst->forks.reads[f] += src->forks.reads[f];
+    dst->forks.writes[f] += src->forks.writes[f];
+    dst->forks.extends[f] += src->forks.extends[f];
+  }
+  for (int m = 0; m < SMGR_STATS_NUM_META_OPS; m++) {
+    dst->meta_ops.calls[m] += src->meta_ops.calls[m];
+    dst->meta_ops.blocks[m] += src->meta_ops.blocks[m];
+    dst->meta_ops.time_us[m] += src->meta_ops.time_us[m];
+  }
+  for (int b = 0; b < SMGR_STATS_SIZE_BINS; b++) {
+    dst->sizes.reads[b] += src->sizes.reads[b];
+    dst->sizes.writes[b] += src->sizes.writes[b];
+    dst->sizes.zeroextends[b] += src->sizes.zeroextends[b];
+  }
+
+  if (src->first_access == 0) {
+    return;
+  }
+
+  /*
+   * Activity: src's first second may be the same second dst saw last, so don't
+   * count it twice. Seconds seen by different backends can still overlap, so
+   * clamp to the span between first and last access (an exact upper bound).
+   */
+  uint32 active = src->active_seconds;
+  if (active > 0 && src->first_access / USECS_PER_SEC == dst->last_active_second) {
+    active--;
+  }
+  dst->active_seconds += active;
+  dst->last_active_second = Max(dst->last_active_second, src->last_active_second);
+  if (dst->first_access == 0 || src->first_access < dst->first_access) {
+    dst->first_access = src->first_access;
+  }
+  dst->last_access = Max(dst->last_access, src->last_access);
+  int64 span = (dst->last_access / USECS_PER_SEC) - (dst->first_access / USECS_PER_SEC) + 1;
+  if ((int64)dst->active_seconds > span) {
+    dst->active_seconds = (uint32)span;
+  }
+}
+
+static void shared_entry_init(SmgrStatsSharedEntry* shared) {
+  /* The key was filled in by dshash; borrow entry_init for the metadata defaults */
+  SmgrStatsEntry defaults;
+  smgr_stats_entry_init(&defaults);
+  shared->meta = defaults.meta;
+
+  pg_atomic_init_u32(&shared->refcount, 0);
+  pg_atomic_init_u64(&shared->reads, 0);
+  pg_atomic_init_u64(&shared->read_blocks, 0);
+  pg_atomic_init_u64(&shared->writes, 0);
+  pg_atomic_init_u64(&shared->write_blocks, 0);
+  pg_atomic_init_u64(&shared->extends, 0);
+  pg_atomic_init_u64(&shared->extend_blocks, 0);
+  pg_atomic_init_u64(&shared->truncates, 0);
+  pg_atomic_init_u64(&shared->truncated_blocks, 0);
+  pg_atomic_init_u64(&shared->fsyncs, 0);
+  pg_atomic_init_u64(&shared->sequential_reads, 0);
+  pg_atomic_init_u64(&shared->random_reads, 0);
+  pg_atomic_init_u64(&shared->sequential_writes, 0);
+  pg_atomic_init_u64(&shared->random_writes, 0);
+  smgr_stats_atomic_hist_init(&shared->read_timing);
+  smgr_stats_atomic_hist_init(&shared->write_timing);
+  smgr_stats_atomic_hist_init(&shared->throttle_timing);
+  smgr_stats_atomic_hist_init(&shared->extend_timing);
+  smgr_stats_atomic_hist_init(&shared->zeroextend_timing);
+  smgr_stats_atomic_hist_init(&shared->truncate_timing);
+  smgr_stats_atomic_hist_init(&shared->fsync_timing);
+  for (int p = 0; p < SMGR_STATS_NUM_AIO_PHASES; p++) {
+    smgr_stats_atomic_hist_init(&shared->aio_phase_timing[p]);
+  }
+  pg_atomic_init_u64(&shared->read_last_op_time, 0);
+  pg_atomic_init_u64(&shared->write_last_op_time, 0);
+  pg_atomic_init_u32(&shared->active_seconds, 0);
+  pg_atomic_init_u64(&shared->last_active_second, 0);
+  pg_atomic_init_u64(&shared->first_access, 0);
+  pg_atomic_init_u64(&shared->last_access, 0);
+  pg_atomic_init_u64(&shared->timing_sample_rate, 0);
+  for (int f = 0; f <= MAX_FORKNUM; f++) {
+    pg_atomic_init_u64(&shared->forks.reads[f], 0);
+    pg_atomic_init_u64(&shared->forks.writes[f], 0);
+    pg_atomic_init_u64(&shared->forks.extends[f], 0);
+  }
+  for (int m = 0; m < SMGR_STATS_NUM_META_OPS; m++) {
+    pg_atomic_init_u64(&shared->meta_ops.calls[m], 0);
+    pg_atomic_init_u64(&shared->meta_ops.blocks[m], 0);
+    pg_atomic_init_u64(&shared->meta_ops.time_us[m], 0);
+  }
+  for (int b = 0; b < SMGR_STATS_SIZE_BINS; b++) {
+    pg_atomic_init_u64(&shared->sizes.reads[b], 0);
+    pg_atomic_init_u64(&shared->sizes.writes[b], 0);
+    pg_atomic_init_u64(&shared->sizes.zeroextends[b], 0);
+  }
+  pg_atomic_init_u32(&shared->contention, 0);
+  pg_atomic_init_u32(&shared->striped, 0);
+  for (int i = 0; i < SMGR_STATS_SHARDS; i++) {
+    SmgrStatsShard* shard = &shared->shards[i].shard;
+    SpinLockInit(&shard->mutex);
+    smgr_stats_welford_reset(&shard->read_iat);
+    smgr_stats_welford_reset(&shard->write_iat);
+    smgr_stats_welford_reset(&shard->read_runs);
+    smgr_stats_welford_reset(&shard->write_runs);
+  }
+}
+
+SmgrStatsSharedEntry* smgr_stats_pin_entry(const SmgrStatsKey* key, bool create, bool* needs_metadata) {
+  dshash_table* hash = get_hash();
+  SmgrStatsSharedEntry* shared;
+  bool found = true;
+
+  if (create && CritSectionCount == 0) {
+    shared = dshash_find_or_insert(hash, key, &found);
+    if (!found) {
+      shared_entry_init(shared);
+    }
+  } else {
+    /* A shared lock is enough: the refcount is atomic and eviction needs the exclusive lock */
+    shared = dshash_find(hash, key, false);
+    if (!shared) {
+      return NULL;
+    }
+  }
+
+  pg_atomic_fetch_add_u32(&shared->refcount, 1);
+  if (needs_metadata) {
+    *needs_metadata = !found || !shared->meta.metadata_valid;
+  }
+  dshash_release_lock(hash, shared);
+  return shared;
+}
+
+void smgr_stats_shared_add(SmgrStatsSharedEntry* shared, const SmgrStatsEntry* src) {
+  if (src->first_access == 0) {
+    return; /* Nothing recorded since the last flush */
+  }
+
+  pg_atomic_fetch_add_u64(&shared->reads, src->reads);
+  pg_atomic_fetch_add_u64(&shared->read_blocks, src->read_blocks);
+  pg_atomic_fetch_add_u64(&shared->writes, src->writes);
+  pg_atomic_fetch_add_u64(&shared->write_blocks, src->write_blocks);
+  pg_atomic_fetch_add_u64(&shared->extends, src->extends);
+  pg_atomic_fetch_add_u64(&shared->extend_blocks, src->extend_blocks);
+  pg_atomic_fetch_add_u64(&shared->truncates, src->truncates);
+  pg_atomic_fetch_add_u64(&shared->truncated_blocks, src->truncated_blocks);
+  pg_atomic_fetch_add_u64(&shared->fsyncs, src->fsyncs);
+  pg_atomic_fetch_add_u64(&shared->sequential_reads, src->sequential_reads);
+  pg_atomic_fetch_add_u64(&shared->random_reads, src->random_reads);
+  pg_atomic_fetch_add_u64(&shared->sequential_writes, src->sequential_writes);
+  pg_atomic_fetch_add_u64(&shared->random_writes, src->random_writes);
+  smgr_stats_atomic_hist_add(&shared->read_timing, &src->read_timing);
+  smgr_stats_atomic_hist_add(&shared->write_timing, &src->write_timing);
+  smgr_stats_atomic_hist_add(&shared->throttle_timing, &src->throttle_timing);
+  smgr_stats_atomic_hist_add(&shared->extend_timing, &src->extend_timing);
+  smgr_stats_atomic_hist_add(&shared->zeroextend_timing, &src->zeroextend_timing);
+  smgr_stats_atomic_hist_add(&shared->truncate_timing, &src->truncate_timing);
+  smgr_stats_atomic_hist_add(&shared->fsync_timing, &src->fsync_timing);
+  for (int p = 0; p < SMGR_STATS_NUM_AIO_PHASES; p++) {
+    smgr_stats_atomic_hist_add(&shared->aio_phase_timing[p], &src->aio_phase_timing[p]);
+  }
+  pg_atomic_monotonic_advance_u64(&shared->read_last_op_time, (uint64)src->read_burst.last_op_time);
+  pg_atomic_monotonic_advance_u64(&shared->write_last_op_time, (uint64)src->write_burst.last_op_time);
+  pg_atomic_monotonic_advance_u64(&shared->timing_sample_rate, src->timing_sample_rate);
+  for (int f = 0; f <= MAX_FORKNUM; f++) {
+    if (src->forks.reads[f] | src->forks.writes[f] | src->forks.extends[f]) {
+      pg_atomic_fetch_add_u64(&shared->forks.reads[f], src->forks.reads[f]);
+      pg_atomic_fetch_add_u64(&shared->forks.writes[f], src->forks.writes[f]);
+      pg_atomic_fetch_add_u64(&shared->forks.extends[f], src->forks.extends[f]);
+    }
+  }
+  for (int m = 0; m < SMGR_STATS_NUM_META_OPS; m++) {
+    if (src->meta_ops.calls[m] > 0) {
+      pg_atomic_fetch_add_u64(&shared->meta_ops.calls[m], src->meta_ops.calls[m]);
+      pg_atomic_fetch_add_u64(&shared->meta_ops.blocks[m], src->meta_ops.blocks[m]);
+      pg_atomic_fetch_add_u64(&shared->meta_ops.time_us[m], src->meta_ops.time_us[m]);
+    }
+  }
+  for (int b = 0; b < SMGR_STATS_SIZE_BINS; b++) {
+    if (src->sizes.reads[b] | src->sizes.writes[b] | src->sizes.zeroextends[b]) {
+      pg_atomic_fetch_add_u64(&shared->sizes.reads[b], src->sizes.reads[b]);
+      pg_atomic_fetch_add_u64(&shared->sizes.writes[b], src->sizes.writes[b]);
+      pg_atomic_fetch_add_u64(&shared->sizes.zeroextends[b], src->sizes.zeroextends[b]);
+    }
+  }
+
+  SmgrStatsShard* shard = smgr_stats_lock_shard(shared);
+  smgr_stats_welford_merge(&shard->read_iat, &src->read_burst.iat);
+  smgr_stats_welford_merge(&shard->write_iat, &src->write_burst.iat);
+  smgr_stats_welford_merge(&shard->read_runs, &src->read_runs);
+  smgr_stats_welford_merge(&shard->write_runs, &src->write_runs);
+  smgr_stats_unlock_shard(shard);
+
+  /* src's first second may be the one the shared entry saw last, don't count it twice */
+  uint32 active = src->active_seconds;
+  if (active > 0 && (uint64)(src->first_access / USECS_PER_SEC) == pg_atomic_read_u64(&shared->last_active_second)) {
+    active--;
+  }
+  pg_atomic_fetch_add_u32(&shared->active_seconds, active);
+  pg_atomic_monotonic_advance_u64(&shared->last_active_second, (uint64)src->last_active_second);
+  uint64 unset = 0;
+  if (!pg_atomic_compare_exchange_u64(&shared->first_access, &unset, (uint64)src->first_access)) {
+    smgr_stats_atomic_min_u64(&shared->first_access, (uint64)src->first_access);
+  }
+  pg_atomic_monotonic_advance_u64(&shared->last_access, (uint64)src->last_access);
+}
+
+double smgr_stats_shared_read_run_mean(SmgrStatsSharedEntry* shared) {
+  SmgrStatsRunDist runs;
+  smgr_stats_welford_reset(&runs);
+  for (int i = 0; i < SMGR_STATS_SHARDS; i++) {
+    SmgrStatsShard* shard = &shared->shards[i].shard;
+    SpinLockAcquire(&shard->mutex);
+    smgr_stats_welford_merge(&runs, &shard->read_runs);
+    SpinLockRelease(&shard->mutex);
+  }
+  return runs.count > 0 ? runs.mean : 0.0;
+}
+
+SmgrStatsSharedEntry* smgr_stats_find_entry(const SmgrStatsKey* key) { return dshash_find(get_hash(), key, true); }
+
+void smgr_stats_release_entry(SmgrStatsSharedEntry* entry) { dshash_release_lock(get_hash(), entry); }
+
+#define READ_COUNTER(field) (reset ? pg_atomic_exchange_u64(&(field), 0) : pg_atomic_read_u64(&(field)))
+
+/* Copy a shared entry into its plain form, optionally resetting the per-period state. */
+static void read_shared_entry(SmgrStatsSharedEntry* shared, SmgrStatsEntry* out, bool reset) {
+  smgr_stats_entry_init(out);
+  out->key = shared->key;
+  out->meta = shared->meta;
+
+  out->reads = READ_COUNTER(shared->reads);
+  out->read_blocks = READ_COUNTER(shared->read_blocks);
+  out->writes = READ_COUNTER(shared->writes);
+  out->write_blocks = READ_COUNTER(shared->write_blocks);
+  out->extends = READ_COUNTER(shared->extends);
+  out->extend_blocks = READ_COUNTER(shared->extend_blocks);
+  out->truncates = READ_COUNTER(shared->truncates);
+  out->truncated_blocks = READ_COUNTER(shared->truncated_blocks);
+  out->fsyncs = READ_COUNTER(shared->fsyncs);
+  out->sequential_reads = READ_COUNTER(shared->sequential_reads);
+  out->random_reads = READ_COUNTER(shared->random_reads);
+  out->sequential_writes = READ_COUNTER(shared->sequential_writes);
+  out->random_writes = READ_COUNTER(shared->random_writes);
+  out->timing_sample_rate = (uint32)READ_COUNTER(shared->timing_sample_rate);
+  for (int f = 0; f <= MAX_FORKNUM; f++) {
+    out->forks.reads[f] = READ_COUNTER(shared->forks.reads[f]);
+    out->forks.writes[f] = READ_COUNTER(shared->forks.writes[f]);
+    out->forks.extends[f] = READ_COUNTER(shared->forks.extends[f]);
+  }
+  for (int m = 0; m < SMGR_STATS_NUM_META_OPS; m++) {
+    out->meta_ops.calls[m] = READ_COUNTER(shared->meta_ops.calls[m]);
+    out->meta_ops.blocks[m] = READ_COUNTER(shared->meta_ops.blocks[m]);
+    out->meta_ops.time_us[m] = READ_COUNTER(shared->meta_ops.time_us[m]);
+  }
+  for (int b = 0; b < SMGR_STATS_SIZE_BINS; b++) {
+    out->sizes.reads[b] = READ_COUNTER(shared->sizes.reads[b]);
+    out->sizes.writes[b] = READ_COUNTER(shared->sizes.writes[b]);
+    out->sizes.zeroextends[b] = READ_COUNTER(shared->sizes.zeroextends[b]);
+  }
+  smgr_stats_atomic_hist_read(&shared->read_timing, &out->read_timing, reset);
+  smgr_stats_atomic_hist_read(&shared->write_timing, &out->write_timing, reset);
+  smgr_stats_atomic_hist_read(&shared->throttle_timing, &out->throttle_timing, reset);
+  smgr_stats_atomic_hist_read(&shared->extend_timing, &out->extend_timing, reset);
+  smgr_stats_atomic_hist_read(&shared->zeroextend_timing, &out->zeroextend_timing, reset);
+  smgr_stats_atomic_hist_read(&shared->truncate_timing, &out->truncate_timing, reset);
+  smgr_stats_atomic_hist_read(&shared->fsync_timing, &out->fsync_timing, reset);
+  for (int p = 0; p < SMGR_STATS_NUM_AIO_PHASES; p++) {
+    smgr_stats_atomic_hist_read(&shared->aio_phase_timing[p], &out->aio_phase_timing[p], reset);
+  }
+
+  /* Not reset: needed for correct IAT and dedup across period boundaries */
+  out->read_burst.last_op_time = (TimestampTz)pg_atomic_read_u64(&shared->read_last_op_time);
+  out->write_burst.last_op_time = (TimestampTz)pg_atomic_read_u64(&shared->write_last_op_time);
+  out->last_active_second = (int64)pg_atomic_read_u64(&shared->last_active_second);
+  out->active_seconds = reset ? pg_atomic_exchange_u32(&shared->active_seconds, 0)
+                              : pg_atomic_read_u32(&shared->active_seconds);
+
+  for (int i = 0; i < SMGR_STATS_SHARDS; i++) {
+    SmgrStatsShard* shard = &shared->shards[i].shard;
+    SpinLockAcquire(&shard->mutex);
+    smgr_stats_welford_merge(&out->read_burst.iat, &shard->read_iat);
+    smgr_stats_welford_merge(&out->write_burst.iat, &shard->write_iat);
+    smgr_stats_welford_merge(&out->read_runs, &shard->read_runs);
+    smgr_stats_welford_merge(&out->write_runs, &shard->write_runs);
+    if (reset) {
+      smgr_stats_welford_reset(&shard->read_iat);
+      smgr_stats_welford_reset(&shard->write_iat);
+      smgr_stats_welford_reset(&shard->read_runs);
+      smgr_stats_welford_reset(&shard->write_runs);
+    }
+    SpinLockRelease(&shard->mutex);
+  }
+
+  /*
+   * Last, after the counters: an op adds to the counters before it stamps
+   * the access times, so every op counted above has stamped them by now
+   * unless it is still running. Exchanging the stamps first let an op that
+   * raced with the reset leave its counts in this period and a stamp with no
+   * counts behind for the next one.
+   */
+  out->first_access = (TimestampTz)READ_COUNTER(shared->first_access);
+  out->last_access = (TimestampTz)READ_COUNTER(shared->last_access);
+
+  /* Seconds counted by different flushing backends may overlap; the span is an exact upper bound */
+  if (out->first_access != 0 && out->last_access >= out->first_access) {
+    int64 span = (out->last_access / USECS_PER_SEC) - (out->first_access / USECS_PER_SEC) + 1;
+    if ((int64)out->active_seconds > span) {
+      out->active_seconds = (uint32)span;
+    }
+  }
 }
 
-SmgrStatsEntry* smgr_stats_get_entry(const SmgrStatsKey* key, bool* found) {
-  SmgrStatsEntry* entry = dshash_find_or_insert(get_hash(), key, found);
-  if (!*found) {
-    smgr_stats_entry_reset(entry);
-    entry->last_active_second = 0;
-    entry->read_burst.last_op_time = 0;
-    entry->write_burst.last_op_time = 0;
-    /* Initialize metadata fields */
-    entry->meta.reloid = InvalidOid;
-    entry->meta.main_reloid = InvalidOid;
-    entry->meta.relkind = '\0';
-    memset(&entry->meta.relname, 0, sizeof(NameData));
-    memset(&entry->meta.nspname, 0, sizeof(NameData));
-    entry->meta.metadata_valid = false;
-  }
-  return entry;
+#undef READ_COUNTER
+
+/* Switch a logical entry to stripes once its shard locks were contended often enough this period. */
+static void update_striping(SmgrStatsSharedEntry* shared) {
+  uint32 contention = pg_atomic_exchange_u32(&shared->contention, 0);
+  if (shared->key.stripe != 0 || smgr_stats_stripes <= 1 || pg_atomic_read_u32(&shared->striped) != 0) {
+    return;
+  }
+  if (contention >= (uint32)smgr_stats_stripe_threshold) {
+    pg_atomic_write_u32(&shared->striped, 1);
+    smgr_stats_counter_add(SMGR_STATS_COUNTER_STRIPED_KEYS, 1);
+  }
+}
+
+/* Orders by logical key, with the stripe-0 entry (if any) first in each group. */
+static int compare_entry_keys(const void* a, const void* b) {
+  return memcmp(&((const SmgrStatsEntry*)a)->key, &((const SmgrStatsEntry*)b)->key, sizeof(SmgrStatsKey));
 }
 
-SmgrStatsEntry* smgr_stats_find_entry(const SmgrStatsKey* key) { return dshash_find(get_hash(), key, true); }
+/*
+ * Fold stripes into their logical entry. Counters and histograms add up and the
+ * Welford states combine, exactly as for a pending flush. Stripes carry no
+ * metadata, so if the logical entry was idle this period its metadata is looked
+ * up separately. Must not be called while holding a dshash lock.
+ */
+static int merge_stripes(SmgrStatsEntry* entries, int n) {
+  bool any = false;
+  for (int i = 0; i < n && !any; i++) {
+    any = entries[i].key.stripe != 0;
+  }
+  if (!any) {
+    return n;
+  }
 
-void smgr_stats_release_entry(SmgrStatsEntry* entry) { dshash_release_lock(get_hash(), entry); }
+  qsort(entries, n, sizeof(SmgrStatsEntry), compare_entry_keys);
+  int out = 0;
+  for (int i = 0; i < n; i++) {
+    if (out > 0 && smgr_stats_same_logical_key(&entries[out - 1].key, &entries[i].key)) {
+      smgr_stats_entry_merge(&entries[out - 1], &entries[i]);
+      continue;
+    }
+    if (out != i) {
+      entries[out] = entries[i];
+    }
+    SmgrStatsEntry* e = &entries[out++];
+    if (e->key.stripe != 0) {
+      e->key.stripe = 0;
+      SmgrStatsSharedEntry* logical = smgr_stats_find_entry(&e->key);
+      if (logical) {
+        e->meta = logical->meta;
+        smgr_stats_release_entry(logical);
+      }
+    }
+  }
+  return out;
+}
 
 static SmgrStatsEntry* snapshot_entries(int* count, bool reset) {
   dshash_table* hash = get_hash();
   dshash_seq_status seq;
-  SmgrStatsEntry* entry;
+  SmgrStatsSharedEntry* shared;
   int capacity = 64;
   int n = 0;
 
   SmgrStatsEntry* result = palloc(sizeof(SmgrStatsEntry) * capacity);
 
   dshash_seq_init(&seq, hash, reset);
-  while ((entry = dshash_seq_next(&seq)) != NULL) {
+  while ((shared = dshash_seq_next(&seq)) != NULL) {
     /* Skip entries with no activity this period */
-    if (entry->first_access == 0) {
+    if (pg_atomic_read_u64(&shared->first_access) == 0) {
+      /*
+       * Evict idle entries nobody has pinned. Pins are only taken under the
+       * partition lock, which we hold exclusively, so this cannot race.
+       */
+      if (reset && pg_atomic_read_u32(&shared->refcount) == 0) {
+        dshash_delete_current(&seq);
+      }
       continue;
     }
 
+    if (reset) {
+      update_striping(shared);
+    }
+
     /* Grow array if needed */
     if (n >= capacity) {
       capacity *= 2;
@@ -143,16 +568,29 @@ static SmgrStatsEntry* snapshot_entries(int* count, bool reset) {
     }
 
     /* Snapshot */
-    result[n] = *entry;
-
-    if (reset) {
-      smgr_stats_entry_reset(entry);
-    }
-
+    read_shared_entry(shared, &result[n], reset);
     n++;
   }
+
   dshash_seq_term(&seq);
 
+  n = merge_stripes(result, n);
+
+  /* Handles only apply relkind filters once metadata is known, drop what got through before */
+  if (smgr_stats_filter.relkinds_active) {
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+      if (result[i].meta.metadata_valid && !smgr_stats_filter_relkind(result[i].meta.relkind)) {
+        continue;
+      }
+      if (kept != i) {
+        result[kept] = result[i];
+      }
+      kept++;
+    }
+    n = kept;
+  }
+
   *count = n;
   return result;
 }
@@ -169,6 +607,59 @@ SmgrStatsEntry* smgr_stats_snapshot_and_reset(int* count, int64* bucket_id) {
   return snapshot_entries(count, true);
 }
 
+void smgr_stats_request_flush(void) { pg_atomic_fetch_add_u64(&get_control()->flush_requests, 1); }
+
+uint64 smgr_stats_flush_requests(void) { return pg_atomic_read_u64(&get_control()->flush_requests); }
+
+int64 smgr_stats_entry_count(void) {
+  dshash_seq_status seq;
+  int64 n = 0;
+  dshash_seq_init(&seq, get_hash(), false);
+  while (dshash_seq_next(&seq) != NULL) {
+    n++;
+  }
+  dshash_seq_term(&seq);
+  return n;
+}
+
+const char* const smgr_stats_counter_names[SMGR_STATS_NUM_COUNTERS] = {
+    [SMGR_STATS_COUNTER_CLOCK_REANCHORS] = "clock_reanchors",
+    [SMGR_STATS_COUNTER_STRIPED_KEYS] = "striped_keys",
+    [SMGR_STATS_COUNTER_AIO_COLLISIONS] = "aio_collisions",
+    [SMGR_STATS_COUNTER_AIO_MISSES] = "aio_misses",
+    [SMGR_STATS_COUNTER_PARTITION_LEAVES] = "partition_leaves",
+    [SMGR_STATS_COUNTER_PREFETCHED_BLOCKS] = "prefetched_blocks",
+    [SMGR_STATS_COUNTER_THROTTLED_OPS] = "throttled_ops",
+    [SMGR_STATS_COUNTER_THROTTLE_DELAY_US] = "throttle_delay_us",
+    [SMGR_STATS_COUNTER_QUERY_EVICTIONS] = "query_evictions",
+    [SMGR_STATS_COUNTER_QUERY_OPS_DROPPED] = "query_ops_dropped",
+    [SMGR_STATS_COUNTER_SLOW_IO_DROPPED] = "slow_io_dropped",
+    [SMGR_STATS_COUNTER_PARKED_OPS_DROPPED] = "parked_ops_dropped",
+};
+
+/* Counts from critical sections (AIO completions) that came before the control segment was attached */
+static uint64 deferred_counters[SMGR_STATS_NUM_COUNTERS];
+static bool have_deferred_counters = false;
+
+void smgr_stats_counter_add(SmgrStatsCounterId id, uint64 n) {
+  if (unlikely(!stats_control && CritSectionCount > 0)) {
+    deferred_counters[id] += n;
+    have_deferred_counters = true;
+    return;
+  }
+  SmgrStatsControl* ctl = get_control();
+  if (unlikely(have_deferred_counters)) {
+    for (int i = 0; i < SMGR_STATS_NUM_COUNTERS; i++) {
+      pg_atomic_fetch_add_u64(&ctl->counters[i], deferred_counters[i]);
+      deferred_counters[i] = 0;
+    }
+    have_deferred_counters = false;
+  }
+  pg_atomic_fetch_add_u64(&ctl->counters[id], n);
+}
+
+uint64 smgr_stats_counter_read(SmgrStatsCounterId id) { return pg_atomic_read_u64(&get_control()->counters[id]); }
+
 /*
  * Direct pg_class scan by (reltablespace, relfilenode) using the index.
  * This works for temp tables (which RelidByRelfilenumber skips) because
@@ -239,6 +730,16 @@ bool smgr_stats_lookup_metadata(const SmgrStatsKey* key, SmgrStatsEntryMeta* met
     return true;
   }
 
+  /* Handle synthetic key for the collector's own I/O */
+  if (smgr_stats_is_collector_key(key)) {
+    meta_out->reloid = InvalidOid;
+    meta_out->relkind = 'C'; /* Custom marker for the collector */
+    namestrcpy(&meta_out->relname, "<pg_smgrstat collector>");
+    namestrcpy(&meta_out->nspname, "smgr_stats");
+    meta_out->metadata_valid = true;
+    return true;
+  }
+
   /*
    * Skip if relNumber is 0 (defensive check). In practice, actual I/O uses
    * real relfilenodes - even mapped relations (system catalogs) have real
@@ -264,24 +765,29 @@ bool smgr_stats_lookup_metadata(const SmgrStatsKey* key, SmgrStatsEntryMeta* met
     return false;
   }
 
-  /*
-   * First try RelidByRelfilenumber for permanent relations.
-   * This uses a cache and is faster for repeated lookups.
-   * Note: RelidByRelfilenumber explicitly doesn't work for temp tables.
-   */
-  reloid = RelidByRelfilenumber(key->locator.spcOid, key->locator.relNumber);
-  if (!OidIsValid(reloid) && key->locator.spcOid != InvalidOid) {
-    /* Fallback: try with InvalidOid (stored as 0 in pg_class for default tablespace) */
-    reloid = RelidByRelfilenumber(InvalidOid, key->locator.relNumber);
-  }
+  if (smgr_stats_is_partition_aggregate_key(key)) {
+    /* Partition aggregate: relNumber is the partitioned root's OID */
+    reloid = (Oid)key->locator.relNumber;
+  } else {
+    /*
+     * First try RelidByRelfilenumber for permanent relations.
+     * This uses a cache and is faster for repeated lookups.
+     * Note: RelidByRelfilenumber explicitly doesn't work for temp tables.
+     */
+    reloid = RelidByRelfilenumber(key->locator.spcOid, key->locator.relNumber);
+    if (!OidIsValid(reloid) && key->locator.spcOid != InvalidOid) {
+      /* Fallback: try with InvalidOid (stored as 0 in pg_class for default tablespace) */
+      reloid = RelidByRelfilenumber(InvalidOid, key->locator.relNumber);
+    }
 
-  /*
-   * If RelidByRelfilenumber failed, try direct pg_class scan.
-   * This works for temp tables since we're in the same backend and
-   * can see our own temp tables via normal visibility rules.
-   */
-  if (!OidIsValid(reloid)) {
-    reloid = lookup_relid_by_relfilenode_direct(key->locator.spcOid, key->locator.relNumber);
+    /*
+     * If RelidByRelfilenumber failed, try direct pg_class scan.
+     * This works for temp tables since we're in the same backend and
+     * can see our own temp tables via normal visibility rules.
+     */
+    if (!OidIsValid(reloid)) {
+      reloid = lookup_relid_by_relfilenode_direct(key->locator.spcOid, key->locator.relNumber);
+    }
   }
 
   if (!OidIsValid(reloid)) {
@@ -343,6 +849,16 @@ bool smgr_stats_lookup_metadata(const SmgrStatsKey* key, SmgrStatsEntryMeta* met
     }
   }
 
+  /* A leaf partition (or index partition): map its file to the root so later I/O aggregates there */
+  if (class_form->relispartition && smgr_stats_track_partitions == SMGR_STATS_PARTITIONS_AGGREGATE &&
+      !smgr_stats_is_partition_aggregate_key(key)) {
+    List* ancestors = get_partition_ancestors(reloid);
+    if (ancestors != NIL) {
+      smgr_stats_partition_register(&key->locator, llast_oid(ancestors));
+    }
+    list_free(ancestors);
+  }
+
   ReleaseSysCache(tuple);
   meta_out->metadata_valid = true;
   return true;
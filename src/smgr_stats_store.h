@@ -3,10 +3,16 @@
 #include "postgres.h"
 
 #include "common/relpath.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "port/pg_bitutils.h"
+#include "storage/procnumber.h"
 #include "storage/relfilelocator.h"
+#include "storage/spin.h"
 
 #include "utils/timestamp.h"
 
+#include "smgr_stats_guc.h"
 #include "smgr_stats_hist.h"
 #include "smgr_stats_welford.h"
 
@@ -32,12 +38,23 @@ typedef struct SmgrStatsBurstiness {
 typedef struct SmgrStatsKey {
   RelFileLocator locator;
   ForkNumber forknum;
+  int32 backend_type; /* BackendType doing the I/O with smgr_stats.track_backend_type, B_INVALID otherwise */
+  int32 stripe;       /* 0 for the logical entry, 1..smgr_stats.stripes for the stripes of a hot one */
 } SmgrStatsKey;
 
+/* The backend_type this process records its I/O under */
+static inline int32 smgr_stats_key_backend_type(void) {
+  return smgr_stats_track_backend_type ? (int32)MyBackendType : (int32)B_INVALID;
+}
+
 /* Synthetic key for temp table aggregate: spcOid=0, relNumber=0 can't conflict with real tables */
 #define SMGR_STATS_TEMP_AGG_SPCOID 0
 #define SMGR_STATS_TEMP_AGG_RELNUMBER 0
 
+/* Synthetic key for all I/O issued by the collector itself: the temp aggregate key of database 0,
+ * which no temp table can have */
+#define SMGR_STATS_COLLECTOR_DBOID 0
+
 static inline SmgrStatsKey smgr_stats_temp_aggregate_key(Oid db_oid) {
   return (SmgrStatsKey){
       .locator = {.spcOid = SMGR_STATS_TEMP_AGG_SPCOID, .dbOid = db_oid, .relNumber = SMGR_STATS_TEMP_AGG_RELNUMBER},
@@ -45,9 +62,112 @@ static inline SmgrStatsKey smgr_stats_temp_aggregate_key(Oid db_oid) {
 }
 
 static inline bool smgr_stats_is_temp_aggregate_key(const SmgrStatsKey* key) {
-  return (key->locator.spcOid == SMGR_STATS_TEMP_AGG_SPCOID && key->locator.relNumber == SMGR_STATS_TEMP_AGG_RELNUMBER);
+  return (key->locator.spcOid == SMGR_STATS_TEMP_AGG_SPCOID && key->locator.relNumber == SMGR_STATS_TEMP_AGG_RELNUMBER &&
+          key->locator.dbOid != SMGR_STATS_COLLECTOR_DBOID);
+}
+
+static inline SmgrStatsKey smgr_stats_collector_key(void) {
+  return (SmgrStatsKey){.locator = {.spcOid = SMGR_STATS_TEMP_AGG_SPCOID,
+                                    .dbOid = SMGR_STATS_COLLECTOR_DBOID,
+                                    .relNumber = SMGR_STATS_TEMP_AGG_RELNUMBER},
+                        .forknum = MAIN_FORKNUM};
+}
+
+static inline bool smgr_stats_is_collector_key(const SmgrStatsKey* key) {
+  return (key->locator.spcOid == SMGR_STATS_TEMP_AGG_SPCOID && key->locator.dbOid == SMGR_STATS_COLLECTOR_DBOID &&
+          key->locator.relNumber == SMGR_STATS_TEMP_AGG_RELNUMBER);
+}
+
+/* Synthetic keys whose metadata is made up rather than looked up in pg_class */
+static inline bool smgr_stats_has_synthetic_metadata(const SmgrStatsKey* key) {
+  return smgr_stats_is_temp_aggregate_key(key) || smgr_stats_is_collector_key(key);
+}
+
+/* Synthetic key for a partitioned table's aggregate: spcOid=0 with the root's pg_class OID as relNumber */
+#define SMGR_STATS_PART_AGG_SPCOID 0
+
+static inline void smgr_stats_set_partition_aggregate(SmgrStatsKey* key, Oid root_reloid) {
+  key->locator.spcOid = SMGR_STATS_PART_AGG_SPCOID;
+  key->locator.relNumber = (RelFileNumber)root_reloid;
+}
+
+static inline bool smgr_stats_is_partition_aggregate_key(const SmgrStatsKey* key) {
+  return (key->locator.spcOid == SMGR_STATS_PART_AGG_SPCOID && key->locator.relNumber != SMGR_STATS_TEMP_AGG_RELNUMBER);
+}
+
+/* Same logical entry, ignoring the stripe */
+static inline bool smgr_stats_same_logical_key(const SmgrStatsKey* a, const SmgrStatsKey* b) {
+  return memcmp(a, b, offsetof(SmgrStatsKey, stripe)) == 0;
+}
+
+/* Per-fork counters of a main-fork entry that other forks were folded into (smgr_stats.fold_forks) */
+typedef struct SmgrStatsForkCounters {
+  uint64 reads[MAX_FORKNUM + 1];
+  uint64 writes[MAX_FORKNUM + 1];
+  uint64 extends[MAX_FORKNUM + 1];
+} SmgrStatsForkCounters;
+
+typedef struct SmgrStatsAtomicForkCounters {
+  pg_atomic_uint64 reads[MAX_FORKNUM + 1];
+  pg_atomic_uint64 writes[MAX_FORKNUM + 1];
+  pg_atomic_uint64 extends[MAX_FORKNUM + 1];
+} SmgrStatsAtomicForkCounters;
+
+/* Request size histograms: bin i counts requests of [2^i, 2^(i+1)) blocks, the last bin everything larger */
+#define SMGR_STATS_SIZE_BINS 8
+
+static inline int smgr_stats_size_bin(BlockNumber nblocks) {
+  return nblocks <= 1 ? 0 : Min(pg_leftmost_one_pos32(nblocks), SMGR_STATS_SIZE_BINS - 1);
 }
 
+/* How many blocks each request moved, showing whether reads and writes are being combined (io_combine_limit) */
+typedef struct SmgrStatsSizeCounters {
+  uint64 reads[SMGR_STATS_SIZE_BINS]; /* readv and startreadv */
+  uint64 writes[SMGR_STATS_SIZE_BINS];
+  uint64 zeroextends[SMGR_STATS_SIZE_BINS];
+} SmgrStatsSizeCounters;
+
+typedef struct SmgrStatsAtomicSizeCounters {
+  pg_atomic_uint64 reads[SMGR_STATS_SIZE_BINS];
+  pg_atomic_uint64 writes[SMGR_STATS_SIZE_BINS];
+  pg_atomic_uint64 zeroextends[SMGR_STATS_SIZE_BINS];
+} SmgrStatsAtomicSizeCounters;
+
+/* SMGR calls that move no data but still cost a syscall or a file descriptor */
+typedef enum SmgrStatsMetaOp {
+  SMGR_STATS_META_NBLOCKS,   /* smgrnblocks: an lseek(SEEK_END) per segment */
+  SMGR_STATS_META_EXISTS,    /* smgrexists */
+  SMGR_STATS_META_PREFETCH,  /* smgrprefetch: posix_fadvise(WILLNEED) */
+  SMGR_STATS_META_WRITEBACK, /* smgrwriteback: sync_file_range */
+  SMGR_STATS_META_CLOSE,     /* smgrclose of a fork this backend did I/O on */
+  SMGR_STATS_NUM_META_OPS
+} SmgrStatsMetaOp;
+
+/* Calls, blocks (prefetch and writeback only) and time (scaled up under timing_sample_rate) per SmgrStatsMetaOp */
+typedef struct SmgrStatsMetaOpCounters {
+  uint64 calls[SMGR_STATS_NUM_META_OPS];
+  uint64 blocks[SMGR_STATS_NUM_META_OPS];
+  uint64 time_us[SMGR_STATS_NUM_META_OPS];
+} SmgrStatsMetaOpCounters;
+
+/*
+ * Phases of an async read (smgrstartreadv), timed through AIO callbacks. Together they
+ * add up to the read's read_timing sample. There is no callback at submission, so a read
+ * staged in a batch waits for its submission within the device phase.
+ */
+typedef enum SmgrStatsAioPhase {
+  SMGR_STATS_AIO_STAGE,      /* smgrstartreadv until the I/O is staged (file lookup, segment open) */
+  SMGR_STATS_AIO_DEVICE,     /* Staged until complete_shared: submission, queueing and device service */
+  SMGR_STATS_AIO_COMPLETION, /* complete_shared until the issuing backend runs complete_local */
+  SMGR_STATS_NUM_AIO_PHASES
+} SmgrStatsAioPhase;
+
+typedef struct SmgrStatsAtomicMetaOpCounters {
+  pg_atomic_uint64 calls[SMGR_STATS_NUM_META_OPS];
+  pg_atomic_uint64 blocks[SMGR_STATS_NUM_META_OPS];
+  pg_atomic_uint64 time_us[SMGR_STATS_NUM_META_OPS];
+} SmgrStatsAtomicMetaOpCounters;
+
 typedef struct SmgrStatsEntry {
   SmgrStatsKey key; /* Must be first (dshash requirement) */
 
@@ -62,11 +182,18 @@ typedef struct SmgrStatsEntry {
   uint64 extends;
   uint64 extend_blocks;
   uint64 truncates;
+  uint64 truncated_blocks;
   uint64 fsyncs;
 
   /* Timing histograms */
   SmgrStatsTimingHist read_timing;
   SmgrStatsTimingHist write_timing;
+  SmgrStatsTimingHist throttle_timing; /* Delays imposed by smgr_stats.io_limits */
+  SmgrStatsTimingHist extend_timing;
+  SmgrStatsTimingHist zeroextend_timing;
+  SmgrStatsTimingHist truncate_timing;
+  SmgrStatsTimingHist fsync_timing; /* smgrimmedsync */
+  SmgrStatsTimingHist aio_phase_timing[SMGR_STATS_NUM_AIO_PHASES];
 
   /* Burstiness: inter-arrival time statistics */
   SmgrStatsBurstiness read_burst;
@@ -89,28 +216,239 @@ typedef struct SmgrStatsEntry {
   /* Timestamps */
   TimestampTz first_access; /* Set once on entry creation */
   TimestampTz last_access;  /* Updated on every operation */
+
+  /* Highest smgr_stats.timing_sample_rate that timed an op this period (0 = none timed) */
+  uint32 timing_sample_rate;
+
+  /* Only counted for folded ops; all zero otherwise */
+  SmgrStatsForkCounters forks;
+
+  SmgrStatsMetaOpCounters meta_ops;
+  SmgrStatsSizeCounters sizes;
 } SmgrStatsEntry;
 
-/* Get or create an entry, returning it locked (exclusive). Caller must release. */
-extern SmgrStatsEntry* smgr_stats_get_entry(const SmgrStatsKey* key, bool* found);
+/* Did any folded op (smgr_stats.fold_forks) land in this entry? */
+static inline bool smgr_stats_entry_has_folded_forks(const SmgrStatsEntry* entry) {
+  for (int f = 0; f <= MAX_FORKNUM; f++) {
+    if (entry->forks.reads[f] | entry->forks.writes[f] | entry->forks.extends[f]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Number of per-entry shards for the non-commutative (Welford) state. */
+#define SMGR_STATS_SHARDS 4
+
+/*
+ * Welford accumulators of a shared entry. They can't be updated with plain
+ * atomics, so each entry keeps a few spinlock-protected copies; a backend
+ * always uses the same one (by proc number) and the snapshot merges them.
+ */
+typedef struct SmgrStatsShard {
+  slock_t mutex;
+  SmgrStatsWelford read_iat;
+  SmgrStatsWelford write_iat;
+  SmgrStatsRunDist read_runs;
+  SmgrStatsRunDist write_runs;
+} SmgrStatsShard;
+
+/* Padded to a cache line so backends in different shards don't share one */
+typedef union SmgrStatsPaddedShard {
+  SmgrStatsShard shard;
+  char pad[PG_CACHE_LINE_SIZE];
+} SmgrStatsPaddedShard;
 
-/* Find an existing entry (exclusive lock). Returns NULL if not found.
- * Safe in critical sections (no allocation). Hash must already be attached. */
-extern SmgrStatsEntry* smgr_stats_find_entry(const SmgrStatsKey* key);
+/*
+ * The dshash entry. The partition lock protects the entry's existence and its
+ * metadata. Counters, histogram bins and timestamps are atomics, so backends
+ * holding a pin update them concurrently without any lock; only the Welford
+ * state goes through a (sharded) spinlock. The collector only evicts entries
+ * nobody has pinned. Snapshots convert it into a plain SmgrStatsEntry.
+ */
+typedef struct SmgrStatsSharedEntry {
+  SmgrStatsKey key;          /* Must be first (dshash requirement) */
+  SmgrStatsEntryMeta meta;   /* Protected by the dshash partition lock */
+  pg_atomic_uint32 refcount; /* Number of pins held by backends */
 
-/* Release the lock on an entry obtained from smgr_stats_get_entry/find_entry. */
-extern void smgr_stats_release_entry(SmgrStatsEntry* entry);
+  /* Operation counters */
+  pg_atomic_uint64 reads;
+  pg_atomic_uint64 read_blocks;
+  pg_atomic_uint64 writes;
+  pg_atomic_uint64 write_blocks;
+  pg_atomic_uint64 extends;
+  pg_atomic_uint64 extend_blocks;
+  pg_atomic_uint64 truncates;
+  pg_atomic_uint64 truncated_blocks;
+  pg_atomic_uint64 fsyncs;
+  pg_atomic_uint64 sequential_reads;
+  pg_atomic_uint64 random_reads;
+  pg_atomic_uint64 sequential_writes;
+  pg_atomic_uint64 random_writes;
+
+  /* Timing histograms */
+  SmgrStatsAtomicHist read_timing;
+  SmgrStatsAtomicHist write_timing;
+  SmgrStatsAtomicHist throttle_timing;
+  SmgrStatsAtomicHist extend_timing;
+  SmgrStatsAtomicHist zeroextend_timing;
+  SmgrStatsAtomicHist truncate_timing;
+  SmgrStatsAtomicHist fsync_timing;
+  SmgrStatsAtomicHist aio_phase_timing[SMGR_STATS_NUM_AIO_PHASES];
+
+  /* Previous operation time, swapped in by every op to compute the inter-arrival time */
+  pg_atomic_uint64 read_last_op_time;
+  pg_atomic_uint64 write_last_op_time;
+
+  /* Activity */
+  pg_atomic_uint32 active_seconds;
+  pg_atomic_uint64 last_active_second;
+  pg_atomic_uint64 first_access;
+  pg_atomic_uint64 last_access;
+
+  pg_atomic_uint64 timing_sample_rate;
+
+  SmgrStatsAtomicForkCounters forks;
+  SmgrStatsAtomicMetaOpCounters meta_ops;
+  SmgrStatsAtomicSizeCounters sizes;
+
+  /* Striping (logical entries only): contended shard locks this period, and whether ops go to stripes */
+  pg_atomic_uint32 contention;
+  pg_atomic_uint32 striped;
+
+  SmgrStatsPaddedShard shards[SMGR_STATS_SHARDS];
+} SmgrStatsSharedEntry;
+
+/* Initialize a freshly allocated entry (counters, timestamps and metadata). */
+extern void smgr_stats_entry_init(SmgrStatsEntry* entry);
+
+/* Reset per-period counters, keeping the state that must survive period boundaries
+ * (last operation time, last active second) and the metadata. */
+extern void smgr_stats_entry_reset(SmgrStatsEntry* entry);
+
+/* Add the per-period counters of src into dst (both local copies). */
+extern void smgr_stats_entry_merge(SmgrStatsEntry* dst, const SmgrStatsEntry* src);
+
+/* Find (or with create=true, create) an entry and pin it. Pinned entries are never
+ * evicted, so the pointer stays valid until smgr_stats_unpin_entry. Sets
+ * *needs_metadata (if not NULL) when the entry is new or its metadata unresolved.
+ * Returns NULL if the entry does not exist and create=false, or in a critical
+ * section, where inserting (which can allocate) is not allowed. */
+extern SmgrStatsSharedEntry* smgr_stats_pin_entry(const SmgrStatsKey* key, bool create, bool* needs_metadata);
+
+/* Take an additional pin on an already pinned entry. */
+static inline void smgr_stats_repin_entry(SmgrStatsSharedEntry* shared) { pg_atomic_fetch_add_u32(&shared->refcount, 1); }
+
+/* Drop a pin. Never blocks, safe in critical sections. */
+static inline void smgr_stats_unpin_entry(SmgrStatsSharedEntry* shared) { pg_atomic_fetch_sub_u32(&shared->refcount, 1); }
+
+/* Lock this backend's shard of a pinned entry. Keep the critical section short. */
+static inline SmgrStatsShard* smgr_stats_lock_shard(SmgrStatsSharedEntry* shared) {
+  SmgrStatsShard* shard = &shared->shards[(uint32)MyProcNumber % SMGR_STATS_SHARDS].shard;
+  if (unlikely(TAS_SPIN(&shard->mutex))) {
+    /* Somebody else holds it: count the wait, the collector stripes entries that see too many */
+    pg_atomic_fetch_add_u32(&shared->contention, 1);
+    SpinLockAcquire(&shard->mutex);
+  }
+  return shard;
+}
+
+static inline void smgr_stats_unlock_shard(SmgrStatsShard* shard) { SpinLockRelease(&shard->mutex); }
+
+/* Record activity at the given time: first/last access and distinct active seconds. */
+static inline void smgr_stats_shared_update_activity(SmgrStatsSharedEntry* shared, TimestampTz now) {
+  uint64 unset = 0;
+  if (pg_atomic_read_u64(&shared->first_access) == 0) {
+    pg_atomic_compare_exchange_u64(&shared->first_access, &unset, (uint64)now);
+  }
+  pg_atomic_monotonic_advance_u64(&shared->last_access, (uint64)now);
+
+  uint64 second = (uint64)(now / USECS_PER_SEC);
+  uint64 last = pg_atomic_read_u64(&shared->last_active_second);
+  /* Only the backend that moves last_active_second forward counts the second */
+  if (second > last && pg_atomic_compare_exchange_u64(&shared->last_active_second, &last, second)) {
+    pg_atomic_fetch_add_u32(&shared->active_seconds, 1);
+  }
+}
+
+/* Swap in the time of this op and return the inter-arrival time in microseconds, or -1
+ * for the first op ever seen on the entry. */
+static inline double smgr_stats_shared_swap_op_time(pg_atomic_uint64* last_op_time, TimestampTz now) {
+  uint64 prev = pg_atomic_exchange_u64(last_op_time, (uint64)now);
+  if (prev == 0) {
+    return -1.0;
+  }
+  /* Concurrent ops may swap in slightly out of order */
+  return (uint64)now > prev ? (double)((uint64)now - prev) : 0.0;
+}
+
+/* Add the per-period stats of a local entry (a pending flush) into a pinned shared entry. */
+extern void smgr_stats_shared_add(SmgrStatsSharedEntry* shared, const SmgrStatsEntry* src);
+
+/* Mean length of the read runs a pinned entry completed this period, over all shards; 0 if none
+ * did. Takes each shard lock in turn, so call it once per run rather than per op. */
+extern double smgr_stats_shared_read_run_mean(SmgrStatsSharedEntry* shared);
+
+/* Find an existing entry (exclusive lock) to read or update its metadata. Returns NULL
+ * if not found. Counters are only updated through pins. */
+extern SmgrStatsSharedEntry* smgr_stats_find_entry(const SmgrStatsKey* key);
+
+/* Release the lock on an entry obtained from smgr_stats_find_entry. */
+extern void smgr_stats_release_entry(SmgrStatsSharedEntry* entry);
+
+/* Stripe of a striped entry this backend uses. Backends in the same stripe still land
+ * in different shards. */
+static inline int32 smgr_stats_my_stripe(int nstripes) {
+  return 1 + (int32)(((uint32)MyProcNumber / SMGR_STATS_SHARDS) % (uint32)nstripes);
+}
 
 /* Iterate all entries (shared lock), snapshot without resetting.
- * Returns a palloc'd array of snapshots. Sets *count and *bucket_id
+ * Returns a palloc'd array of snapshots, one per logical key (stripes merged). Sets *count and *bucket_id
  * (the current in-progress bucket). */
 extern SmgrStatsEntry* smgr_stats_snapshot(int* count, int64* bucket_id);
 
 /* Iterate all entries with exclusive lock, snapshot and reset counters.
- * Returns a palloc'd array of snapshots. Sets *count and *bucket_id
+ * Entries that were idle for the whole period and are not pinned are evicted.
+ * Entries whose shard locks were contended more than smgr_stats.stripe_threshold
+ * times are switched to stripes.
+ * Returns a palloc'd array of snapshots, one per logical key (stripes merged). Sets *count and *bucket_id
  * (the bucket that was just completed). Advances the bucket counter. */
 extern SmgrStatsEntry* smgr_stats_snapshot_and_reset(int* count, int64* bucket_id);
 
+/* Ask backends holding pending stats to flush them soon (called by the collector). */
+extern void smgr_stats_request_flush(void);
+
+/* Number of flush requests issued so far; backends compare it against the last value they saw. */
+extern uint64 smgr_stats_flush_requests(void);
+
+/* Number of entries in the shared hash, including idle ones. */
+extern int64 smgr_stats_entry_count(void);
+
+/* Instance-wide event counters, reported by smgr_stats.status(). */
+typedef enum SmgrStatsCounterId {
+  SMGR_STATS_COUNTER_CLOCK_REANCHORS,    /* Wall-clock offset re-anchors in the I/O hooks */
+  SMGR_STATS_COUNTER_STRIPED_KEYS,       /* Keys switched to striped entries */
+  SMGR_STATS_COUNTER_AIO_COLLISIONS,     /* Async reads whose tracking slot was reused or unavailable */
+  SMGR_STATS_COUNTER_AIO_MISSES,         /* Async read completions with no matching tracking slot */
+  SMGR_STATS_COUNTER_PARTITION_LEAVES,   /* Leaf partitions mapped to their root's aggregate */
+  SMGR_STATS_COUNTER_PREFETCHED_BLOCKS,  /* Blocks prefetched by adaptive read-ahead */
+  SMGR_STATS_COUNTER_THROTTLED_OPS,      /* Reads and writes delayed by smgr_stats.io_limits */
+  SMGR_STATS_COUNTER_THROTTLE_DELAY_US,  /* Total time those ops were delayed */
+  SMGR_STATS_COUNTER_QUERY_EVICTIONS,    /* (queryid, file) pairs replaced in the full top-N table */
+  SMGR_STATS_COUNTER_QUERY_OPS_DROPPED,  /* Ops not attributed to a query because the backend batch was full */
+  SMGR_STATS_COUNTER_SLOW_IO_DROPPED,    /* Slow I/O records lost to a full ring before collection */
+  SMGR_STATS_COUNTER_PARKED_OPS_DROPPED, /* Ops in critical sections lost because too many were parked */
+  SMGR_STATS_NUM_COUNTERS
+} SmgrStatsCounterId;
+
+extern const char* const smgr_stats_counter_names[SMGR_STATS_NUM_COUNTERS];
+
+/* Safe in critical sections: if the control segment isn't attached yet, the count is
+ * kept locally and added by a later call. */
+extern void smgr_stats_counter_add(SmgrStatsCounterId id, uint64 n);
+
+extern uint64 smgr_stats_counter_read(SmgrStatsCounterId id);
+
 /* Resolve metadata from pg_class for an entry. Must be called from a backend with
  * the correct database connection. Returns true if metadata was resolved.
  * WARNING: This function accesses syscache which may trigger I/O. Do NOT call
@@ -0,0 +1,213 @@
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "common/hashfn.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/dsm_registry.h"
+#include "storage/ipc.h"
+
+#include "smgr_stats_tablespace.h"
+
+struct SmgrStatsTablespace {
+  pg_atomic_uint32 spcoid;     /* InvalidOid while the slot is free; never released */
+  pg_atomic_uint64 depth;      /* I/Os in flight */
+  pg_atomic_uint64 max_depth;  /* This bucket */
+  pg_atomic_uint64 busy_since; /* Instant depth last went from 0 to 1 (or the bucket started) */
+  pg_atomic_uint64 busy_us;    /* Busy periods that ended this bucket */
+  pg_atomic_uint64 ios;
+  pg_atomic_uint64 io_time_us;
+  pg_atomic_uint64 reset_at; /* Instant the bucket started, 0 until the slot is claimed */
+};
+
+/* Padded to a cache line so I/O on one tablespace doesn't slow down another */
+typedef union SmgrStatsPaddedTablespace {
+  SmgrStatsTablespace ts;
+  char pad[PG_CACHE_LINE_SIZE];
+} SmgrStatsPaddedTablespace;
+
+typedef struct SmgrStatsTablespaceTable {
+  SmgrStatsPaddedTablespace slots[SMGR_STATS_MAX_TABLESPACES];
+} SmgrStatsTablespaceTable;
+
+static SmgrStatsTablespaceTable* tablespace_table = NULL;
+
+/* The tablespace of the last I/O, so steady-state I/O skips the probe */
+static Oid cached_spcoid = InvalidOid;
+static SmgrStatsTablespace* cached_ts = NULL;
+
+/* The synchronous I/O this backend has in flight, until its call returns or errors out */
+static SmgrStatsTablespace* sync_ts = NULL;
+static SmgrStatsInstant sync_start = 0;
+static bool sync_callbacks_registered = false;
+
+static void tablespace_table_init(void* ptr, void* arg) {
+  (void)arg;
+  SmgrStatsTablespaceTable* t = ptr;
+  for (int i = 0; i < SMGR_STATS_MAX_TABLESPACES; i++) {
+    SmgrStatsTablespace* ts = &t->slots[i].ts;
+    pg_atomic_init_u32(&ts->spcoid, InvalidOid);
+    pg_atomic_init_u64(&ts->depth, 0);
+    pg_atomic_init_u64(&ts->max_depth, 0);
+    pg_atomic_init_u64(&ts->busy_since, 0);
+    pg_atomic_init_u64(&ts->busy_us, 0);
+    pg_atomic_init_u64(&ts->ios, 0);
+    pg_atomic_init_u64(&ts->io_time_us, 0);
+    pg_atomic_init_u64(&ts->reset_at, 0);
+  }
+}
+
+static SmgrStatsTablespaceTable* get_tablespace_table(void) {
+  if (!tablespace_table) {
+    bool found;
+    tablespace_table = GetNamedDSMSegment("pg_smgrstat_tablespaces", sizeof(SmgrStatsTablespaceTable),
+                                          tablespace_table_init, &found, NULL);
+  }
+  return tablespace_table;
+}
+
+/* Find the slot of spcoid, claiming a free one on its first I/O */
+static SmgrStatsTablespace* tablespace_lookup(Oid spcoid, SmgrStatsInstant now) {
+  if (likely(spcoid == cached_spcoid && cached_ts)) {
+    return cached_ts;
+  }
+  if (!tablespace_table && CritSectionCount > 0) {
+    return NULL; /* Attaching allocates */
+  }
+  SmgrStatsTablespaceTable* t = get_tablespace_table();
+
+  uint32 home = murmurhash32(spcoid) & (SMGR_STATS_MAX_TABLESPACES - 1);
+  for (int n = 0; n < SMGR_STATS_MAX_TABLESPACES; n++) {
+    SmgrStatsTablespace* ts = &t->slots[(home + n) & (SMGR_STATS_MAX_TABLESPACES - 1)].ts;
+    uint32 owner = pg_atomic_read_u32(&ts->spcoid);
+    if (owner == InvalidOid) {
+      if (pg_atomic_compare_exchange_u32(&ts->spcoid, &owner, spcoid)) {
+        pg_atomic_write_u64(&ts->reset_at, now);
+        owner = spcoid;
+      }
+    }
+    if (owner == spcoid) {
+      cached_spcoid = spcoid;
+      cached_ts = ts;
+      return ts;
+    }
+  }
+  return NULL;
+}
+
+SmgrStatsTablespace* smgr_stats_tablespace_io_start(Oid spcoid, SmgrStatsInstant now) {
+  SmgrStatsTablespace* ts = tablespace_lookup(spcoid, now);
+  if (!ts) {
+    return NULL;
+  }
+  uint64 depth = pg_atomic_add_fetch_u64(&ts->depth, 1);
+  if (depth == 1) {
+    pg_atomic_write_u64(&ts->busy_since, now);
+  }
+  pg_atomic_monotonic_advance_u64(&ts->max_depth, depth);
+  return ts;
+}
+
+void smgr_stats_tablespace_io_end(SmgrStatsTablespace* ts, SmgrStatsInstant start, SmgrStatsInstant end) {
+  if (!ts) {
+    return;
+  }
+  /* Read before leaving: while this I/O is in flight, no new busy period can start */
+  SmgrStatsInstant busy_since = pg_atomic_read_u64(&ts->busy_since);
+  if (pg_atomic_sub_fetch_u64(&ts->depth, 1) == 0) {
+    /* A snapshot that reset the bucket meanwhile already counted the period up to then */
+    busy_since = Max(busy_since, pg_atomic_read_u64(&ts->reset_at));
+    pg_atomic_fetch_add_u64(&ts->busy_us, smgr_stats_clock_elapsed_us(busy_since, end));
+  }
+  pg_atomic_fetch_add_u64(&ts->ios, 1);
+  pg_atomic_fetch_add_u64(&ts->io_time_us, smgr_stats_clock_elapsed_us(start, end));
+}
+
+SmgrStatsTablespaceStats* smgr_stats_tablespace_snapshot(int* count, bool reset) {
+  SmgrStatsTablespaceTable* t = get_tablespace_table();
+  SmgrStatsTablespaceStats* result = palloc(sizeof(SmgrStatsTablespaceStats) * SMGR_STATS_MAX_TABLESPACES);
+  SmgrStatsInstant now = smgr_stats_clock_read();
+
+  *count = 0;
+  for (int i = 0; i < SMGR_STATS_MAX_TABLESPACES; i++) {
+    SmgrStatsTablespace* ts = &t->slots[i].ts;
+    Oid spcoid = pg_atomic_read_u32(&ts->spcoid);
+    SmgrStatsInstant reset_at = pg_atomic_read_u64(&ts->reset_at);
+    if (spcoid == InvalidOid || reset_at == 0) {
+      continue;
+    }
+
+    SmgrStatsTablespaceStats* out = &result[(*count)++];
+    uint64 depth = pg_atomic_read_u64(&ts->depth);
+    out->spcoid = spcoid;
+    out->depth = (uint32)depth;
+    out->interval_us = smgr_stats_clock_elapsed_us(reset_at, now);
+
+    /* A busy period still open counts up to now; on reset, the rest of it goes to the next bucket */
+    uint64 open_busy_us = depth > 0 ? smgr_stats_clock_elapsed_us(pg_atomic_read_u64(&ts->busy_since), now) : 0;
+    if (reset) {
+      out->ios = pg_atomic_exchange_u64(&ts->ios, 0);
+      out->io_time_us = pg_atomic_exchange_u64(&ts->io_time_us, 0);
+      out->busy_us = pg_atomic_exchange_u64(&ts->busy_us, 0) + open_busy_us;
+      out->max_depth = (uint32)pg_atomic_exchange_u64(&ts->max_depth, depth);
+      if (depth > 0) {
+        pg_atomic_write_u64(&ts->busy_since, now);
+      }
+      pg_atomic_write_u64(&ts->reset_at, now);
+    } else {
+      out->ios = pg_atomic_read_u64(&ts->ios);
+      out->io_time_us = pg_atomic_read_u64(&ts->io_time_us);
+      out->busy_us = pg_atomic_read_u64(&ts->busy_us) + open_busy_us;
+      out->max_depth = (uint32)pg_atomic_read_u64(&ts->max_depth);
+    }
+  }
+  return result;
+}
+
+/* End the synchronous I/O left in flight by an ERROR in the next chain member */
+static void tablespace_sync_cleanup(void) {
+  if (sync_ts) {
+    smgr_stats_tablespace_io_end(sync_ts, sync_start, smgr_stats_clock_read_coarse());
+    sync_ts = NULL;
+  }
+}
+
+static void tablespace_xact_callback(XactEvent event, void* arg) {
+  (void)arg;
+  if (event == XACT_EVENT_ABORT || event == XACT_EVENT_PARALLEL_ABORT) {
+    tablespace_sync_cleanup();
+  }
+}
+
+static void tablespace_subxact_callback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid,
+                                        void* arg) {
+  (void)mySubid;
+  (void)parentSubid;
+  (void)arg;
+  if (event == SUBXACT_EVENT_ABORT_SUB) {
+    tablespace_sync_cleanup();
+  }
+}
+
+static void tablespace_before_shmem_exit(int code, Datum arg) {
+  (void)code;
+  (void)arg;
+  tablespace_sync_cleanup();
+}
+
+void smgr_stats_tablespace_sync_start(Oid spcoid, SmgrStatsInstant now) {
+  tablespace_sync_cleanup(); /* Processes without transactions (checkpointer, ...) clean up here */
+  if (unlikely(!sync_callbacks_registered) && CritSectionCount == 0) {
+    RegisterXactCallback(tablespace_xact_callback, NULL);
+    RegisterSubXactCallback(tablespace_subxact_callback, NULL);
+    before_shmem_exit(tablespace_before_shmem_exit, (Datum)0);
+    sync_callbacks_registered = true;
+  }
+  sync_ts = smgr_stats_tablespace_io_start(spcoid, now);
+  sync_start = now;
+}
+
+void smgr_stats_tablespace_sync_end(SmgrStatsInstant end) {
+  smgr_stats_tablespace_io_end(sync_ts, sync_start, end);
+  sync_ts = NULL;
+}
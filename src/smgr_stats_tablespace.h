@@ -0,0 +1,57 @@
+#pragma once
+
+#include "postgres.h"
+
+#include "smgr_stats_clock.h"
+
+/*
+ * Per-tablespace queue depth and utilization.
+ *
+ * Every tracked readv, startreadv and writev counts as in flight on its
+ * tablespace from the call until it returns (or, for async reads, until the
+ * issuing backend processes the completion). Per collection bucket each
+ * tablespace keeps:
+ *
+ * - the time-weighted average depth, by Little's law: the sum of the I/O
+ *   durations divided by the length of the bucket
+ * - the highest depth seen
+ * - busy time, during which at least one I/O was in flight; busy time over
+ *   the bucket length is iostat's %util
+ *
+ * Counters are atomics in a fixed table of SMGR_STATS_MAX_TABLESPACES slots
+ * in a named DSM segment, claimed on a tablespace's first I/O. Untimed
+ * operations (smgr_stats.timing_sample_rate) are measured with the coarse
+ * clock, which is unbiased on average but noisy for short buckets.
+ */
+
+#define SMGR_STATS_MAX_TABLESPACES 64
+
+typedef struct SmgrStatsTablespace SmgrStatsTablespace;
+
+typedef struct SmgrStatsTablespaceStats {
+  Oid spcoid;
+  uint64 ios;         /* I/Os completed */
+  uint64 io_time_us;  /* Sum of their durations */
+  uint64 busy_us;     /* Time with at least one I/O in flight */
+  uint64 interval_us; /* Since the last reset */
+  uint32 depth;       /* In flight at the time of the snapshot */
+  uint32 max_depth;
+} SmgrStatsTablespaceStats;
+
+/* An I/O on spcoid starts now. Returns the tablespace to pass to smgr_stats_tablespace_io_end,
+ * or NULL if it isn't tracked (table full, or not attached yet inside a critical section). */
+extern SmgrStatsTablespace* smgr_stats_tablespace_io_start(Oid spcoid, SmgrStatsInstant now);
+
+/* The I/O started at `start` ended. No-op for NULL. Safe in critical sections. */
+extern void smgr_stats_tablespace_io_end(SmgrStatsTablespace* ts, SmgrStatsInstant start, SmgrStatsInstant end);
+
+/*
+ * The same for a synchronous readv or writev. The backend remembers the I/O,
+ * so if the call errors out it is ended at transaction or subtransaction
+ * abort, at exit, or by the next call in processes without transactions.
+ */
+extern void smgr_stats_tablespace_sync_start(Oid spcoid, SmgrStatsInstant now);
+extern void smgr_stats_tablespace_sync_end(SmgrStatsInstant end);
+
+/* Copy every tablespace's counters, optionally starting a new bucket (collector). Returns a palloc'd array. */
+extern SmgrStatsTablespaceStats* smgr_stats_tablespace_snapshot(int* count, bool reset);
@@ -23,6 +23,27 @@ static inline void smgr_stats_welford_record(SmgrStatsWelford* w, double value)
   w->m2 += delta * delta2;
 }
 
+/*
+ * Combine two Welford accumulators (Chan et al. parallel update). The result
+ * is the same as if all of src's observations had been recorded into dst.
+ */
+static inline void smgr_stats_welford_merge(SmgrStatsWelford* dst, const SmgrStatsWelford* src) {
+  if (src->count == 0) {
+    return;
+  }
+  if (dst->count == 0) {
+    *dst = *src;
+    return;
+  }
+  double n_a = (double)dst->count;
+  double n_b = (double)src->count;
+  double n = n_a + n_b;
+  double delta = src->mean - dst->mean;
+  dst->mean += delta * n_b / n;
+  dst->m2 += src->m2 + delta * delta * n_a * n_b / n;
+  dst->count += src->count;
+}
+
 static inline void smgr_stats_welford_reset(SmgrStatsWelford* w) {
   w->count = 0;
   w->mean = 0.0;
@@ -1,22 +1,38 @@
 #include "postgres.h"
 
+#include <sys/stat.h>
+
 #include "access/xact.h"
 #include "executor/spi.h"
 #include "lib/stringinfo.h"
 #include "miscadmin.h"
 #include "pgstat.h"
 #include "postmaster/bgworker.h"
+#include "storage/fd.h"
 #include "storage/ipc.h"
 #include "storage/latch.h"
+#include "storage/smgr.h"
 #include "tcop/utility.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/relfilenumbermap.h"
 #include "utils/snapmgr.h"
 #include "utils/timestamp.h"
+#include "utils/varlena.h"
 
+#include "smgr_stats_aio.h"
+#include "smgr_stats_filter.h"
 #include "smgr_stats_guc.h"
+#include "smgr_stats_limit.h"
+#include "smgr_stats_partition.h"
+#include "smgr_stats_query.h"
+#include "smgr_stats_slow_io.h"
 #include "smgr_stats_store.h"
+#include "smgr_stats_tablespace.h"
 #include "smgr_stats_worker.h"
 
+bool smgr_stats_am_collector = false;
+
 /* Signal handling state */
 static volatile sig_atomic_t got_sigterm = 0;
 static volatile sig_atomic_t got_sighup = 0;
@@ -45,6 +61,60 @@ static void welford_to_query(StringInfo query, const SmgrStatsWelford* w) {
   }
 }
 
+/* The five columns of a timing histogram: hist, count, total_us, min_us, max_us */
+static void timing_to_query(StringInfo query, const SmgrStatsTimingHist* h) {
+  if (h->count == 0) {
+    appendStringInfoString(query, "NULL, NULL, NULL, NULL, NULL, ");
+    return;
+  }
+  appendStringInfoString(query, "ARRAY[");
+  for (int b = 0; b < SMGR_STATS_HIST_BINS; b++) {
+    appendStringInfo(query, "%s%lu", b > 0 ? "," : "", (unsigned long)h->bins[b]);
+  }
+  appendStringInfo(query, "]::bigint[], %lu, %lu, %lu, %lu, ", (unsigned long)h->count, (unsigned long)h->total_us,
+                   (unsigned long)h->min_us, (unsigned long)h->max_us);
+}
+
+/* The metadata op columns, each preceded by ", ": calls and time, plus blocks for prefetch and writeback */
+static void meta_ops_to_query(StringInfo query, const SmgrStatsMetaOpCounters* m) {
+  for (int op = 0; op < SMGR_STATS_NUM_META_OPS; op++) {
+    appendStringInfo(query, ", %lu", (unsigned long)m->calls[op]);
+    if (op == SMGR_STATS_META_PREFETCH || op == SMGR_STATS_META_WRITEBACK) {
+      appendStringInfo(query, ", %lu", (unsigned long)m->blocks[op]);
+    }
+    appendStringInfo(query, ", %lu", (unsigned long)m->time_us[op]);
+  }
+}
+
+static void fork_counts_to_query(StringInfo query, const uint64* counts, bool folded) {
+  if (!folded) {
+    appendStringInfoString(query, "NULL");
+    return;
+  }
+  appendStringInfoString(query, "ARRAY[");
+  for (int f = 0; f <= MAX_FORKNUM; f++) {
+    appendStringInfo(query, "%s%lu", f > 0 ? "," : "", (unsigned long)counts[f]);
+  }
+  appendStringInfoString(query, "]::bigint[]");
+}
+
+/* A request size histogram column followed by ", ", NULL if there were no requests of that kind */
+static void size_counts_to_query(StringInfo query, const uint64* bins) {
+  uint64 total = 0;
+  for (int b = 0; b < SMGR_STATS_SIZE_BINS; b++) {
+    total += bins[b];
+  }
+  if (total == 0) {
+    appendStringInfoString(query, "NULL, ");
+    return;
+  }
+  appendStringInfoString(query, "ARRAY[");
+  for (int b = 0; b < SMGR_STATS_SIZE_BINS; b++) {
+    appendStringInfo(query, "%s%lu", b > 0 ? "," : "", (unsigned long)bins[b]);
+  }
+  appendStringInfoString(query, "]::bigint[], ");
+}
+
 static void append_name_or_null(StringInfo query, const NameData* name) {
   if (name->data[0] != '\0') {
     appendStringInfo(query, "'%s'", NameStr(*name));
@@ -61,21 +131,43 @@ static void append_oid_or_null(StringInfo query, Oid oid) {
   }
 }
 
-static void smgr_stats_collect_and_insert(void) {
-  int count = 0;
-  int64 bucket_id;
-  SmgrStatsEntry* snapshot = smgr_stats_snapshot_and_reset(&count, &bucket_id);
-
-  if (count == 0) {
-    pfree(snapshot);
-    return;
-  }
-
+/*
+ * Run fn(arg) in a transaction of its own, with SPI connected and a snapshot
+ * pushed. An ERROR aborts the transaction and still disconnects SPI.
+ */
+static void run_in_spi(void (*fn)(void* arg), void* arg) {
   SetCurrentStatementStartTimestamp();
   StartTransactionCommand();
   SPI_connect();
   PushActiveSnapshot(GetTransactionSnapshot());
 
+  PG_TRY();
+  {
+    fn(arg);
+
+    PopActiveSnapshot();
+    CommitTransactionCommand();
+  }
+  PG_FINALLY();
+  {
+    SPI_finish();
+  }
+  PG_END_TRY();
+}
+
+/* Rows for one of the history tables, collected under bucket_id */
+typedef struct SmgrStatsInsertBatch {
+  void* items;
+  int count;
+  int64 bucket_id;
+} SmgrStatsInsertBatch;
+
+static void insert_history_rows(void* arg) {
+  const SmgrStatsInsertBatch* batch = arg;
+  SmgrStatsEntry* snapshot = batch->items;
+  int count = batch->count;
+  int64 bucket_id = batch->bucket_id;
+
   /*
    * Resolve metadata for entries that don't have it yet.
    * We can resolve metadata for entries belonging to our database or global/shared
@@ -88,112 +180,309 @@ static void smgr_stats_collect_and_insert(void) {
     }
   }
 
-  PG_TRY();
-  {
-    for (int i = 0; i < count; i++) {
-      SmgrStatsEntry* e = &snapshot[i];
-      StringInfoData query;
-      initStringInfo(&query);
-
-      appendStringInfo(&query,
-                       "INSERT INTO smgr_stats.history "
-                       "(bucket_id, spcoid, dboid, relnumber, forknum,"
-                       " reloid, main_reloid, relname, nspname, relkind,"
-                       " reads, read_blocks, writes, write_blocks,"
-                       " extends, extend_blocks, truncates, fsyncs,"
-                       " read_hist, read_count, read_total_us, read_min_us, read_max_us,"
-                       " write_hist, write_count, write_total_us, write_min_us, write_max_us,"
-                       " read_iat_mean_us, read_iat_cov, write_iat_mean_us, write_iat_cov,"
-                       " sequential_reads, random_reads, sequential_writes, random_writes,"
-                       " read_run_mean, read_run_cov, read_run_count,"
-                       " write_run_mean, write_run_cov, write_run_count,"
-                       " active_seconds, first_access, last_access) "
-                       "VALUES (%ld, %u, %u, %u, %d, ",
-                       (long)bucket_id, e->key.locator.spcOid, e->key.locator.dbOid, e->key.locator.relNumber,
-                       (int)e->key.forknum);
-
-      /* Metadata columns */
-      append_oid_or_null(&query, e->meta.reloid);
-      appendStringInfoString(&query, ", ");
-      append_oid_or_null(&query, e->meta.main_reloid);
-      appendStringInfoString(&query, ", ");
-      append_name_or_null(&query, &e->meta.relname);
-      appendStringInfoString(&query, ", ");
-      append_name_or_null(&query, &e->meta.nspname);
-      appendStringInfoString(&query, ", ");
-      if (e->meta.relkind != '\0') {
-        appendStringInfo(&query, "'%c'", e->meta.relkind);
-      } else {
-        appendStringInfoString(&query, "NULL");
-      }
+  const char* io_method = smgr_stats_io_method_name();
 
-      /* Stats columns */
-      appendStringInfo(&query,
-                       ", %lu, %lu, %lu, %lu,"
-                       " %lu, %lu, %lu, %lu, ",
-                       (unsigned long)e->reads, (unsigned long)e->read_blocks, (unsigned long)e->writes,
-                       (unsigned long)e->write_blocks, (unsigned long)e->extends, (unsigned long)e->extend_blocks,
-                       (unsigned long)e->truncates, (unsigned long)e->fsyncs);
-
-      if (e->read_timing.count > 0) {
-        appendStringInfoString(&query, "ARRAY[");
-        for (int b = 0; b < SMGR_STATS_HIST_BINS; b++) {
-          if (b > 0) {
-            appendStringInfoChar(&query, ',');
-          }
-          appendStringInfo(&query, "%lu", (unsigned long)e->read_timing.bins[b]);
-        }
-        appendStringInfo(&query, "]::bigint[], %lu, %lu, %lu, %lu, ", (unsigned long)e->read_timing.count,
-                         (unsigned long)e->read_timing.total_us, (unsigned long)e->read_timing.min_us,
-                         (unsigned long)e->read_timing.max_us);
-      } else {
-        appendStringInfoString(&query, "NULL, NULL, NULL, NULL, NULL, ");
-      }
+  for (int i = 0; i < count; i++) {
+    SmgrStatsEntry* e = &snapshot[i];
+    if (e->meta.metadata_valid && !smgr_stats_filter_relkind(e->meta.relkind)) {
+      continue; /* Relkind only became known just now */
+    }
+    StringInfoData query;
+    initStringInfo(&query);
 
-      if (e->write_timing.count > 0) {
-        appendStringInfoString(&query, "ARRAY[");
-        for (int b = 0; b < SMGR_STATS_HIST_BINS; b++) {
-          if (b > 0) {
-            appendStringInfoChar(&query, ',');
-          }
-          appendStringInfo(&query, "%lu", (unsigned long)e->write_timing.bins[b]);
-        }
-        appendStringInfo(&query, "]::bigint[], %lu, %lu, %lu, %lu, ", (unsigned long)e->write_timing.count,
-                         (unsigned long)e->write_timing.total_us, (unsigned long)e->write_timing.min_us,
-                         (unsigned long)e->write_timing.max_us);
-      } else {
-        appendStringInfoString(&query, "NULL, NULL, NULL, NULL, NULL, ");
-      }
+    appendStringInfo(&query,
+                     "INSERT INTO smgr_stats.history "
+                     "(bucket_id, spcoid, dboid, relnumber, forknum,"
+                     " reloid, main_reloid, relname, nspname, relkind,"
+                     " reads, read_blocks, writes, write_blocks,"
+                     " extends, extend_blocks, truncates, fsyncs,"
+                     " read_hist, read_count, read_total_us, read_min_us, read_max_us,"
+                     " write_hist, write_count, write_total_us, write_min_us, write_max_us,"
+                     " read_iat_mean_us, read_iat_cov, write_iat_mean_us, write_iat_cov,"
+                     " sequential_reads, random_reads, sequential_writes, random_writes,"
+                     " read_run_mean, read_run_cov, read_run_count,"
+                     " write_run_mean, write_run_cov, write_run_count,"
+                     " active_seconds, first_access, last_access, timing_sample_rate,"
+                     " throttle_hist, throttle_count, throttle_total_us, throttle_min_us, throttle_max_us,"
+                     " fork_reads, fork_writes, fork_extends, backend_type,"
+                     " extend_hist, extend_count, extend_total_us, extend_min_us, extend_max_us,"
+                     " zeroextend_hist, zeroextend_count, zeroextend_total_us, zeroextend_min_us, zeroextend_max_us,"
+                     " truncate_hist, truncate_count, truncate_total_us, truncate_min_us, truncate_max_us,"
+                     " fsync_hist, fsync_count, fsync_total_us, fsync_min_us, fsync_max_us, truncated_blocks,"
+                     " nblocks_calls, nblocks_time_us, exists_calls, exists_time_us,"
+                     " prefetches, prefetch_blocks, prefetch_time_us,"
+                     " writebacks, writeback_blocks, writeback_time_us, closes, close_time_us,"
+                     " aio_stage_hist, aio_stage_count, aio_stage_total_us, aio_stage_min_us, aio_stage_max_us,"
+                     " aio_device_hist, aio_device_count, aio_device_total_us, aio_device_min_us, aio_device_max_us,"
+                     " aio_completion_hist, aio_completion_count, aio_completion_total_us, aio_completion_min_us,"
+                     " aio_completion_max_us, read_size_hist, write_size_hist, zeroextend_size_hist, io_method) "
+                     "VALUES (%ld, %u, %u, %u, %d, ",
+                     (long)bucket_id, e->key.locator.spcOid, e->key.locator.dbOid, e->key.locator.relNumber,
+                     (int)e->key.forknum);
+
+    /* Metadata columns */
+    append_oid_or_null(&query, e->meta.reloid);
+    appendStringInfoString(&query, ", ");
+    append_oid_or_null(&query, e->meta.main_reloid);
+    appendStringInfoString(&query, ", ");
+    append_name_or_null(&query, &e->meta.relname);
+    appendStringInfoString(&query, ", ");
+    append_name_or_null(&query, &e->meta.nspname);
+    appendStringInfoString(&query, ", ");
+    if (e->meta.relkind != '\0') {
+      appendStringInfo(&query, "'%c'", e->meta.relkind);
+    } else {
+      appendStringInfoString(&query, "NULL");
+    }
+
+    /* Stats columns */
+    appendStringInfo(&query,
+                     ", %lu, %lu, %lu, %lu,"
+                     " %lu, %lu, %lu, %lu, ",
+                     (unsigned long)e->reads, (unsigned long)e->read_blocks, (unsigned long)e->writes,
+                     (unsigned long)e->write_blocks, (unsigned long)e->extends, (unsigned long)e->extend_blocks,
+                     (unsigned long)e->truncates, (unsigned long)e->fsyncs);
+
+    timing_to_query(&query, &e->read_timing);
+    timing_to_query(&query, &e->write_timing);
+
+    welford_to_query(&query, &e->read_burst.iat);
+    welford_to_query(&query, &e->write_burst.iat);
+
+    appendStringInfo(&query, "%lu, %lu, %lu, %lu, ", (unsigned long)e->sequential_reads,
+                     (unsigned long)e->random_reads, (unsigned long)e->sequential_writes,
+                     (unsigned long)e->random_writes);
+
+    welford_to_query(&query, &e->read_runs);
+    appendStringInfo(&query, "%lu, ", (unsigned long)e->read_runs.count);
+    welford_to_query(&query, &e->write_runs);
+    appendStringInfo(&query, "%lu, ", (unsigned long)e->write_runs.count);
+
+    appendStringInfo(&query, "%u, '%s', '%s', ", e->active_seconds, timestamptz_to_str(e->first_access),
+                     timestamptz_to_str(e->last_access));
+    if (e->timing_sample_rate > 0) {
+      appendStringInfo(&query, "%u, ", e->timing_sample_rate);
+    } else {
+      appendStringInfoString(&query, "NULL, ");
+    }
+    timing_to_query(&query, &e->throttle_timing);
+
+    bool folded = smgr_stats_entry_has_folded_forks(e);
+    fork_counts_to_query(&query, e->forks.reads, folded);
+    appendStringInfoString(&query, ", ");
+    fork_counts_to_query(&query, e->forks.writes, folded);
+    appendStringInfoString(&query, ", ");
+    fork_counts_to_query(&query, e->forks.extends, folded);
+    if (e->key.backend_type != B_INVALID) {
+      appendStringInfo(&query, ", '%s', ", GetBackendTypeDesc((BackendType)e->key.backend_type));
+    } else {
+      appendStringInfoString(&query, ", NULL, ");
+    }
+    timing_to_query(&query, &e->extend_timing);
+    timing_to_query(&query, &e->zeroextend_timing);
+    timing_to_query(&query, &e->truncate_timing);
+    timing_to_query(&query, &e->fsync_timing);
+    appendStringInfo(&query, "%lu", (unsigned long)e->truncated_blocks);
+    meta_ops_to_query(&query, &e->meta_ops);
+    appendStringInfoString(&query, ", ");
+    for (int p = 0; p < SMGR_STATS_NUM_AIO_PHASES; p++) {
+      timing_to_query(&query, &e->aio_phase_timing[p]);
+    }
+    size_counts_to_query(&query, e->sizes.reads);
+    size_counts_to_query(&query, e->sizes.writes);
+    size_counts_to_query(&query, e->sizes.zeroextends);
+    appendStringInfo(&query, "'%s')", io_method);
+
+    SPI_execute(query.data, false, 0);
+    pfree(query.data);
+  }
+}
+
+/* Returns the bucket that was just completed */
+static int64 smgr_stats_collect_and_insert(void) {
+  int count = 0;
+  int64 bucket_id;
+  SmgrStatsEntry* snapshot = smgr_stats_snapshot_and_reset(&count, &bucket_id);
+
+  if (count == 0) {
+    pfree(snapshot);
+    return bucket_id;
+  }
+
+  SmgrStatsInsertBatch batch = {.items = snapshot, .count = count, .bucket_id = bucket_id};
+  run_in_spi(insert_history_rows, &batch);
+
+  pfree(snapshot);
+  return bucket_id;
+}
+
+static void insert_query_history_rows(void* arg) {
+  const SmgrStatsInsertBatch* batch = arg;
+  SmgrStatsQueryEntry* entries = batch->items;
+  int count = batch->count;
+  int64 bucket_id = batch->bucket_id;
+
+  for (int i = 0; i < count; i++) {
+    SmgrStatsQueryEntry* e = &entries[i];
+    StringInfoData query;
+    initStringInfo(&query);
+
+    appendStringInfo(&query,
+                     "INSERT INTO smgr_stats.query_history "
+                     "(bucket_id, queryid, spcoid, dboid, relnumber, forknum, reads, read_blocks, read_time_us, "
+                     "writes, write_blocks, write_time_us, extends, extend_blocks, error) "
+                     "VALUES (" INT64_FORMAT ", " INT64_FORMAT ", %u, %u, %u, %d, " UINT64_FORMAT ", " UINT64_FORMAT
+                     ", " UINT64_FORMAT ", " UINT64_FORMAT ", " UINT64_FORMAT ", " UINT64_FORMAT ", " UINT64_FORMAT
+                     ", " UINT64_FORMAT ", " UINT64_FORMAT ")",
+                     bucket_id, e->key.queryid, e->key.locator.spcOid, e->key.locator.dbOid,
+                     e->key.locator.relNumber, (int)e->key.forknum, e->counters.reads, e->counters.read_blocks,
+                     e->counters.read_us, e->counters.writes, e->counters.write_blocks, e->counters.write_us,
+                     e->counters.extends, e->counters.extend_blocks, e->error);
+
+    SPI_execute(query.data, false, 0);
+    pfree(query.data);
+  }
+}
 
-      welford_to_query(&query, &e->read_burst.iat);
-      welford_to_query(&query, &e->write_burst.iat);
+/* Persist and reset the per-query top-N table under the bucket just collected */
+static void smgr_stats_insert_query_history(int64 bucket_id) {
+  if (smgr_stats_query_top_n == 0) {
+    return;
+  }
+  int count = 0;
+  SmgrStatsQueryEntry* entries = smgr_stats_query_snapshot(&count, true);
 
-      appendStringInfo(&query, "%lu, %lu, %lu, %lu, ", (unsigned long)e->sequential_reads,
-                       (unsigned long)e->random_reads, (unsigned long)e->sequential_writes,
-                       (unsigned long)e->random_writes);
+  if (count == 0) {
+    pfree(entries);
+    return;
+  }
 
-      welford_to_query(&query, &e->read_runs);
-      appendStringInfo(&query, "%lu, ", (unsigned long)e->read_runs.count);
-      welford_to_query(&query, &e->write_runs);
-      appendStringInfo(&query, "%lu, ", (unsigned long)e->write_runs.count);
+  SmgrStatsInsertBatch batch = {.items = entries, .count = count, .bucket_id = bucket_id};
+  run_in_spi(insert_query_history_rows, &batch);
 
-      appendStringInfo(&query, "%u, '%s', '%s')", e->active_seconds, timestamptz_to_str(e->first_access),
-                       timestamptz_to_str(e->last_access));
+  pfree(entries);
+}
 
-      SPI_execute(query.data, false, 0);
-      pfree(query.data);
+static void insert_tablespace_history_rows(void* arg) {
+  const SmgrStatsInsertBatch* batch = arg;
+  SmgrStatsTablespaceStats* stats = batch->items;
+  int count = batch->count;
+  int64 bucket_id = batch->bucket_id;
+
+  for (int i = 0; i < count; i++) {
+    SmgrStatsTablespaceStats* s = &stats[i];
+    if (s->interval_us == 0) {
+      continue;
     }
+    StringInfoData query;
+    initStringInfo(&query);
 
-    PopActiveSnapshot();
-    CommitTransactionCommand();
+    appendStringInfo(&query,
+                     "INSERT INTO smgr_stats.tablespace_history "
+                     "(bucket_id, spcoid, ios, io_time_us, busy_us, interval_us, avg_queue_depth, max_queue_depth, "
+                     "utilization) "
+                     "VALUES (" INT64_FORMAT ", %u, " UINT64_FORMAT ", " UINT64_FORMAT ", " UINT64_FORMAT
+                     ", " UINT64_FORMAT ", %g, %u, %g)",
+                     bucket_id, s->spcoid, s->ios, s->io_time_us, s->busy_us, s->interval_us,
+                     (double)s->io_time_us / (double)s->interval_us, s->max_depth,
+                     Min((double)s->busy_us / (double)s->interval_us, 1.0));
+
+    SPI_execute(query.data, false, 0);
+    pfree(query.data);
   }
-  PG_FINALLY();
-  {
-    SPI_finish();
+}
+
+/* Persist each tablespace's queue depth and utilization and start a new bucket for them */
+static void smgr_stats_insert_tablespace_history(int64 bucket_id) {
+  int count = 0;
+  SmgrStatsTablespaceStats* stats = smgr_stats_tablespace_snapshot(&count, true);
+
+  if (count == 0) {
+    pfree(stats);
+    return;
   }
-  PG_END_TRY();
 
-  pfree(snapshot);
+  SmgrStatsInsertBatch batch = {.items = stats, .count = count, .bucket_id = bucket_id};
+  run_in_spi(insert_tablespace_history_rows, &batch);
+
+  pfree(stats);
+}
+
+static void insert_slow_io_rows(void* arg) {
+  const SmgrStatsInsertBatch* batch = arg;
+  SmgrStatsSlowIO* ios = batch->items;
+  int count = batch->count;
+  int64 bucket_id = batch->bucket_id;
+
+  for (int i = 0; i < count; i++) {
+    SmgrStatsSlowIO* io = &ios[i];
+    StringInfoData query;
+    initStringInfo(&query);
+
+    appendStringInfo(&query,
+                     "INSERT INTO smgr_stats.slow_io "
+                     "(bucket_id, completed_at, pid, backend_type, op, spcoid, dboid, relnumber, forknum, blocknum, "
+                     "nblocks, elapsed_us) "
+                     "VALUES (" INT64_FORMAT ", '%s', %d, '%s', '%s', %u, %u, %u, %d, ",
+                     bucket_id, timestamptz_to_str(io->completed_at), io->pid, GetBackendTypeDesc(io->backend_type),
+                     smgr_stats_inflight_op_name(io->op), io->locator.spcOid, io->locator.dbOid,
+                     io->locator.relNumber, io->forknum);
+    if (BlockNumberIsValid(io->blocknum)) {
+      appendStringInfo(&query, "%u, ", io->blocknum);
+    } else {
+      appendStringInfoString(&query, "NULL, ");
+    }
+    appendStringInfo(&query, "%u, " UINT64_FORMAT ")", io->nblocks, io->elapsed_us);
+
+    SPI_execute(query.data, false, 0);
+    pfree(query.data);
+  }
+}
+
+/* Persist the slow I/Os recorded since the last collection */
+static void smgr_stats_insert_slow_io(int64 bucket_id) {
+  int count = 0;
+  SmgrStatsSlowIO* ios = smgr_stats_slow_io_snapshot(&count, true);
+
+  if (count == 0) {
+    pfree(ios);
+    return;
+  }
+
+  SmgrStatsInsertBatch batch = {.items = ios, .count = count, .bucket_id = bucket_id};
+  run_in_spi(insert_slow_io_rows, &batch);
+
+  pfree(ios);
+}
+
+static void insert_relfile_history_rows(void* arg) {
+  const SmgrStatsInsertBatch* batch = arg;
+  SmgrStatsRelfileAssoc* assocs = batch->items;
+  int count = batch->count;
+
+  for (int i = 0; i < count; i++) {
+    SmgrStatsRelfileAssoc* a = &assocs[i];
+    StringInfoData query;
+    initStringInfo(&query);
+
+    const char* is_redo_str = a->is_redo ? "true" : "false";  // NOLINT(readability-implicit-bool-conversion)
+    appendStringInfo(&query,
+                     "INSERT INTO smgr_stats.relfile_history "
+                     "(spcoid, dboid, old_relnumber, new_relnumber, forknum, is_redo, reloid, relname, nspname) "
+                     "VALUES (%u, %u, %u, %u, %d, %s, ",
+                     a->new_locator.spcOid, a->new_locator.dbOid, a->old_locator.relNumber, a->new_locator.relNumber,
+                     (int)a->forknum, is_redo_str);
+
+    append_oid_or_null(&query, a->reloid);
+    appendStringInfoString(&query, ", ");
+    append_name_or_null(&query, &a->relname);
+    appendStringInfoString(&query, ", ");
+    append_name_or_null(&query, &a->nspname);
+    appendStringInfoChar(&query, ')');
+
+    SPI_execute(query.data, false, 0);
+    pfree(query.data);
+  }
 }
 
 static void smgr_stats_insert_relfile_history(void) {
@@ -204,86 +493,310 @@ static void smgr_stats_insert_relfile_history(void) {
     return;
   }
 
-  SetCurrentStatementStartTimestamp();
-  StartTransactionCommand();
-  SPI_connect();
-  PushActiveSnapshot(GetTransactionSnapshot());
+  SmgrStatsInsertBatch batch = {.items = assocs, .count = count};
+  run_in_spi(insert_relfile_history_rows, &batch);
 
-  PG_TRY();
-  {
-    for (int i = 0; i < count; i++) {
-      SmgrStatsRelfileAssoc* a = &assocs[i];
-      StringInfoData query;
-      initStringInfo(&query);
-
-      const char* is_redo_str = a->is_redo ? "true" : "false";  // NOLINT(readability-implicit-bool-conversion)
-      appendStringInfo(&query,
-                       "INSERT INTO smgr_stats.relfile_history "
-                       "(spcoid, dboid, old_relnumber, new_relnumber, forknum, is_redo, reloid, relname, nspname) "
-                       "VALUES (%u, %u, %u, %u, %d, %s, ",
-                       a->new_locator.spcOid, a->new_locator.dbOid, a->old_locator.relNumber, a->new_locator.relNumber,
-                       (int)a->forknum, is_redo_str);
-
-      append_oid_or_null(&query, a->reloid);
-      appendStringInfoString(&query, ", ");
-      append_name_or_null(&query, &a->relname);
-      appendStringInfoString(&query, ", ");
-      append_name_or_null(&query, &a->nspname);
-      appendStringInfoChar(&query, ')');
-
-      SPI_execute(query.data, false, 0);
-      pfree(query.data);
+  pfree(assocs);
+}
+
+/* Most relations whose page cache is released per collection */
+#define COLD_RELEASE_MAX_RELATIONS 1000
+
+/*
+ * Drop one fork's segment files from the OS page cache and return how many were
+ * advised, or -1 if the file was replaced while we looked at it. Existence is
+ * checked through the SMGR chain; SMGR has no callback for releasing cache, so
+ * the segments themselves are opened by path, which is only right when md stores
+ * them (see cold_release_md_below()). The first segment is opened before that
+ * check and compared with what the path names after it, so the file advised is
+ * the one the chain saw.
+ */
+static int release_fork_cache(RelFileLocator locator, ForkNumber forknum, uint64* bytes) {
+  int segments = 0;
+#if defined(USE_POSIX_FADVISE) && defined(POSIX_FADV_DONTNEED)
+  RelPathStr path = relpathperm(locator, forknum);
+  int first_fd = OpenTransientFile(path.str, O_RDONLY | PG_BINARY);
+  if (first_fd < 0) {
+    return 0;
+  }
+
+  SMgrRelation reln = smgropen(locator, INVALID_PROC_NUMBER);
+  bool exists = smgrexists(reln, forknum);
+  smgrclose(reln);
+  struct stat opened;
+  struct stat current;
+  if (!exists || fstat(first_fd, &opened) != 0 || stat(path.str, &current) != 0 || opened.st_dev != current.st_dev ||
+      opened.st_ino != current.st_ino) {
+    CloseTransientFile(first_fd);
+    return exists ? -1 : 0;
+  }
+
+  for (uint32 segno = 0;; segno++) {
+    int fd = first_fd;
+    if (segno > 0) {
+      char segpath[MAXPGPATH];
+      snprintf(segpath, MAXPGPATH, "%s.%u", path.str, segno);
+      fd = OpenTransientFile(segpath, O_RDONLY | PG_BINARY);
+      if (fd < 0) {
+        break; /* Past the last segment, or dropped meanwhile */
+      }
     }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      *bytes += (uint64)st.st_size;
+    }
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    CloseTransientFile(fd);
+    segments++;
+  }
+#else
+  (void)locator;
+  (void)forknum;
+  (void)bytes;
+#endif
+  return segments;
+}
 
-    PopActiveSnapshot();
-    CommitTransactionCommand();
+/* 1 if md is the storage manager right below smgr_stats in smgr_chain, -1 until checked */
+static int cold_release_md = -1;
+
+/* release_fork_cache() assumes md's file layout. smgr_chain only changes on restart, so check it once. */
+static bool cold_release_md_below(void) {
+  if (cold_release_md >= 0) {
+    return cold_release_md == 1;
   }
-  PG_FINALLY();
-  {
-    SPI_finish();
+  const char* chain = GetConfigOption("smgr_chain", true, false);
+  char* raw = pstrdup(chain ? chain : "");
+  List* names = NIL;
+  cold_release_md = 0;
+  if (SplitIdentifierString(raw, ',', &names)) {
+    ListCell* lc;
+    foreach (lc, names) {
+      if (strcmp(lfirst(lc), "smgr_stats") == 0) {
+        ListCell* next = lnext(names, lc);
+        cold_release_md = next != NULL && strcmp(lfirst(next), "md") == 0;
+        break;
+      }
+    }
   }
-  PG_END_TRY();
+  list_free(names);
+  pfree(raw);
 
-  pfree(assocs);
+  if (cold_release_md == 0) {
+    elog(LOG, "pg_smgrstat: cold_release_buckets ignored, md is not the storage manager below smgr_stats");
+  }
+  return cold_release_md == 1;
 }
 
-static void smgr_stats_run_retention(void) {
-  if (smgr_stats_retention_hours <= 0) {
-    return; /* retention disabled */
+typedef struct ColdRelation {
+  RelFileLocator locator;
+  int64 last_bucket_id;
+  int64 active_seconds;
+  Oid reloid;       /* pg_class OID last recorded, InvalidOid if unknown */
+  NameData relname; /* Empty if unknown */
+} ColdRelation;
+
+typedef struct ColdReleaseWindow {
+  int64 bucket_id;    /* Bucket the releases are logged under */
+  int64 cold_after;   /* Relations without I/O after this bucket are cold */
+  int64 window_start; /* Activity is summed over the buckets after this one */
+} ColdReleaseWindow;
+
+/*
+ * Is the file at c's locator still the relation its history rows were recorded
+ * for? A relfilenumber is reused once a dropped relation's file is gone. Only
+ * relations of this database can be looked up; their pg_class OID must match
+ * the one last recorded, if any was.
+ */
+static bool cold_relation_is_current(const ColdRelation* c) {
+  if (c->locator.dbOid != MyDatabaseId || !OidIsValid(c->reloid)) {
+    return true;
   }
+  /* pg_class stores 0 for the database's default tablespace */
+  Oid reltablespace = c->locator.spcOid == MyDatabaseTableSpace ? InvalidOid : c->locator.spcOid;
+  return RelidByRelfilenumber(reltablespace, c->locator.relNumber) == c->reloid;
+}
 
-  SetCurrentStatementStartTimestamp();
-  StartTransactionCommand();
-  SPI_connect();
-  PushActiveSnapshot(GetTransactionSnapshot());
+static void release_cold_files_in_window(void* arg) {
+  const ColdReleaseWindow* window = arg;
+  int64 bucket_id = window->bucket_id;
+  int64 cold_after = window->cold_after;
+  int64 window_start = window->window_start;
 
-  PG_TRY();
-  {
-    StringInfoData query;
-    initStringInfo(&query);
-    appendStringInfo(&query, "DELETE FROM smgr_stats.history WHERE collected_at < now() - interval '%d hours'",
-                     smgr_stats_retention_hours);
+  StringInfoData query;
+  initStringInfo(&query);
+  /*
+   * Synthetic aggregates (spcoid 0) have no files; buckets with only metadata ops (nblocks, ...) are idle.
+   * Files a rewrite retired (relfile_history) are gone, any file at their path now belongs to another relation.
+   */
+  appendStringInfo(&query,
+                   "SELECT h.spcoid, h.dboid, h.relnumber, max(h.bucket_id), sum(h.active_seconds)::int8, "
+                   "(array_agg(h.relname ORDER BY h.bucket_id DESC))[1], "
+                   "(array_agg(h.reloid ORDER BY h.bucket_id DESC))[1] "
+                   "FROM smgr_stats.history h "
+                   "WHERE h.bucket_id > %ld AND h.spcoid <> 0 AND h.reads + h.writes + h.extends > 0 "
+                   "GROUP BY h.spcoid, h.dboid, h.relnumber "
+                   "HAVING max(h.bucket_id) <= %ld AND sum(h.active_seconds) <= %d "
+                   "AND NOT EXISTS (SELECT 1 FROM smgr_stats.cache_release_log l "
+                   "WHERE l.spcoid = h.spcoid AND l.dboid = h.dboid AND l.relnumber = h.relnumber "
+                   "AND l.last_bucket_id >= max(h.bucket_id)) "
+                   "AND NOT EXISTS (SELECT 1 FROM smgr_stats.relfile_history r "
+                   "WHERE r.dboid = h.dboid AND r.old_relnumber = h.relnumber) "
+                   "LIMIT %d",
+                   (long)window_start, (long)cold_after, smgr_stats_cold_release_max_active_seconds,
+                   COLD_RELEASE_MAX_RELATIONS);
+  SPI_execute(query.data, true, 0);
+
+  /* Copy the candidates out, the inserts below replace SPI_tuptable */
+  uint64 count = SPI_processed;
+  ColdRelation* cold = palloc0(sizeof(ColdRelation) * Max(count, 1));
+  for (uint64 i = 0; i < count; i++) {
+    HeapTuple tuple = SPI_tuptable->vals[i];
+    TupleDesc desc = SPI_tuptable->tupdesc;
+    bool isnull;
+    cold[i].locator.spcOid = DatumGetObjectId(SPI_getbinval(tuple, desc, 1, &isnull));
+    cold[i].locator.dbOid = DatumGetObjectId(SPI_getbinval(tuple, desc, 2, &isnull));
+    cold[i].locator.relNumber = DatumGetObjectId(SPI_getbinval(tuple, desc, 3, &isnull));
+    cold[i].last_bucket_id = DatumGetInt64(SPI_getbinval(tuple, desc, 4, &isnull));
+    cold[i].active_seconds = DatumGetInt64(SPI_getbinval(tuple, desc, 5, &isnull));
+    Datum relname = SPI_getbinval(tuple, desc, 6, &isnull);
+    if (!isnull) {
+      namestrcpy(&cold[i].relname, NameStr(*DatumGetName(relname)));
+    }
+    Datum reloid = SPI_getbinval(tuple, desc, 7, &isnull);
+    cold[i].reloid = isnull ? InvalidOid : DatumGetObjectId(reloid);
+  }
+
+  for (uint64 i = 0; i < count; i++) {
+    ColdRelation* c = &cold[i];
+    if (!cold_relation_is_current(c)) {
+      elog(LOG, "pg_smgrstat: not releasing page cache of %u/%u/%u (%s), its relfilenode was reused",
+           c->locator.spcOid, c->locator.dbOid, c->locator.relNumber, NameStr(c->relname));
+      continue;
+    }
+    uint64 bytes = 0;
+    int segments = 0;
+    bool replaced = false;
+    for (ForkNumber forknum = 0; forknum <= MAX_FORKNUM && !replaced; forknum++) {
+      int released = release_fork_cache(c->locator, forknum, &bytes);
+      replaced = released < 0;
+      segments += Max(released, 0);
+    }
+    if (replaced) {
+      elog(LOG, "pg_smgrstat: stopped releasing page cache of %u/%u/%u (%s), its file was replaced meanwhile",
+           c->locator.spcOid, c->locator.dbOid, c->locator.relNumber, NameStr(c->relname));
+    }
+    if (segments == 0) {
+      continue;
+    }
+
+    resetStringInfo(&query);
+    appendStringInfo(&query,
+                     "INSERT INTO smgr_stats.cache_release_log "
+                     "(bucket_id, spcoid, dboid, relnumber, relname, last_bucket_id, active_seconds, segments, bytes) "
+                     "VALUES (%ld, %u, %u, %u, ",
+                     (long)bucket_id, c->locator.spcOid, c->locator.dbOid, c->locator.relNumber);
+    append_name_or_null(&query, &c->relname);
+    appendStringInfo(&query, ", %ld, %ld, %d, %lu)", (long)c->last_bucket_id, (long)c->active_seconds, segments,
+                     (unsigned long)bytes);
     SPI_execute(query.data, false, 0);
-    pfree(query.data);
+  }
 
-    PopActiveSnapshot();
-    CommitTransactionCommand();
+  pfree(cold);
+  pfree(query.data);
+}
+
+/*
+ * Release the page cache of relations that went cold: no I/O during the last
+ * cold_release_buckets buckets, and at most cold_release_max_active_seconds of
+ * activity in the same number of buckets before that. Each relation is released
+ * once per cold spell and logged in smgr_stats.cache_release_log.
+ */
+static void smgr_stats_release_cold_files(int64 bucket_id) {
+  if (smgr_stats_cold_release_buckets <= 0) {
+    return;
   }
-  PG_FINALLY();
-  {
-    SPI_finish();
+  if (!cold_release_md_below()) {
+    return;
   }
-  PG_END_TRY();
+  int64 cold_after = bucket_id - smgr_stats_cold_release_buckets;
+  int64 window_start = cold_after - smgr_stats_cold_release_buckets;
+  if (cold_after <= 0) {
+    return;
+  }
+
+  ColdReleaseWindow window = {.bucket_id = bucket_id, .cold_after = cold_after, .window_start = window_start};
+  run_in_spi(release_cold_files_in_window, &window);
+}
+
+static void delete_expired_rows(void* arg) {
+  (void)arg;
+  StringInfoData query;
+  initStringInfo(&query);
+  appendStringInfo(&query, "DELETE FROM smgr_stats.history WHERE collected_at < now() - interval '%d hours'",
+                   smgr_stats_retention_hours);
+  SPI_execute(query.data, false, 0);
+  resetStringInfo(&query);
+  appendStringInfo(&query,
+                   "DELETE FROM smgr_stats.cache_release_log WHERE released_at < now() - interval '%d hours'",
+                   smgr_stats_retention_hours);
+  SPI_execute(query.data, false, 0);
+  resetStringInfo(&query);
+  appendStringInfo(&query,
+                   "DELETE FROM smgr_stats.query_history WHERE collected_at < now() - interval '%d hours'",
+                   smgr_stats_retention_hours);
+  SPI_execute(query.data, false, 0);
+  resetStringInfo(&query);
+  appendStringInfo(&query,
+                   "DELETE FROM smgr_stats.tablespace_history WHERE collected_at < now() - interval '%d hours'",
+                   smgr_stats_retention_hours);
+  SPI_execute(query.data, false, 0);
+  resetStringInfo(&query);
+  appendStringInfo(&query, "DELETE FROM smgr_stats.slow_io WHERE collected_at < now() - interval '%d hours'",
+                   smgr_stats_retention_hours);
+  SPI_execute(query.data, false, 0);
+  pfree(query.data);
+}
+
+static void smgr_stats_run_retention(void) {
+  if (smgr_stats_retention_hours <= 0) {
+    return; /* retention disabled */
+  }
+
+  run_in_spi(delete_expired_rows, NULL);
+}
+
+static void load_io_limits(void* arg) {
+  (void)arg;
+  smgr_stats_load_io_limits();
+}
+
+/* Pick up changes to smgr_stats.io_limits */
+static void smgr_stats_refresh_io_limits(void) {
+  run_in_spi(load_io_limits, NULL);
 }
 
 static void smgr_stats_collect_cycle(void) {
   pgstat_report_activity(STATE_RUNNING, "collecting smgr stats");
-  smgr_stats_collect_and_insert();
+  /* Ask buffering backends to push their pending stats; anything not yet flushed lands in the next bucket */
+  smgr_stats_request_flush();
+  int64 bucket_id = smgr_stats_collect_and_insert();
+  smgr_stats_insert_query_history(bucket_id);
+  smgr_stats_insert_tablespace_history(bucket_id);
+  smgr_stats_insert_slow_io(bucket_id);
+  smgr_stats_partition_maintain();
+  smgr_stats_refresh_io_limits();
+  smgr_stats_release_cold_files(bucket_id);
   smgr_stats_insert_relfile_history();
   smgr_stats_run_retention();
   pgstat_report_activity(STATE_IDLE, NULL);
 }
 
+static void create_extension(void* arg) {
+  (void)arg;
+  SPI_execute("CREATE EXTENSION IF NOT EXISTS pg_smgrstat", false, 0);
+}
+
 PGDLLEXPORT void smgr_stats_worker_main(Datum main_arg);
 
 void smgr_stats_worker_main(Datum main_arg) {
@@ -293,20 +806,13 @@ void smgr_stats_worker_main(Datum main_arg) {
   pqsignal(SIGHUP, sighup_handler);
   BackgroundWorkerUnblockSignals();
 
+  smgr_stats_am_collector = true;
+
   /* Connect to the configured database */
   BackgroundWorkerInitializeConnection(smgr_stats_database, NULL, 0);
 
   /* Bootstrap: create the extension if it doesn't exist */
-  SetCurrentStatementStartTimestamp();
-  StartTransactionCommand();
-  SPI_connect();
-  PushActiveSnapshot(GetTransactionSnapshot());
-
-  SPI_execute("CREATE EXTENSION IF NOT EXISTS pg_smgrstat", false, 0);
-
-  PopActiveSnapshot();
-  SPI_finish();
-  CommitTransactionCommand();
+  run_in_spi(create_extension, NULL);
 
   elog(LOG, "pg_smgrstat: worker started, collection_interval=%d", smgr_stats_collection_interval);
 
@@ -1,4 +1,7 @@
 #pragma once
 #include "postgres.h"
 
+/* True in the collector process. Its own I/O is recorded under the collector key and never throttled. */
+extern bool smgr_stats_am_collector;
+
 extern void smgr_stats_register_worker(void);